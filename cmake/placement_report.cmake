@@ -0,0 +1,60 @@
+# Lists the memory region every hot symbol was linked into, run after the build with
+#   cmake -DNM=<nm> -DELF=<elf> -DOUTPUT=<report> -DPLATFORM=<PICO_PLATFORM> -DSYMBOLS=<regex> -P placement_report.cmake
+
+if(PLATFORM MATCHES "^rp2040")
+    set(scratchX 0x20040000)
+else()
+    set(scratchX 0x20080000)
+endif()
+math(EXPR scratchX "${scratchX}")
+math(EXPR scratchY "${scratchX} + 0x1000")
+math(EXPR scratchEnd "${scratchX} + 0x2000")
+math(EXPR flashEnd "0x20000000")
+
+set(symbolFile "${OUTPUT}.nm")
+execute_process(
+    COMMAND ${NM} -C -S -n ${ELF}
+    OUTPUT_FILE ${symbolFile}
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${ELF}")
+endif()
+file(STRINGS ${symbolFile} lines REGEX "${SYMBOLS}")
+file(REMOVE ${symbolFile})
+
+set(report "")
+foreach(region flash sram scratch_x scratch_y other)
+    set(${region}Total 0)
+endforeach()
+
+foreach(line IN LISTS lines)
+    if(NOT line MATCHES "^([0-9a-fA-F]+) ([0-9a-fA-F]+) [A-Za-z] (.*)$")
+        continue()
+    endif()
+    set(name "${CMAKE_MATCH_3}")
+    math(EXPR address "0x${CMAKE_MATCH_1}")
+    math(EXPR size "0x${CMAKE_MATCH_2}")
+
+    if(address LESS flashEnd)
+        set(region flash)
+    elseif(address LESS scratchX)
+        set(region sram)
+    elseif(address LESS scratchY)
+        set(region scratch_x)
+    elseif(address LESS scratchEnd)
+        set(region scratch_y)
+    else()
+        set(region other)
+    endif()
+    math(EXPR ${region}Total "${${region}Total} + ${size}")
+    string(APPEND report "${region}\t${size}\t${name}\n")
+endforeach()
+
+string(APPEND report "\n")
+foreach(region flash sram scratch_x scratch_y other)
+    string(APPEND report "${region} total: ${${region}Total} bytes\n")
+endforeach()
+
+file(WRITE ${OUTPUT} "${report}")
+message(STATUS "Hot symbol placement written to ${OUTPUT}")
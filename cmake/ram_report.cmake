@@ -0,0 +1,78 @@
+# Sums the SRAM taken by static data and fails the build if less than MIN_HEAP bytes are left for the heap, run
+# after the build with
+#   cmake -DNM=<nm> -DELF=<elf> -DOUTPUT=<report> -DMIN_HEAP=<bytes> -P ram_report.cmake
+
+math(EXPR sramStart "0x20000000")
+set(largestCount 16)
+
+set(symbolFile "${OUTPUT}.nm")
+execute_process(
+    COMMAND ${NM} -C -S --size-sort ${ELF}
+    OUTPUT_FILE ${symbolFile}
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${ELF}")
+endif()
+file(STRINGS ${symbolFile} lines REGEX "^[0-9a-fA-F]+ [0-9a-fA-F]+ [bBdD] ")
+
+# The linker script puts the heap between the end of .bss and the top of main SRAM
+execute_process(
+    COMMAND ${NM} ${ELF}
+    OUTPUT_FILE ${symbolFile}
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${ELF}")
+endif()
+file(STRINGS ${symbolFile} heapLines REGEX " (__end__|__HeapLimit)$")
+file(REMOVE ${symbolFile})
+
+set(staticTotal 0)
+set(largest "")
+foreach(line IN LISTS lines)
+    if(NOT line MATCHES "^([0-9a-fA-F]+) ([0-9a-fA-F]+) [A-Za-z] (.*)$")
+        continue()
+    endif()
+    math(EXPR address "0x${CMAKE_MATCH_1}")
+    if(address LESS sramStart)
+        continue()
+    endif()
+    math(EXPR size "0x${CMAKE_MATCH_2}")
+    math(EXPR staticTotal "${staticTotal} + ${size}")
+    # nm sorted by size, so the last ones are the biggest
+    list(APPEND largest "${size}\t${CMAKE_MATCH_3}")
+endforeach()
+list(LENGTH largest count)
+if(count GREATER largestCount)
+    math(EXPR first "${count} - ${largestCount}")
+    list(SUBLIST largest ${first} ${largestCount} largest)
+endif()
+list(REVERSE largest)
+
+set(heapStart "")
+set(heapLimit "")
+foreach(line IN LISTS heapLines)
+    if(line MATCHES "^([0-9a-fA-F]+) [A-Za-z] __end__$")
+        math(EXPR heapStart "0x${CMAKE_MATCH_1}")
+    elseif(line MATCHES "^([0-9a-fA-F]+) [A-Za-z] __HeapLimit$")
+        math(EXPR heapLimit "0x${CMAKE_MATCH_1}")
+    endif()
+endforeach()
+if(heapStart STREQUAL "" OR heapLimit STREQUAL "")
+    message(FATAL_ERROR "No __end__ or __HeapLimit in ${ELF}")
+endif()
+math(EXPR heapSize "${heapLimit} - ${heapStart}")
+
+set(report "Largest static SRAM symbols:\n")
+foreach(entry IN LISTS largest)
+    string(APPEND report "${entry}\n")
+endforeach()
+string(APPEND report "\nstatic SRAM total: ${staticTotal} bytes\n")
+string(APPEND report "heap left: ${heapSize} bytes, ${MIN_HEAP} needed\n")
+
+file(WRITE ${OUTPUT} "${report}")
+message(STATUS "SRAM usage written to ${OUTPUT}")
+if(heapSize LESS MIN_HEAP)
+    message(FATAL_ERROR "Only ${heapSize} bytes of heap left, lower PICOSTATION_MOUNT_ARENA_SIZE")
+endif()
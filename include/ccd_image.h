@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../third_party/cueparser/disc.h"
+#include "ff.h"
+#include "file_pool.h"
+#include "sector_cache.h"
+#include "subq.h"
+#include "subq_ring.h"
+
+namespace picostation {
+// CloneCD images: the TOC comes from the .ccd, the main channel from the .img and the raw subchannel from the .sub,
+// all under the same name. Whenever core1 reads sectors from the .img, on demand or ahead, their subchannel
+// records are read along with them and the Q channel kept in a small ring. SubQ then sends the recorded Q, bad CRCs
+// of protected discs included, instead of a generated one, without core0 ever touching the card.
+class CcdImage {
+  public:
+    static constexpr int c_subFileIndex = 1;  // The .img is file 0
+
+    static bool isCcdPath(const TCHAR *path);
+    static bool getSiblingPath(const TCHAR *path, const char *extension, TCHAR *siblingPath);
+
+    FRESULT open(const TCHAR *ccdPath, CueDisc &disc);
+    void close();
+    bool hasSubchannel() const { return m_subQ.isActive(); }
+    void readSubchannel(FilePool &filePool, const int sector, const int sectorCount);
+    bool needsSubchannel(const int sector) const;  // Its Q isn't in the ring but can be read
+    bool getSubQ(const int sector, SubQ::Data &data) const { return m_subQ.load(sector, data); }
+
+  private:
+    static constexpr size_t c_subQEntries = 128;  // Power of two, well over what the sector cache holds
+    static constexpr size_t c_recordBytes = 96;
+    static constexpr size_t c_maxRecordsPerRead = SectorCache::c_sectorsPerLine;
+    static constexpr size_t c_qOffset = 12;  // Channels are stored one after the other, P first
+
+    bool parseToc(FIL *file, CueDisc &disc);
+
+    SubQRing m_subQ;
+    uint8_t *m_records = nullptr;
+    int m_sectorCount = 0;
+};
+}  // namespace picostation
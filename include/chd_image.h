@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../third_party/cueparser/disc.h"
+#include "ff.h"
+#include "file_pool.h"
+#include "flac_decoder.h"
+#include "inflate.h"
+#include "input_stream.h"
+#include "lzma_decoder.h"
+
+namespace picostation {
+// CHD v5 CD images, as written by chdman createcd. The header, hunk map and track metadata are parsed at mount,
+// hunks are decompressed on demand into a couple of hunk buffers carved out of the mount arena.
+// Decoding is incremental: a sector read only waits for its own part of the hunk, and prefetch() finishes the
+// current hunk and starts on the next one while the DMA is busy, so the codec work is spread over playback.
+class ChdImage {
+  public:
+    static bool isChdPath(const TCHAR *path);
+
+    FRESULT open(FilePool &filePool, CueDisc &disc);  // The image is file 0 of the pool
+    void close();
+    bool readSector(const int track, const int adjustedSector, uint8_t *buffer);  // false if not stored
+    void prefetch(const int track, const int adjustedSector);
+
+  private:
+    static constexpr uint32_t c_maxFramesPerHunk = 32;
+    static constexpr size_t c_maxSlots = 2;
+    static constexpr size_t c_inputBufferSize = 2048;
+    static constexpr size_t c_checkpointBudget = 4096;
+    static constexpr size_t c_entryCacheSize = 4;
+
+    enum class Codec : uint8_t { None, Zlib, Lzma, Flac, Unsupported };
+
+    struct Track {
+        uint32_t chdFrame;     // Image frame holding firstSector
+        int32_t firstSector;   // First disc sector stored in the image, the pregap's if it is stored
+        uint32_t frames;       // Stored frames, a stored pregap included
+        uint32_t pregap;
+        uint32_t postgap;
+        uint16_t dataSize;     // Bytes per frame, 2352 for raw tracks
+        bool pregapStored;
+        bool audio;
+    };
+
+    struct MapEntry {
+        uint8_t type;
+        uint32_t length;
+        uint32_t offset;  // File offset, or the source hunk for a self reference
+    };
+
+    // Decoder state of the compressed map right before a hunk, so lookups don't have to walk it from the start
+    struct MapState {
+        uint32_t typeBit;
+        uint32_t dataBit;
+        uint32_t offset;
+        uint32_t lastSelf;
+        uint16_t repeat;
+        uint8_t lastType;
+    };
+
+    // MSB-first bit reader over the compressed map, straight from the card through a small window
+    class MapReader {
+      public:
+        void init(FIL *file, const FSIZE_t base, const uint32_t length);
+        void seek(const uint32_t bitPos);
+        uint32_t peek(const int count);  // Up to 24 bits
+        void remove(const int count) {
+            m_accumulator <<= count;
+            m_bits -= count;
+        }
+        uint32_t read(const int count);
+        uint32_t getPosition() const { return m_bytePos * 8 - m_bits; }
+
+      private:
+        uint8_t nextByte();
+
+        FIL *m_file = nullptr;
+        FSIZE_t m_base = 0;
+        uint32_t m_length = 0;
+        uint32_t m_bufferStart = 0;
+        uint32_t m_bufferLength = 0;
+        uint32_t m_bytePos = 0;
+        uint32_t m_accumulator = 0;
+        int m_bits = 0;
+        uint8_t m_buffer[256];
+    };
+
+    struct HunkSlot {
+        uint8_t *data = nullptr;  // Sector data of every frame in the hunk, subcode dropped
+        uint32_t hunk = UINT32_MAX;
+        uint32_t validBytes = 0;
+        uint32_t eccMask = 0;  // Frames whose sync and ECC were stripped by the compressor
+        uint32_t eccDone = 0;
+        uint32_t lastUse = 0;
+    };
+
+    bool readAt(const FSIZE_t offset, void *buffer, const UINT size);
+    bool parseMetadata(CueDisc &disc);
+    bool readMap();
+    bool readHuffmanTree();
+    uint8_t decodeType();
+    uint8_t decodeNextType();
+    MapEntry decodeEntryData(const uint8_t type);
+    bool lookupEntry(const uint32_t hunk, MapEntry &entry);
+    bool resolveEntry(uint32_t &hunk, MapEntry &entry);
+
+    HunkSlot *findSlot(const uint32_t hunk);
+    HunkSlot *claimSlot(const HunkSlot *keep);
+    bool startDecode(HunkSlot &slot, const uint32_t hunk, const MapEntry &entry);
+    bool stepDecode(const uint32_t target);
+    const uint8_t *getFrame(uint32_t hunk, const uint32_t frame, uint8_t *buffer);
+
+    FIL *m_file = nullptr;
+    uint32_t m_hunkBytes = 0;
+    uint32_t m_unitBytes = 0;
+    uint32_t m_framesPerHunk = 0;
+    uint32_t m_hunkCount = 0;
+    Codec m_codecs[4];
+    FSIZE_t m_mapOffset = 0;
+    FSIZE_t m_metaOffset = 0;
+
+    bool m_compressedMap = false;
+    uint8_t m_lengthBits = 0;
+    uint8_t m_selfBits = 0;
+    uint8_t m_parentBits = 0;
+    uint8_t m_huffmanLookup[256];
+    MapReader m_typeReader;
+    MapReader m_dataReader;
+    MapState m_mapState;
+    uint32_t m_mapHunk = 0;  // Hunk m_mapState decodes next
+    MapState *m_checkpoints = nullptr;
+    int m_checkpointShift = 0;
+    uint32_t m_entryCacheHunk[c_entryCacheSize];
+    MapEntry m_entryCache[c_entryCacheSize];
+
+    Track *m_tracks = nullptr;
+    HunkSlot m_slots[c_maxSlots];
+    size_t m_slotCount = 0;
+    uint32_t m_useCounter = 0;
+
+    // Only one hunk is being decoded at a time, the other slot holds a finished or abandoned one
+    HunkSlot *m_activeSlot = nullptr;
+    Codec m_activeCodec = Codec::None;
+    InputStream m_input;
+    uint8_t *m_inputBuffer = nullptr;
+    void *m_scratch = nullptr;
+    uint32_t m_flacBlockSize = 0;
+    Inflate m_inflate;
+    LzmaDecoder m_lzma;
+    FlacDecoder m_flac;
+};
+}  // namespace picostation
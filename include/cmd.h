@@ -14,8 +14,8 @@ class MechCommand {
     void setSens(const size_t what, const bool new_value);
     bool getSoct();
     void setSoct(const bool new_value);
-    void processLatchedCommand();
-    void updateMechSens();
+    void processLatchedCommand(const uint32_t latched);
+    void publishSens();  // Hands the status word to the SENS state machine, which answers the mechacon itself
 
     void updateAutoSeqTrack();
 
@@ -53,27 +53,10 @@ class MechCommand {
     alarm_id_t m_autoSeqAlarmID = 0;
     int m_autoSeqTrack = 0;
     int m_jumpTrack = 0;
-    uint32_t m_latched = 0;  // Command latch
 
-    size_t m_currentSens = 0;
-    bool m_sensData[16] = {
-        0,  // $0X - FZC
-        0,  // $1X - AS
-        0,  // $2X - TZC
-        0,  // $3X - Misc.
-        0,  // $4X - XBUSY
-        1,  // $5X - FOK
-        0,  // $6X - 0
-        0,  // $7X - 0
-        0,  // $8X - 0
-        0,  // $9X - 0
-        1,  // $AX - GFS
-        0,  // $BX - COMP
-        0,  // $CX - COUT
-        0,  // $DX - 0
-        0,  // $EX - OV64
-        0   // $FX - 0
-    };
+    // One bit per SENS address: $0X FZC, $1X AS, $2X TZC, $3X misc., $4X XBUSY, $5X FOK, $AX GFS, $BX COMP,
+    // $CX COUT, $EX OV64, the rest read 0
+    volatile uint16_t m_sensData = (1 << SENS::FOK) | (1 << SENS::GFS);
     pseudoatomic<bool> m_soctEnabled;
 };
 }  // namespace picostation
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace picostation {
+class MechCommand;
+
+// Mechacon commands collected by DMA, so no byte depends on core0 getting to a FIFO in time. One channel copies
+// each byte from the mechacon program into a byte ring. The xlat program turns every XLAT falling edge into a FIFO
+// word; a channel paced by it pops the word and chains to one that stores where the byte ring's write pointer
+// stood into a boundary ring, then chains back. That second channel's completion interrupt decodes the commands on
+// core0, in order, each from the bytes between its boundary and the one before.
+class CommandRing {
+  public:
+    void init(MechCommand *mechCommand);  // On core0, which takes the interrupt
+    void flush();                         // Drops whatever hasn't been decoded yet
+    uint32_t getOverruns() const { return m_overruns; }
+
+  private:
+    static constexpr size_t c_byteRingBits = 8;
+    static constexpr size_t c_byteRingSize = 1 << c_byteRingBits;
+    static constexpr size_t c_boundaryRingBits = 6;  // In bytes, 16 boundaries
+    static constexpr size_t c_boundaryRingSize = (1 << c_boundaryRingBits) / sizeof(uint32_t);
+    static constexpr size_t c_maxCommandBytes = 3;
+
+    static void interruptHandler();
+    void decode();
+    size_t getBoundaryWriteIndex() const;
+
+    alignas(c_byteRingSize) uint8_t m_bytes[c_byteRingSize];
+    alignas(1 << c_boundaryRingBits) uint32_t m_boundaries[c_boundaryRingSize];
+    uint32_t m_sink = 0;
+
+    MechCommand *m_mechCommand = nullptr;
+    int m_byteChannel = -1;
+    int m_edgeChannel = -1;
+    int m_boundaryChannel = -1;
+    size_t m_bytePosition = 0;
+    size_t m_boundaryRead = 0;
+    volatile uint32_t m_overruns = 0;  // Commands longer than 24 bits: an XLAT edge was missed or the clock glitched
+};
+
+extern CommandRing g_commandRing;
+}  // namespace picostation
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../third_party/cueparser/disc.h"
+#include "ff.h"
+
+namespace picostation {
+// Names of the files referenced by a cue sheet, and which of them backs each track
+struct CueFileTable {
+    static constexpr size_t c_namePoolSize = 2048;
+    static constexpr uint8_t c_noFile = 0xFF;
+
+    void clear();
+    int addFile(const char *name);  // Returns the file index, or -1 if the table is full
+    const char *getFileName(const int index) const { return &namePool[nameOffsets[index]]; }
+    bool isFlacFile(const int index) const { return flacFiles[index]; }
+
+    int fileCount = 0;
+    uint16_t poolUsed = 0;
+    uint16_t nameOffsets[MAXTRACK];
+    uint8_t trackFile[MAXTRACK];  // File index for each track, c_noFile for the lead-in/lead-out
+    uint32_t dataOffsets[MAXTRACK];  // Where the sectors start in each file, past a WAVE header for instance
+    bool flacFiles[MAXTRACK];        // Taken from the names when the table is filled, not on every sector read
+    char namePool[c_namePoolSize];
+};
+
+// Binary snapshot of a parsed cue sheet, stored as a hidden file next to the cue.
+// The snapshot is only used if the size and timestamp of the cue and of every file it references still match, so
+// editing the cue or replacing a bin invalidates it.
+class CueCache {
+  public:
+    static bool load(const TCHAR *cuePath, const TCHAR *parentPath, const FILINFO &cueInfo, CueDisc &disc,
+                     CueFileTable &files);
+    static bool save(const TCHAR *cuePath, const TCHAR *parentPath, const FILINFO &cueInfo, const CueDisc &disc,
+                     const CueFileTable &files);
+
+  private:
+    static bool getCachePath(const TCHAR *cuePath, TCHAR *cachePath);
+};
+}  // namespace picostation
@@ -6,8 +6,21 @@
 #include "../third_party/cueparser/disc.h"
 #include "../third_party/cueparser/scheduler.h"
 #include "../third_party/posix_file.h"
+#include "ccd_image.h"
+#include "chd_image.h"
+#include "cue_cache.h"
+#include "ecm_file.h"
+#include "encoded_image.h"
+#include "file_pool.h"
+#include "flac_file.h"
 #include "ff.h"
+#include "iso_image.h"
+#include "menu_image.h"
+#include "pbp_image.h"
+#include "ppf_patch.h"
+#include "sector_cache.h"
 #include "subq.h"
+#include "subq_patches.h"
 
 namespace picostation {
 class DiscImage {
@@ -30,14 +43,64 @@ class DiscImage {
         return m_cueDisc.tracks[m_currentLogicalTrack].trackType == CueTrackType::TRACK_TYPE_DATA;
     };
     void makeDummyCue();
+    void unload();
     void readSector(void *buffer, const int sector, DataLocation location);
     void readSectorRAM(void *buffer, const int sector);
     void readSectorSD(void *buffer, const int sector);
+    bool readEncodedSector(uint32_t *pioWords, const int sector, DataLocation location);  // false if not encoded
+    void prefetch(const int sector, const uint32_t budgetUs);  // budgetUs: time left before the DMA runs dry
 
   private:
+    enum class ImageFormat {
+        Cue,
+        Chd,
+        Iso,
+        Pbp,
+        Ccd,
+        Encoded,
+    };
+
+    static constexpr int c_prefetchSectors = SectorCache::c_sectorsPerLine;
+    static constexpr int c_prefetchOpenSectors = 75;  // Open the next track's file a second ahead of the boundary
+    static constexpr uint32_t c_initialLineReadTime = 3000;  // uS, until a read has been timed
+    static constexpr uint32_t c_initialFileOpenTime = 2000;  // uS
+    static constexpr uint32_t c_initialBlockStepTime = 3000;  // uS
+
+    static void updateTimeEstimate(uint32_t &estimate, const uint32_t measured);
+
+    FRESULT loadCue(const TCHAR *targetCue, const TCHAR *parentPath);
+    FRESULT loadChd(const TCHAR *targetChd, const TCHAR *parentPath);
+    FRESULT loadPbp(const TCHAR *targetPbp, const TCHAR *parentPath);
+    FRESULT loadIso(const TCHAR *targetIso, const TCHAR *parentPath);
+    FRESULT loadCcd(const TCHAR *targetCcd, const TCHAR *parentPath);
+    FRESULT loadEncoded(const TCHAR *targetEncoded, const TCHAR *parentPath);
+    int findTrack(const int adjustedSector) const;
+    UINT readTrackSectors(const int track, const int adjustedSector, uint8_t *buffer);
+    int readFileSectors(const int fileIndex, FIL *fp, const int fileSector, uint8_t *buffer, const int sectorCount);
+
     CueDisc m_cueDisc;
+    CueFileTable m_fileTable;
+    FilePool m_filePool;
+    SectorCache m_sectorCache;
+    ChdImage m_chdImage;
+    IsoImage m_isoImage;
+    PbpImage m_pbpImage;
+    CcdImage m_ccdImage;
+    EncodedImage m_encodedImage;
+    SubQPatches m_subQPatches;
+    PpfPatch m_ppfPatch;
+    EcmFile m_ecmFile;
+    int m_ecmFileIndex = -1;
+    FlacFile m_flacFile;
+    MenuImage m_menuImage;
+    ImageFormat m_format = ImageFormat::Cue;
     bool m_hasData = false;
     int m_currentLogicalTrack = 0;
+    int m_prefetchFailedSector = -1;
+    // Slowest recent times of the card accesses prefetch makes, it only starts one that fits before the DMA runs dry
+    uint32_t m_lineReadTime = c_initialLineReadTime;
+    uint32_t m_fileOpenTime = c_initialFileOpenTime;
+    uint32_t m_blockStepTime = c_initialBlockStepTime;  // A PBP prefetch step
 };
 
 extern DiscImage g_discImage;
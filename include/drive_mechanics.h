@@ -10,14 +10,20 @@
 namespace picostation {
 class MechCommand;
 
+// How long an auto sequence jump keeps XBUSY up. ACCURATE follows a PU-8/PU-18 over the distance, FAST holds it
+// just long enough for the CD controller to see it
+enum class SeekProfile : uint8_t { ACCURATE, FAST };
+
 class DriveMechanics {
   public:
+    void init(MechCommand *mechCommand);  // On core0, the sled alarm's interrupt is taken by the core that sets it up
     void moveToNextSector();
     int getSector() { return m_sector.Load(); }
     uint32_t getTrack() const { return m_track; }
-    void moveSled(MechCommand &mechCommand);
+    uint32_t getSeekTime(const uint32_t tracks) const;  // uS
     void moveTrack(int tracks) { setTrack(m_track + tracks); }
     void setCountTrack(uint32_t countTrack) { m_countTrack = countTrack; }
+    void setSeekProfile(const SeekProfile seekProfile) { m_seekProfile = seekProfile; }
     void setSectorForTrackUpdate(int sectorForTrackUpdate) { m_sectorForTrackUpdate = sectorForTrackUpdate; }
     void setSledMoveDirection(int sledMoveDirection);
     void setTrack(uint32_t track) {
@@ -29,6 +35,9 @@ class DriveMechanics {
     bool isSledStopped() { return m_sledMoveDirection == SledMove::STOP; }
 
   private:
+    static void sledAlarmHandler(unsigned int alarmNum);
+    void stepSled();
+
     uint32_t m_countTrack = 0;
     uint32_t m_originalTrack = 0;
     uint32_t m_track = 0;
@@ -38,8 +47,14 @@ class DriveMechanics {
     int m_sectorForTrackUpdate = 0;
     int m_sectorsPerTrack = sectorsPerTrack(0);
 
-    int m_sledMoveDirection = SledMove::STOP;
-    uint64_t m_sledTimer = 0;
+    SeekProfile m_seekProfile = SeekProfile::ACCURATE;
+
+    // A hardware alarm steps the sled one track every c_MaxTrackMoveTime while it moves, so COUT toggles at the
+    // modelled crossing rate whatever the core0 loop is doing
+    MechCommand *m_mechCommand = nullptr;
+    int m_sledAlarm = -1;
+    volatile int m_sledMoveDirection = SledMove::STOP;
+    uint64_t m_sledTarget = 0;
 };
 
 extern DriveMechanics g_driveMechanics;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ff.h"
+#include "input_stream.h"
+#include "values.h"
+
+namespace picostation {
+// A bin file shrunk with ECM, which drops the sync, header and EDC/ECC bytes that can be regenerated.
+// The first mount scans the file once and writes the decoder state at the start of every sector to a hidden
+// index next to it, so any sector can be found with one small index read. Sequential reads carry on from the
+// previous sector without touching the index.
+class EcmFile {
+  public:
+    static constexpr char c_extension[] = ".ecm";
+
+    static bool isEcmPath(const TCHAR *path);
+    static bool prepare(const TCHAR *ecmPath, uint64_t &decodedSize);  // Builds the index if needed
+
+    bool open(const TCHAR *ecmPath);
+    void close();
+    int read(FIL *file, const int sector, uint8_t *buffer, const int sectorCount);  // Returns sectors read
+
+  private:
+    static constexpr size_t c_inputBufferSize = 2048;
+    static constexpr size_t c_scanBufferSize = 4096;
+    static constexpr size_t c_entriesPerBlock = 32;
+
+    // Decoder state at a sector boundary: where the current item's input starts, how many items of the record
+    // are left including it, and how much of its output came before the boundary
+    struct IndexEntry {
+        uint32_t inputOffset;
+        uint32_t remaining;
+        uint16_t skip;
+        uint8_t type;
+        uint8_t reserved;
+    };
+
+    static bool getIndexPath(const TCHAR *ecmPath, TCHAR *indexPath);
+    static bool openIndex(const TCHAR *ecmPath, FIL *indexFile, uint32_t &ecmSize, uint32_t &sectorCount,
+                          uint64_t &decodedSize);
+    static bool buildIndex(const TCHAR *ecmPath, const TCHAR *indexPath, const FILINFO &ecmInfo);
+    static bool readRecordHeader(InputStream &input, uint8_t &type, uint32_t &count);
+
+    bool seek(FIL *file, const int sector);
+    bool decodeSector(uint8_t *out);
+    bool decodeItem(uint8_t *sector);
+
+    FIL *m_indexFile = nullptr;
+    uint32_t m_ecmSize = 0;
+    uint32_t m_sectorCount = 0;
+    IndexEntry *m_entries = nullptr;
+    uint32_t m_entryBlock = UINT32_MAX;
+
+    InputStream m_input;
+    uint8_t *m_inputBuffer = nullptr;
+    uint8_t *m_item = nullptr;  // Rebuilt sector of the current item, while it straddles two output sectors
+    bool m_itemReady = false;
+    uint8_t m_type = 0;
+    uint32_t m_remaining = 0;
+    uint32_t m_skip = 0;
+    int m_nextSector = -1;  // Sector the decoder state is at, -1 if it needs a seek
+};
+}  // namespace picostation
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../third_party/cueparser/disc.h"
+#include "ff.h"
+#include "file_pool.h"
+#include "subq.h"
+#include "subq_ring.h"
+#include "values.h"
+
+namespace picostation {
+// Images converted by tools/encode_image.py: each sector is stored as the PIO words the I2S program shifts out,
+// scrambled already for data tracks, so core1 reads it from the card straight into the DMA buffer. The Q frame of
+// every sector is stored alongside, LibCrypt ones included, and read ahead in batches into a ring for core0.
+class EncodedImage {
+  public:
+    static constexpr size_t c_sectorBytes = c_cdSamplesBytes * 2;  // One 32 bit word per 16 bit sample
+
+    static bool isEncodedPath(const TCHAR *path);
+
+    FRESULT open(FilePool &filePool, CueDisc &disc);  // The image is file 0 of the pool
+    void close();
+    bool readSector(const int adjustedSector, uint32_t *pioWords);  // false if not stored
+    void prefetch(const int adjustedSector);                         // Keeps the Q frames ahead of playback loaded
+    bool getSubQ(const int adjustedSector, SubQ::Data &data) const { return m_subQ.load(adjustedSector, data); }
+
+  private:
+    static constexpr size_t c_headerBytes = 2048;
+    static constexpr size_t c_subQEntries = 64;  // Power of two
+    static constexpr int c_subQPerRead = 32;
+    static constexpr int c_subQLead = 16;  // Sectors ahead of playback whose Q should already be loaded
+
+    bool readAt(const FSIZE_t offset, void *buffer, const UINT size);
+    bool parseHeader(const uint8_t *header, CueDisc &disc);
+    bool readSubQ(const int firstSector);
+
+    FIL *m_file = nullptr;
+    FSIZE_t m_subQOffset = 0;
+    FSIZE_t m_dataOffset = 0;
+    int m_sectorCount = 0;
+    SubQRing m_subQ;
+    uint8_t *m_records = nullptr;
+};
+}  // namespace picostation
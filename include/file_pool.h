@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cue_cache.h"
+#include "ff.h"
+
+namespace picostation {
+// A few open FILs shared by every file of the mounted image, reopened lazily in least recently used order.
+// Each file's fast-seek cluster map is built once and reattached whenever the file gets a handle again.
+class FilePool {
+  public:
+    static constexpr size_t c_handleCount = 3;
+    static constexpr size_t c_linkMapEntries = 32;  // Initial map size in DWORDs, grown once if the file is fragmented
+
+    void reset(const TCHAR *parentPath, const CueFileTable *files);
+    void closeAll();
+    FIL *acquire(const int fileIndex);
+    void buildLinkMaps();  // At mount, so no later open walks a cluster chain
+
+  private:
+    struct Handle {
+        FIL fil;
+        int fileIndex = -1;
+        uint32_t lastUse = 0;
+    };
+
+    void attachLinkMap(Handle &handle);
+
+    Handle m_handles[c_handleCount];
+    DWORD *m_linkMaps[MAXTRACK];
+    bool m_linkMapTried[MAXTRACK];
+    TCHAR m_parentPath[128];
+    const CueFileTable *m_files = nullptr;
+    uint32_t m_useCounter = 0;
+};
+}  // namespace picostation
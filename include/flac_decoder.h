@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "input_stream.h"
+
+namespace picostation {
+// Decoder for bare FLAC frames (no stream header) of 16-bit stereo audio, writing interleaved samples into a flat
+// output buffer. decode() works a whole frame at a time, so playback can be kept fed while the rest is decoded later.
+class FlacDecoder {
+  public:
+    enum class Status { Running, Done, Error };
+
+    static constexpr size_t getScratchSize(const uint32_t maxBlockSize) { return 2 * maxBlockSize * sizeof(int32_t); }
+
+    // scratch must hold getScratchSize(maxBlockSize) bytes
+    void begin(InputStream *input, uint8_t *output, const uint32_t outputSize, int32_t *scratch,
+               const uint32_t maxBlockSize, const bool bigEndian);
+    Status decode(uint32_t target);
+    // Starts over at the beginning of the output, to run through a stream a frame at a time. The output may be the
+    // scratch buffer itself when it holds a single frame, samples are packed in place.
+    void restartOutput() {
+        m_outPos = 0;
+        if (m_status == Status::Done) {
+            m_status = Status::Running;
+        }
+    }
+    uint32_t getOutputPos() const { return m_outPos; }
+    Status getStatus() const { return m_status; }
+
+  private:
+    inline uint32_t bits(const int count) {
+        while (m_bitCount < count) {
+            m_bitBuffer |= (uint32_t)m_input->readByte() << (24 - m_bitCount);
+            m_bitCount += 8;
+        }
+        const uint32_t value = m_bitBuffer >> (32 - count);
+        m_bitBuffer <<= count;
+        m_bitCount -= count;
+        return value;
+    }
+    int32_t signedBits(const int count);
+    uint32_t unary();
+    void alignToByte() {
+        if (m_bitCount & 7) {
+            bits(m_bitCount & 7);
+        }
+    }
+
+    bool decodeFrame();
+    bool decodeSubframe(int32_t *samples, const uint32_t blockSize, int bitsPerSample);
+    bool decodeResidual(int32_t *samples, const uint32_t blockSize, const int predictorOrder);
+
+    InputStream *m_input = nullptr;
+    uint8_t *m_output = nullptr;
+    uint32_t m_outputSize = 0;
+    uint32_t m_outPos = 0;
+    int32_t *m_channels[2] = {nullptr, nullptr};
+    uint32_t m_maxBlockSize = 0;
+    bool m_bigEndian = false;
+    uint32_t m_bitBuffer = 0;
+    int m_bitCount = 0;
+    Status m_status = Status::Done;
+};
+}  // namespace picostation
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ff.h"
+#include "flac_decoder.h"
+#include "input_stream.h"
+#include "values.h"
+
+namespace picostation {
+// Audio tracks stored as native FLAC files (16-bit stereo, 44.1kHz), decoded to 2352 byte sectors as they are read.
+// All the FLAC files of a disc share one decoder, a switch to another file only rereads its STREAMINFO and seek
+// table. A seek starts from the nearest seek point and bisects between frame headers found on the way, so only the
+// frame holding the target sector gets decoded. Read-ahead goes through the sector cache like any other file.
+class FlacFile {
+  public:
+    static bool isFlacPath(const TCHAR *path);
+    static bool prepare(const TCHAR *path, uint64_t &decodedSize, uint32_t &maxBlockSize);
+
+    bool open(const uint32_t maxBlockSize);  // Decoder buffers for frames of up to maxBlockSize samples
+    void close();
+    int read(FIL *file, const int fileIndex, const int sector, uint8_t *buffer, const int sectorCount);
+
+  private:
+    static constexpr uint32_t c_samplesPerSector = c_cdSamplesBytes / 4;
+    static constexpr uint32_t c_maxSeekPoints = 64;
+    static constexpr uint32_t c_maxBisectSteps = 12;
+    static constexpr size_t c_inputBufferSize = 2048;
+    static constexpr uint32_t c_frameHeaderMax = 16;
+
+    struct StreamInfo {
+        uint32_t minBlockSize;
+        uint32_t maxBlockSize;
+        uint64_t totalSamples;
+        FSIZE_t audioOffset;  // First frame
+        FSIZE_t fileSize;
+    };
+
+    struct SeekPoint {
+        uint64_t sample;
+        FSIZE_t offset;  // Of a frame starting at sample
+    };
+
+    static bool readMetadata(InputStream &input, StreamInfo &info, SeekPoint *seekPoints, uint32_t &seekPointCount);
+    static bool parseFrameHeader(const uint8_t *header, const uint32_t length, const StreamInfo &info,
+                                 uint64_t &sample);
+
+    bool selectFile(FIL *file, const int fileIndex);
+    bool findFrame(FIL *file, const FSIZE_t from, const FSIZE_t to, SeekPoint &frame);
+    bool seek(FIL *file, const uint64_t sample);
+    bool decodeFrame();
+
+    int m_fileIndex = -1;
+    StreamInfo m_info;
+    SeekPoint *m_seekPoints = nullptr;
+    uint32_t m_seekPointCount = 0;
+    uint32_t m_maxBlockSize = 0;
+
+    uint8_t *m_inputBuffer = nullptr;
+    InputStream m_input;
+    FlacDecoder m_decoder;
+    int32_t *m_frame = nullptr;  // Decoder scratch, also holds the last decoded frame as 16-bit stereo
+    uint64_t m_frameSample = 0;  // First sample of the decoded frame
+    uint32_t m_frameSamples = 0;  // 0 when nothing is decoded
+    bool m_streamReady = false;   // The decoder is positioned right after the decoded frame
+};
+}  // namespace picostation
@@ -4,6 +4,7 @@
 
 #include <array>
 #include "ff.h"
+#include "logging.h"
 #include "pseudo_atomics.h"
 #include "disc_image.h"
 
@@ -20,6 +21,16 @@ class I2S {
 
   private:
     static constexpr std::array<uint16_t, 1176> generateScramblingLUT();
+    // Turns a sector of samples into PIO words, scrambled unless scramblingLUT is null
+    static void encodeSector(uint32_t *out, const int16_t *samples, const uint16_t *scramblingLUT);
+#if BENCHMARK_I2S
+    static void encodeSectorReference(uint32_t *out, const int16_t *samples, const uint16_t *scramblingLUT);
+    static void benchmarkEncoder(const int16_t *samples, uint32_t *out, uint32_t *referenceOut,
+                                 const uint16_t *scramblingLUT);
+#endif
+#if BENCHMARK_EDCECC
+    static void benchmarkEdcEcc(uint8_t *sector, uint8_t *referenceSector);
+#endif
     int initDMA(const volatile void *read_addr, unsigned int transfer_count);  // Returns DMA channel number
     void mountSDCard();
     void reset();
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "input_stream.h"
+
+namespace picostation {
+// Raw deflate (RFC 1951) decoder writing into a flat output buffer, which doubles as the history window.
+// Decoding can be stopped once enough output exists and resumed later, so a block can be spread over several calls.
+class Inflate {
+  public:
+    enum class Status { Running, Done, Error };
+
+    void begin(InputStream *input, uint8_t *output, const uint32_t outputSize);
+    Status decode(uint32_t target);  // Runs until at least target bytes of output exist, the stream ends or fails
+    uint32_t getOutputPos() const { return m_outPos; }
+    Status getStatus() const { return m_status; }
+
+  private:
+    static constexpr int c_maxBits = 15;
+
+    struct Huffman {
+        uint16_t count[c_maxBits + 1];
+        uint16_t symbol[288];
+    };
+
+    enum class Block { None, Stored, Codes };
+
+    inline uint32_t bits(const int need) {
+        while (m_bitCount < need) {
+            m_bitBuffer |= (uint32_t)m_input->readByte() << m_bitCount;
+            m_bitCount += 8;
+        }
+        const uint32_t value = m_bitBuffer & ((1u << need) - 1);
+        m_bitBuffer >>= need;
+        m_bitCount -= need;
+        return value;
+    }
+
+    bool beginBlock();
+    bool readDynamicTables();
+    int decodeSymbol(const Huffman &huffman);
+    static bool buildHuffman(Huffman &huffman, const uint8_t *lengths, const int count);
+
+    InputStream *m_input = nullptr;
+    uint8_t *m_output = nullptr;
+    uint32_t m_outputSize = 0;
+    uint32_t m_outPos = 0;
+    uint32_t m_bitBuffer = 0;
+    int m_bitCount = 0;
+    Block m_block = Block::None;
+    bool m_final = false;
+    uint32_t m_storedRemaining = 0;
+    Status m_status = Status::Done;
+    Huffman m_lengthCodes;
+    Huffman m_distanceCodes;
+};
+}  // namespace picostation
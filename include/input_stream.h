@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ff.h"
+
+namespace picostation {
+// Buffered sequential reader over a byte range of an open file (or of memory), refilled on demand.
+// Reading past the end returns zeros and flags the overrun, so decoders can check once per block instead of per byte.
+class InputStream {
+  public:
+    void init(FIL *file, const FSIZE_t offset, const uint32_t length, uint8_t *buffer, const uint32_t bufferSize);
+    void init(const uint8_t *data, const uint32_t length);
+
+    inline uint8_t readByte() {
+        if (m_pos == m_end && !refill()) {
+            m_overrun = true;
+            return 0;
+        }
+        return m_data[m_pos++];
+    }
+    uint32_t read(void *buffer, const uint32_t size);
+    void skip(uint32_t size);
+
+    void setFile(FIL *file) { m_file = file; }  // Same file through another handle, the buffered data stays valid
+    bool isOverrun() const { return m_overrun; }
+    uint32_t getConsumed() const { return m_length - m_pending - (m_end - m_pos); }
+    FSIZE_t getPosition() const { return m_nextOffset - (m_end - m_pos); }  // File offset of the next byte
+
+  private:
+    bool refill();
+
+    FIL *m_file = nullptr;
+    FSIZE_t m_nextOffset = 0;
+    uint32_t m_length = 0;
+    uint32_t m_pending = 0;  // Bytes of the range not loaded yet
+    uint8_t *m_buffer = nullptr;
+    uint32_t m_bufferSize = 0;
+    const uint8_t *m_data = nullptr;
+    uint32_t m_pos = 0;
+    uint32_t m_end = 0;
+    bool m_overrun = false;
+};
+}  // namespace picostation
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../third_party/cueparser/disc.h"
+#include "ff.h"
+
+namespace picostation {
+// Plain 2048 byte per sector ISO images, presented as a single mode 2 form 1 data track. Only the user data is
+// read from the card, sync, header, subheader and EDC/ECC are filled in from a template as each sector is read.
+class IsoImage {
+  public:
+    static constexpr size_t c_sectorBytes = 2048;
+
+    static bool isIsoPath(const TCHAR *path);
+
+    FRESULT open(const TCHAR *path, CueDisc &disc);
+    void close() { m_sectorCount = 0; }
+    int read(FIL *file, const int sector, uint8_t *buffer, const int sectorCount);  // Returns sectors read
+
+  private:
+    void buildSector(uint8_t *sector, const int fileSector) const;
+
+    uint32_t m_sectorCount = 0;
+};
+}  // namespace picostation
@@ -8,3 +8,10 @@
 #define DEBUG_SUBQ 0
 
 #define DEBUG_LOGGING_ENABLED (DEBUG_CMD || DEBUG_CUE || DEBUG_I2S || DEBUG_MAIN || DEBUG_MODCHIP || DEBUG_SUBQ)
+
+// Times the sector encoder against the original loop on core1 before streaming starts, printed with DEBUG_I2S
+#define BENCHMARK_I2S 0
+
+// Times EDC/ECC generation against the original byte-wise code on core1 before streaming starts, printed with
+// DEBUG_I2S
+#define BENCHMARK_EDCECC 0
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "input_stream.h"
+
+namespace picostation {
+// Raw LZMA stream decoder for streams of known size without an end marker, writing into a flat output buffer that
+// doubles as the dictionary. Like Inflate, it can stop once enough output exists and pick up again on the next call.
+class LzmaDecoder {
+  public:
+    enum class Status { Running, Done, Error };
+
+    static constexpr size_t getProbCount(const int lc, const int lp) { return c_baseProbCount + (0x300u << (lc + lp)); }
+
+    // probs must hold getProbCount(lc, lp) entries, it is the only state besides this object
+    void begin(InputStream *input, uint8_t *output, const uint32_t outputSize, uint16_t *probs, const int lc,
+               const int lp, const int pb);
+    Status decode(uint32_t target);
+    uint32_t getOutputPos() const { return m_outPos; }
+    Status getStatus() const { return m_status; }
+
+  private:
+    static constexpr int c_numStates = 12;
+    static constexpr int c_posStatesMax = 16;
+    static constexpr int c_lenToPosStates = 4;
+    static constexpr int c_endPosModelIndex = 14;
+    static constexpr int c_fullDistances = 128;
+    static constexpr int c_alignBits = 4;
+    static constexpr int c_lenProbCount = 2 + (c_posStatesMax << 3) * 2 + 256;
+
+    // Offsets into the probability array
+    static constexpr int c_isMatch = 0;
+    static constexpr int c_isRep = c_isMatch + (c_numStates << 4);
+    static constexpr int c_isRepG0 = c_isRep + c_numStates;
+    static constexpr int c_isRepG1 = c_isRepG0 + c_numStates;
+    static constexpr int c_isRepG2 = c_isRepG1 + c_numStates;
+    static constexpr int c_isRep0Long = c_isRepG2 + c_numStates;
+    static constexpr int c_posSlot = c_isRep0Long + (c_numStates << 4);
+    static constexpr int c_posDecoders = c_posSlot + (c_lenToPosStates << 6);
+    static constexpr int c_align = c_posDecoders + 1 + c_fullDistances - c_endPosModelIndex;
+    static constexpr int c_lenDecoder = c_align + (1 << c_alignBits);
+    static constexpr int c_repLenDecoder = c_lenDecoder + c_lenProbCount;
+    static constexpr int c_literal = c_repLenDecoder + c_lenProbCount;
+    static constexpr size_t c_baseProbCount = c_literal;
+
+    InputStream *m_input = nullptr;
+    uint8_t *m_output = nullptr;
+    uint32_t m_outputSize = 0;
+    uint32_t m_outPos = 0;
+    uint16_t *m_probs = nullptr;
+    int m_lc = 0;
+    uint32_t m_lpMask = 0;
+    uint32_t m_pbMask = 0;
+
+    uint32_t m_range = 0;
+    uint32_t m_code = 0;
+    uint32_t m_state = 0;
+    uint32_t m_reps[4] = {0, 0, 0, 0};
+    Status m_status = Status::Done;
+};
+}  // namespace picostation
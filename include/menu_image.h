@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inflate.h"
+#include "input_stream.h"
+
+namespace picostation {
+// The menu disc embedded in flash, packed at build time by tools/pack_menu.py. Each sector is deflated on its
+// own, without the sync, header, EDC and ECC that can be regenerated, and decoded straight into the sector
+// buffer when it's read. The packed image is read through the uncached XIP alias so it doesn't evict code.
+class MenuImage {
+  public:
+    bool readSector(const int adjustedSector, uint8_t *buffer);  // false if the image has no such sector
+
+  private:
+    bool init();
+
+    const uint8_t *m_image = nullptr;
+    uint32_t m_sectorCount = 0;
+    InputStream m_input;
+    Inflate m_inflate;
+};
+}  // namespace picostation
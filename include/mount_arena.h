@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Set per chip by the build, RP2040 has half the SRAM of RP2350
+#ifndef MOUNT_ARENA_SIZE
+#define MOUNT_ARENA_SIZE (64 * 1024)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Allocation hooks for the C code in third_party (cue parser closures, CueFile and FIL objects)
+void *mount_arena_malloc(size_t size);
+void mount_arena_free(void *ptr);
+
+#ifdef __cplusplus
+}
+
+namespace picostation {
+// Bump allocator backing everything that lives for the duration of one mounted image.
+// Nothing is freed individually; the whole arena is released in one step when the next image mounts,
+// so repeated mounts and swaps can never fragment the heap.
+class MountArena {
+  public:
+    static constexpr size_t c_capacity = MOUNT_ARENA_SIZE;
+    static constexpr size_t c_defaultAlignment = 8;
+
+    void *allocate(const size_t size, const size_t alignment = c_defaultAlignment);
+    template <typename T>
+    T *allocate(const size_t count = 1) {
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+    void reset();
+    void release(const size_t mark);  // Drops everything allocated since getUsed() returned mark
+
+    size_t getCapacity() const { return c_capacity; }
+    size_t getUsed() const { return m_used; }
+    size_t getFree() const { return c_capacity - m_used; }
+    size_t getPeak() const { return m_peak; }            // Since boot
+    unsigned int getFailures() const { return m_failures; }  // Since boot
+    void printStats() const;
+
+  private:
+    alignas(c_defaultAlignment) uint8_t m_buffer[c_capacity];
+    size_t m_used = 0;
+    size_t m_peak = 0;
+    unsigned int m_allocations = 0;
+    unsigned int m_failures = 0;
+};
+
+extern MountArena g_mountArena;
+}  // namespace picostation
+#endif
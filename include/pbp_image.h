@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../third_party/cueparser/disc.h"
+#include "ff.h"
+#include "file_pool.h"
+#include "inflate.h"
+#include "input_stream.h"
+#include "sector_cache.h"
+#include "values.h"
+
+namespace picostation {
+// PS1 EBOOT.PBP images as made by popstation and its successors: the disc is split into blocks of 16 raw sectors,
+// each deflated on its own, behind an index and a TOC at fixed offsets. Only the first disc of a multi-disc PBP
+// is mounted. One block is held decoded at a time, inflated (or for a stored block, read) incrementally so a read
+// only waits for its own sector; prefetch() finishes it while the DMA is busy, and near its end hands the remaining
+// sectors to the sector cache so the next block can be started in the same buffer.
+class PbpImage {
+  public:
+    static bool isPbpPath(const TCHAR *path);
+
+    FRESULT open(FilePool &filePool, CueDisc &disc);  // The image is file 0 of the pool
+    void close();
+    bool readSector(const int adjustedSector, uint8_t *buffer);  // false if not stored
+    // Reads or decodes at most a sector's worth of the card per call, false if it had nothing to do
+    bool prefetch(const int adjustedSector, SectorCache &sectorCache);
+
+  private:
+    static constexpr uint32_t c_sectorsPerBlock = 16;
+    static constexpr uint32_t c_blockBytes = c_sectorsPerBlock * c_cdSamplesBytes;
+    static constexpr uint32_t c_entriesPerRead = 16;
+    static constexpr size_t c_inputBufferSize = 2048;
+
+    bool readAt(const FSIZE_t offset, void *buffer, const UINT size);
+    FSIZE_t findDisc();
+    bool parseToc(CueDisc &disc);
+    bool parseTocEntries(const uint8_t *toc, CueDisc &disc);
+    bool lookupBlock(const uint32_t block, uint32_t &offset, uint32_t &length);
+    bool startDecode(const uint32_t block);
+    bool stepDecode(const uint32_t target);
+    const uint8_t *getSector(const uint32_t sector);
+
+    FIL *m_file = nullptr;
+    FSIZE_t m_discOffset = 0;  // Start of the disc's PSISOIMG header
+    uint32_t m_sectorCount = 0;
+    uint32_t m_blockCount = 0;
+
+    uint8_t *m_index = nullptr;  // Raw index entries, c_entriesPerRead of them starting at m_indexFirst
+    uint32_t m_indexFirst = UINT32_MAX;
+
+    uint8_t *m_block = nullptr;
+    uint32_t m_blockNumber = UINT32_MAX;
+    uint32_t m_validBytes = 0;
+    bool m_decoding = false;
+    bool m_stored = false;  // The block didn't shrink, it is read from m_storedOffset rather than inflated
+    FSIZE_t m_storedOffset = 0;
+    InputStream m_input;
+    uint8_t *m_inputBuffer = nullptr;
+    Inflate m_inflate;
+};
+}  // namespace picostation
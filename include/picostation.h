@@ -28,6 +28,7 @@ enum class Command {
     COMMAND_MOUNT_FILE = 0x5,
     COMMAND_IO_COMMAND = 0x6,
     COMMAND_IO_DATA = 0x7,
+    COMMAND_SEEK_PROFILE = 0x8,
     COMMAND_BOOTLOADER = 0xA
 };
 
@@ -60,7 +61,7 @@ extern pseudoatomic<bool> g_coreReady[2];
 extern unsigned int g_soctOffset;
 extern unsigned int g_subqOffset;
 
-extern bool g_subqDelay;
+extern volatile bool g_subqDelay;
 extern int g_targetPlaybackSpeed;
 extern unsigned int g_audioCtrlMode;
 
@@ -70,6 +71,8 @@ extern unsigned int g_audioCtrlMode;
 
 [[noreturn]] void core0Entry();  // Reset, playback speed, Sled, soct, subq
 [[noreturn]] void core1Entry();  // I2S, sdcard, modchip
+void launchCore1();                // core1Entry on its own stack
+size_t getCore1StackUsed();        // Deepest core1 has been into its stack since launch
 
 void initHW();
 void updatePlaybackSpeed();
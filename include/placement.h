@@ -0,0 +1,11 @@
+#pragma once
+
+#include "pico.h"
+
+// Core0 polls the mechacon and clocks out SubQ, core1 runs the sector pipeline and feeds the I2S DMA.
+// The small per-sector functions of each core go in the scratch bank that already holds that core's stack
+// (scratch_y for core0, scratch_x for core1), so their fetches never wait on the other core or the DMA.
+// Bigger code and tables stay in striped main SRAM, where word interleaving spreads them over every bank.
+// The build writes <project>.placement.txt listing where each hot symbol ended up.
+#define CORE0_FUNC(func_name) __scratch_y(__STRING(func_name)) func_name
+#define CORE1_FUNC(func_name) __scratch_x(__STRING(func_name)) func_name
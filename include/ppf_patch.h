@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ff.h"
+#include "file_pool.h"
+#include "input_stream.h"
+
+namespace picostation {
+// PPF 1.0/2.0/3.0 patches, applied over sectors as they are read so the image on the card stays untouched.
+// Mounting scans the patch once and indexes its records as segments of the file, each covering a few sectors.
+// A coarse bitmap over the patched sectors turns unpatched sectors away with one bit test, a patched sector only
+// reads its own segment from the card. Offsets are taken as bytes into the image as one continuous bin, which is
+// what patches are made against.
+class PpfPatch {
+  public:
+    bool load(FilePool &filePool, const int fileIndex);  // The patch is that file of the pool
+    void clear();
+    void apply(const int sector, uint8_t *buffer) {
+        const uint32_t bucket = (uint32_t)sector >> m_bucketShift;
+        if (m_segmentCount == 0 || bucket >= c_bucketCount || !(m_buckets[bucket / 32] & (1u << (bucket % 32)))) {
+            return;
+        }
+        applySegments(sector, buffer);
+    }
+
+  private:
+    static constexpr uint32_t c_bucketCount = 1024;
+    static constexpr uint32_t c_maxSegments = 512;
+    static constexpr uint32_t c_scanBufferSize = 2048;
+    static constexpr uint32_t c_readBufferSize = 512;
+
+    // Records of the patch that sit one after the other in the file, and the sectors they touch
+    struct Segment {
+        int32_t firstSector;
+        int32_t lastSector;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    bool parseHeader(FIL *file, uint32_t &dataStart, uint32_t &dataEnd);
+    bool readRecordHeader(InputStream &input, uint64_t &offset, uint8_t &length);
+    void addRecord(const uint32_t recordOffset, const uint32_t recordLength, const int first, const int last);
+    void applySegment(const Segment &segment, const int sector, uint8_t *buffer);
+    void applySegments(const int sector, uint8_t *buffer);
+
+    FilePool *m_filePool = nullptr;
+    int m_fileIndex = -1;
+    bool m_longOffsets = false;  // 64-bit record offsets, PPF 3.0
+    bool m_hasUndo = false;      // Each record is followed by the bytes it replaces, PPF 3.0
+    bool m_sorted = true;        // Segments are in sector order and don't overlap
+
+    Segment *m_segments = nullptr;
+    uint32_t m_segmentCount = 0;
+    uint32_t m_segmentSpan = 1;  // Sectors a segment may cover, doubled whenever the index runs full
+    uint8_t *m_readBuffer = nullptr;
+    InputStream m_input;
+
+    uint32_t m_bucketShift = 0;
+    uint32_t m_buckets[c_bucketCount / 32];
+};
+}  // namespace picostation
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "values.h"
+
+namespace picostation {
+// Lines of consecutive raw sectors read from the card in one go, carved out of the mount arena.
+// The cache is sized from whatever the arena has left once the image is mounted.
+class SectorCache {
+  public:
+    static constexpr size_t c_sectorsPerLine = 4;
+    static constexpr size_t c_lineBytes = c_sectorsPerLine * c_cdSamplesBytes;
+    static constexpr size_t c_maxLines = 6;
+
+    void init(const size_t budgetBytes);
+    void clear();
+    const uint8_t *find(const int sector);
+    uint8_t *beginFill(const int firstSector);  // Claims the least recently used line
+    void endFill(uint8_t *data, const int sectorCount);
+    bool contains(const int sector) const;
+    size_t getLineCount() const { return m_lineCount; }
+
+  private:
+    struct Line {
+        uint8_t *data = nullptr;
+        int firstSector = 0;
+        int sectorCount = 0;
+        uint32_t lastUse = 0;
+    };
+
+    Line m_lines[c_maxLines];
+    size_t m_lineCount = 0;
+    uint32_t m_useCounter = 0;
+};
+}  // namespace picostation
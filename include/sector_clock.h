@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "subq.h"
+
+namespace picostation {
+// Sends a sector's Q subchannel and the SCOR pulse at a fixed delay after the I2S DMA started sending the sector.
+// A hardware alarm claimed at init does both edges, so the timing doesn't depend on how long a pass of the core0
+// loop takes and nothing is allocated per sector. The loop builds the frame beforehand, the alarm only hands it to
+// the PIO. g_subqDelay stays set while a start is pending, clearing it (spindle stop, reset) drops the pending start.
+class SectorClock {
+  public:
+    void init(SubQ *subq);  // On core0, its alarm interrupt is taken by the core that sets it up
+    void schedule(const uint64_t sectorStartTime);  // After SubQ::prepare_subq
+
+  private:
+    static constexpr uint64_t c_scorPulseTime = 135;  // uS
+
+    static void alarmHandler(unsigned int alarmNum);
+    void fire();
+
+    SubQ *m_subq = nullptr;
+    int m_alarm = -1;
+    volatile bool m_scorHigh = false;
+};
+
+extern SectorClock g_sectorClock;
+}  // namespace picostation
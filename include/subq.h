@@ -36,12 +36,14 @@ class SubQ {
     };
 
     SubQ(DiscImage *discImage) : m_discImage(discImage) {}
-    void start_subq(const int sector);
+    void prepare_subq(const int sector);  // From the core0 loop, the frame is built there
+    void start_subq();                    // From the sector clock's alarm, only sends the prepared frame
     void stop_subq();
 
   private:
     void printf_subq(const uint8_t *data);
 
     DiscImage *m_discImage;
+    Data m_frame;
 };
 }  // namespace picostation
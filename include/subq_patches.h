@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ff.h"
+#include "subq.h"
+
+namespace picostation {
+// SubQ frames of LibCrypt protected discs, from a .sbi or .lsd dump next to the image. The patched sectors are kept
+// sorted for a binary search, behind a coarse bitmap so the sectors that aren't patched, nearly all of them, are
+// turned away with one bit test.
+class SubQPatches {
+  public:
+    enum class Patched { None, WithoutCrc, WithCrc };
+
+    bool load(const TCHAR *imagePath);  // Same name as the image, false if there is no usable dump
+    void clear();
+    Patched apply(const int sector, SubQ::Data &data) const {
+        const uint32_t bucket = (uint32_t)sector >> m_bucketShift;
+        if (m_count == 0 || bucket >= c_bucketCount || !(m_buckets[bucket / 32] & (1u << (bucket % 32)))) {
+            return Patched::None;
+        }
+        return applyPatch(sector, data);
+    }
+
+  private:
+    static constexpr uint32_t c_bucketCount = 1024;
+    static constexpr uint32_t c_maxFileSize = 16384;
+    static constexpr uint32_t c_lsdEntryBytes = 15;  // MSF and the whole frame, CRC included
+
+    struct Patch {
+        int32_t sector;
+        uint8_t offset;  // Bytes of the frame that are replaced
+        uint8_t length;
+        uint8_t q[12];
+    };
+
+    bool parse(FIL *file, const bool lsd);
+    Patched applyPatch(const int sector, SubQ::Data &data) const;
+
+    Patch *m_patches = nullptr;
+    uint32_t m_count = 0;
+    uint32_t m_bucketShift = 0;
+    uint32_t m_buckets[c_bucketCount / 32];
+};
+}  // namespace picostation
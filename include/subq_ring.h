@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "subq.h"
+
+namespace picostation {
+// Q frames read off the card by core1 and handed to core0, which sends them instead of generated ones.
+// Entries are indexed by sector and tagged with it; the writer clears the tag around its copy and core0 only keeps
+// a copy if the tag is the same before and after, so neither side ever waits on the other.
+class SubQRing {
+  public:
+    bool init(const size_t entries);  // Power of two, from the mount arena
+    void reset() { m_entries = nullptr; }
+    bool isActive() const { return m_entries != nullptr; }
+
+    void store(const int sector, const uint8_t *q);  // 12 bytes, CRC the way generateSubQ computes it
+    bool contains(const int sector) const { return m_entries && m_entries[sector & m_mask].sector == sector; }
+    bool load(const int sector, SubQ::Data &data) const;  // false if the sector's Q isn't in the ring
+
+  private:
+    struct Entry {
+        volatile int32_t sector;  // -1 while the entry is being written
+        uint8_t q[12];
+    };
+
+    Entry *m_entries = nullptr;
+    size_t m_mask = 0;
+};
+}  // namespace picostation
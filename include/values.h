@@ -67,6 +67,8 @@ PIO const I2S_DATA = pio0;
 PIO const MECHACON = pio0;
 PIO const SOCT = pio0;
 PIO const SUBQ = pio0;
+PIO const SENS = pio1;
+PIO const XLAT = pio1;
 }  // namespace PIOInstance
 
 namespace SM {
@@ -75,6 +77,9 @@ constexpr unsigned int I2S_DATA = 0;
 constexpr unsigned int MECHACON = 1;
 constexpr unsigned int SOCT = 2;
 constexpr unsigned int SUBQ = 3;
+// PIO1
+constexpr unsigned int SENS = 0;
+constexpr unsigned int XLAT = 1;
 }  // namespace SM
 
 constexpr int NUM_IMAGES = 3;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ff.h"
+
+namespace picostation {
+// RIFF WAVE files holding CD audio (16-bit stereo, 44.1kHz). Only the header is parsed, once when the cue is,
+// after that the samples are read as raw sectors from the start of the data chunk like any bin file.
+class WaveFile {
+  public:
+    enum class Header {
+        Pcm,          // dataOffset and dataSize are set
+        Raw,          // No RIFF header, or the file couldn't be read, it is treated as raw samples
+        Unsupported,  // A RIFF file that isn't 16-bit stereo 44.1kHz PCM, or has no data chunk
+    };
+
+    static bool isWavePath(const TCHAR *path);
+    static Header readHeader(const TCHAR *path, uint32_t &dataOffset, uint32_t &dataSize);
+};
+}  // namespace picostation
@@ -0,0 +1,236 @@
+#include "ccd_image.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "global.h"
+#include "logging.h"
+#include "mount_arena.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr int c_pointLeadOut = 0xA2;
+constexpr uint8_t c_controlData = 0x04;
+
+// One [Entry n] section of the .ccd, a TOC entry as read from the lead-in
+struct TocEntry {
+    int session;
+    int point;
+    int control;
+    long plba;
+    bool hasPlba;
+};
+
+void commitEntry(const TocEntry &entry, CueDisc &disc, int &trackCount, long &leadOut) {
+    // Only the first session is of any use to a PS1
+    if (entry.session != 1 || !entry.hasPlba) {
+        return;
+    }
+    if (entry.point >= 1 && entry.point < MAXTRACK - 1) {
+        CueTrack &track = disc.tracks[entry.point];
+        track.indices[1] = entry.plba;
+        track.trackType = (entry.control & c_controlData) ? CueTrackType::TRACK_TYPE_DATA
+                                                           : CueTrackType::TRACK_TYPE_AUDIO;
+        trackCount = std::max(trackCount, entry.point);
+    } else if (entry.point == c_pointLeadOut) {
+        leadOut = entry.plba;
+    }
+}
+}  // namespace
+
+bool picostation::CcdImage::isCcdPath(const TCHAR *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcasecmp(extension, ".ccd") == 0;
+}
+
+bool picostation::CcdImage::getSiblingPath(const TCHAR *path, const char *extension, TCHAR *siblingPath) {
+    const char *dot = strrchr(path, '.');
+    const size_t stem = dot ? dot - path : strlen(path);
+    if (stem + strlen(extension) > c_maxFilePathLength) {
+        return false;
+    }
+    memcpy(siblingPath, path, stem);
+    strcpy(siblingPath + stem, extension);
+    return true;
+}
+
+bool picostation::CcdImage::parseToc(FIL *file, CueDisc &disc) {
+    enum class Section { Other, Entry, Track };
+
+    memset(&disc, 0, sizeof(disc));
+    disc.tracks[0].trackType = CueTrackType::TRACK_TYPE_UNKNOWN;
+    bool hasPregap[MAXTRACK] = {};
+
+    Section section = Section::Other;
+    TocEntry entry = {};
+    int trackNumber = 0;
+    int trackCount = 0;
+    long leadOut = -1;
+    char line[128];
+    while (f_gets(line, sizeof(line), file)) {
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ')) {
+            line[--length] = '\0';
+        }
+
+        if (line[0] == '[') {
+            if (section == Section::Entry) {
+                commitEntry(entry, disc, trackCount, leadOut);
+            }
+            section = Section::Other;
+            if (strncasecmp(line, "[Entry ", 7) == 0) {
+                section = Section::Entry;
+                entry = {};
+                entry.point = -1;
+            } else if (strncasecmp(line, "[TRACK ", 7) == 0) {
+                trackNumber = strtol(line + 7, nullptr, 10);
+                section = (trackNumber >= 1 && trackNumber < MAXTRACK - 1) ? Section::Track : Section::Other;
+            }
+            continue;
+        }
+
+        char *equals = strchr(line, '=');
+        if (!equals) {
+            continue;
+        }
+        *equals = '\0';
+        const long value = strtol(equals + 1, nullptr, 0);  // Points and flags are written in hex with a 0x prefix
+        if (section == Section::Entry) {
+            if (strcasecmp(line, "Session") == 0) {
+                entry.session = value;
+            } else if (strcasecmp(line, "Point") == 0) {
+                entry.point = value;
+            } else if (strcasecmp(line, "Control") == 0) {
+                entry.control = value;
+            } else if (strcasecmp(line, "PLBA") == 0) {
+                entry.plba = value;
+                entry.hasPlba = true;
+            }
+        } else if (section == Section::Track && strcasecmp(line, "INDEX 0") == 0 && value >= 0) {
+            disc.tracks[trackNumber].indices[0] = value;
+            hasPregap[trackNumber] = true;
+        }
+    }
+    if (section == Section::Entry) {
+        commitEntry(entry, disc, trackCount, leadOut);
+    }
+
+    if (trackCount < 1 || leadOut <= 0) {
+        DEBUG_PRINT("Bad CCD TOC: %d tracks, lead-out %ld\n", trackCount, leadOut);
+        return false;
+    }
+
+    // The image is one continuous dump from LBA 0, pregaps included, so every track reads from the same place
+    for (int i = 1; i <= trackCount; i++) {
+        CueTrack &track = disc.tracks[i];
+        const uint32_t previousStart = (i > 1) ? disc.tracks[i - 1].indices[1] : 0;
+        if (track.trackType == CueTrackType::TRACK_TYPE_UNKNOWN || (i > 1 && track.indices[1] <= previousStart)) {
+            DEBUG_PRINT("Bad CCD TOC: track %d missing or out of order\n", i);
+            return false;
+        }
+        if (!hasPregap[i] || track.indices[0] > track.indices[1] || track.indices[0] < previousStart) {
+            track.indices[0] = track.indices[1];
+        }
+        track.indexCount = 2;
+        track.fileOffset = 0;
+    }
+    for (int i = 1; i <= trackCount; i++) {
+        const uint32_t end = (i < trackCount) ? disc.tracks[i + 1].indices[1] : (uint32_t)leadOut;
+        if (end <= disc.tracks[i].indices[1]) {
+            return false;
+        }
+        disc.tracks[i].size = end - disc.tracks[i].indices[1];
+    }
+    disc.trackCount = trackCount;
+    m_sectorCount = leadOut;
+    return true;
+}
+
+FRESULT picostation::CcdImage::open(const TCHAR *ccdPath, CueDisc &disc) {
+    close();
+
+    FIL file;
+    FRESULT fr = f_open(&file, ccdPath, FA_READ | FA_OPEN_EXISTING);
+    if (FR_OK != fr) {
+        return fr;
+    }
+    const bool parsed = parseToc(&file, disc);
+    f_close(&file);
+    if (!parsed) {
+        return FR_INVALID_OBJECT;
+    }
+
+    TCHAR path[c_maxFilePathLength + 1];
+    FILINFO info;
+    if (!getSiblingPath(ccdPath, ".img", path)) {
+        return FR_INVALID_NAME;
+    }
+    fr = f_stat(path, &info);
+    if (FR_OK != fr) {
+        return fr;
+    }
+
+    // Without a .sub the disc still mounts, with the usual generated Q
+    if (getSiblingPath(ccdPath, ".sub", path) && f_stat(path, &info) == FR_OK) {
+        m_records = g_mountArena.allocate<uint8_t>(c_maxRecordsPerRead * c_recordBytes);
+        if (!m_records || !m_subQ.init(c_subQEntries)) {
+            close();
+            return FR_NOT_ENOUGH_CORE;
+        }
+    }
+    return FR_OK;
+}
+
+void picostation::CcdImage::close() {
+    m_subQ.reset();
+    m_records = nullptr;
+    m_sectorCount = 0;
+}
+
+// Called by core1 right after the same sectors were read from the .img
+void picostation::CcdImage::readSubchannel(FilePool &filePool, const int sector, const int sectorCount) {
+    if (!m_subQ.isActive() || sector < 0 || sector >= m_sectorCount) {
+        return;
+    }
+    FIL *fp = filePool.acquire(c_subFileIndex);
+    if (!fp) {
+        return;
+    }
+
+    const int count = std::min<int>(sectorCount, c_maxRecordsPerRead);
+    UINT br = 0;
+    FRESULT fr = f_lseek(fp, (FSIZE_t)sector * c_recordBytes);
+    if (FR_OK == fr) {
+        fr = f_read(fp, m_records, count * c_recordBytes, &br);
+    }
+    if (FR_OK != fr) {
+        DEBUG_PRINT("Subchannel read error at %d: %s (%d)\n", sector, FRESULT_str(fr), fr);
+        return;
+    }
+
+    for (UINT i = 0; i < br / c_recordBytes; i++) {
+        uint8_t *q = m_records + i * c_recordBytes + c_qOffset;
+        // The CRC is recorded inverted, SubQ sends it the way generateSubQ computes it
+        q[10] = ~q[10];
+        q[11] = ~q[11];
+        m_subQ.store(sector + i, q);
+    }
+}
+
+bool picostation::CcdImage::needsSubchannel(const int sector) const {
+    return m_subQ.isActive() && sector >= 0 && sector < m_sectorCount && !m_subQ.contains(sector);
+}
@@ -0,0 +1,875 @@
+#include "chd_image.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+#include "mount_arena.h"
+#include "third_party/iec-60908b/edcecc.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr uint32_t c_headerSize = 124;
+constexpr uint32_t c_version = 5;
+constexpr uint32_t c_cdFrameBytes = 2448;  // Sector plus subcode
+constexpr uint32_t c_cookedMode2Bytes = 2336;
+constexpr uint8_t c_syncHeader[12] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+
+constexpr uint32_t makeTag(const char (&tag)[5]) {
+    return ((uint32_t)tag[0] << 24) | ((uint32_t)tag[1] << 16) | ((uint32_t)tag[2] << 8) | (uint32_t)tag[3];
+}
+
+namespace Tag {
+enum : uint32_t {
+    CdZlib = makeTag("cdzl"),
+    CdLzma = makeTag("cdlz"),
+    CdFlac = makeTag("cdfl"),
+    TrackMetadata = makeTag("CHTR"),
+    TrackMetadata2 = makeTag("CHT2"),
+};
+}
+
+// Hunk map entry types, including the pseudo types that only exist in the compressed map
+namespace Compression {
+enum : uint8_t {
+    Type0 = 0,
+    Type3 = 3,
+    None = 4,
+    Self = 5,
+    Parent = 6,
+    RleSmall = 7,
+    RleLarge = 8,
+    Self0 = 9,
+    Self1 = 10,
+    ParentSelf = 11,
+    Parent0 = 12,
+    Parent1 = 13,
+};
+}
+
+uint32_t getBE16(const uint8_t *data) { return (data[0] << 8) | data[1]; }
+uint32_t getBE24(const uint8_t *data) { return (data[0] << 16) | (data[1] << 8) | data[2]; }
+uint32_t getBE32(const uint8_t *data) { return (getBE16(data) << 16) | getBE16(data + 2); }
+uint64_t getBE48(const uint8_t *data) { return ((uint64_t)getBE16(data) << 32) | getBE32(data + 2); }
+uint64_t getBE64(const uint8_t *data) { return ((uint64_t)getBE32(data) << 32) | getBE32(data + 4); }
+
+uint8_t toBCD(const int in) { return ((in / 10) << 4) | (in % 10); }
+}  // namespace
+
+bool picostation::ChdImage::isChdPath(const TCHAR *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcasecmp(extension, ".chd") == 0;
+}
+
+bool picostation::ChdImage::readAt(const FSIZE_t offset, void *buffer, const UINT size) {
+    UINT br = 0;
+    FRESULT fr = f_lseek(m_file, offset);
+    if (FR_OK == fr) {
+        fr = f_read(m_file, buffer, size, &br);
+    }
+    if (FR_OK != fr || br != size) {
+        DEBUG_PRINT("CHD read error at %llu: %s (%d)\n", (unsigned long long)offset, FRESULT_str(fr), fr);
+        return false;
+    }
+    return true;
+}
+
+FRESULT picostation::ChdImage::open(FilePool &filePool, CueDisc &disc) {
+    close();
+
+    m_file = filePool.acquire(0);
+    if (!m_file) {
+        return FR_NO_FILE;
+    }
+
+    uint8_t header[c_headerSize];
+    if (!readAt(0, header, sizeof(header))) {
+        return FR_DISK_ERR;
+    }
+    if (memcmp(header, "MComprHD", 8) != 0 || getBE32(header + 12) != c_version) {
+        DEBUG_PRINT("Not a CHD v5 image\n");
+        return FR_INVALID_OBJECT;
+    }
+
+    const uint64_t logicalBytes = getBE64(header + 32);
+    m_mapOffset = getBE64(header + 40);
+    m_metaOffset = getBE64(header + 48);
+    m_hunkBytes = getBE32(header + 56);
+    m_unitBytes = getBE32(header + 60);
+    m_framesPerHunk = m_unitBytes ? m_hunkBytes / m_unitBytes : 0;
+    if (m_unitBytes != c_cdFrameBytes || m_framesPerHunk == 0 || m_framesPerHunk > c_maxFramesPerHunk ||
+        m_hunkBytes % m_unitBytes != 0 || f_size(m_file) > UINT32_MAX) {
+        DEBUG_PRINT("Unsupported CHD layout: hunk %lu, unit %lu\n", m_hunkBytes, m_unitBytes);
+        return FR_INVALID_OBJECT;
+    }
+    m_hunkCount = (logicalBytes + m_hunkBytes - 1) / m_hunkBytes;
+
+    bool usesLzma = false;
+    bool usesFlac = false;
+    for (int i = 0; i < 4; i++) {
+        switch (getBE32(header + 16 + i * 4)) {
+            case 0:
+                m_codecs[i] = Codec::None;
+                break;
+            case Tag::CdZlib:
+                m_codecs[i] = Codec::Zlib;
+                break;
+            case Tag::CdLzma:
+                m_codecs[i] = Codec::Lzma;
+                usesLzma = true;
+                break;
+            case Tag::CdFlac:
+                m_codecs[i] = Codec::Flac;
+                usesFlac = true;
+                break;
+            default:
+                // Anything else (cdzs, generic codecs) fails per hunk, and only those hunks read as filler
+                DEBUG_PRINT("Unsupported CHD codec %08lx\n", getBE32(header + 16 + i * 4));
+                m_codecs[i] = Codec::Unsupported;
+                break;
+        }
+    }
+    m_compressedMap = m_codecs[0] != Codec::None;
+
+    if (!parseMetadata(disc) || !readMap()) {
+        close();
+        return FR_INVALID_OBJECT;
+    }
+
+    // Codec state is shared by every hunk, only one is decoded at a time
+    const uint32_t hunkSectorBytes = m_framesPerHunk * c_cdSamplesBytes;
+    // cdfl's encoder halves the hunk's sample count down to a sector's worth (CD_MAX_SECTOR_DATA), not FLAC's 2048
+    m_flacBlockSize = hunkSectorBytes / 4;
+    while (m_flacBlockSize > c_cdSamplesBytes) {
+        m_flacBlockSize /= 2;
+    }
+    size_t scratchBytes = 0;
+    if (usesLzma) {
+        scratchBytes = LzmaDecoder::getProbCount(3, 0) * sizeof(uint16_t);
+    }
+    if (usesFlac) {
+        scratchBytes = std::max(scratchBytes, FlacDecoder::getScratchSize(m_flacBlockSize));
+    }
+    m_inputBuffer = g_mountArena.allocate<uint8_t>(c_inputBufferSize);
+    m_scratch = scratchBytes ? g_mountArena.allocate(scratchBytes) : nullptr;
+    if (!m_inputBuffer || (scratchBytes && !m_scratch)) {
+        close();
+        return FR_NOT_ENOUGH_CORE;
+    }
+
+    // A second hunk buffer lets the next hunk decode while the current one plays
+    for (m_slotCount = 0; m_slotCount < c_maxSlots; m_slotCount++) {
+        m_slots[m_slotCount] = HunkSlot();
+        m_slots[m_slotCount].data = static_cast<uint8_t *>(g_mountArena.allocate(hunkSectorBytes, 4));
+        if (!m_slots[m_slotCount].data) {
+            break;
+        }
+    }
+    if (m_slotCount == 0) {
+        close();
+        return FR_NOT_ENOUGH_CORE;
+    }
+
+    DEBUG_PRINT("CHD: %lu hunks of %lu frames, %u hunk buffers, map checkpoint every %d hunks\n", m_hunkCount,
+                m_framesPerHunk, m_slotCount, 1 << m_checkpointShift);
+    return FR_OK;
+}
+
+void picostation::ChdImage::close() {
+    m_tracks = nullptr;
+    m_checkpoints = nullptr;
+    m_inputBuffer = nullptr;
+    m_scratch = nullptr;
+    m_activeSlot = nullptr;
+    m_slotCount = 0;
+    m_hunkCount = 0;
+    m_file = nullptr;
+    for (uint32_t &hunk : m_entryCacheHunk) {
+        hunk = UINT32_MAX;
+    }
+}
+
+bool picostation::ChdImage::parseMetadata(CueDisc &disc) {
+    m_tracks = g_mountArena.allocate<Track>(MAXTRACK);
+    if (!m_tracks) {
+        return false;
+    }
+    memset(m_tracks, 0, sizeof(Track) * MAXTRACK);
+
+    int trackCount = 0;
+    FSIZE_t offset = m_metaOffset;
+    for (int entries = 0; offset != 0 && entries < 256; entries++) {
+        uint8_t header[16];
+        if (!readAt(offset, header, sizeof(header))) {
+            return false;
+        }
+        const uint32_t tag = getBE32(header);
+        const uint32_t length = getBE24(header + 5);
+
+        if (tag == Tag::TrackMetadata2 || tag == Tag::TrackMetadata) {
+            char text[256];
+            const UINT textLength = std::min<uint32_t>(length, sizeof(text) - 1);
+            if (!readAt(offset + sizeof(header), text, textLength)) {
+                return false;
+            }
+            text[textLength] = '\0';
+
+            int number = 0;
+            int frames = 0;
+            int pregap = 0;
+            int postgap = 0;
+            char type[32];
+            char subtype[32];
+            char pregapType[32] = "";
+            char pregapSubtype[32];
+            const int fields =
+                sscanf(text, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d PGTYPE:%31s PGSUB:%31s POSTGAP:%d",
+                       &number, type, subtype, &frames, &pregap, pregapType, pregapSubtype, &postgap);
+            if (fields < 4 || number < 1 || number >= MAXTRACK - 1 || frames < 0 || pregap < 0 || postgap < 0) {
+                DEBUG_PRINT("Bad CHD track metadata: %s\n", text);
+                return false;
+            }
+
+            Track &track = m_tracks[number];
+            track.frames = frames;
+            track.pregap = pregap;
+            track.postgap = postgap;
+            track.pregapStored = pregapType[0] == 'V';
+            track.audio = strcmp(type, "AUDIO") == 0;
+            if (track.audio || strcmp(type, "MODE1_RAW") == 0 || strcmp(type, "MODE2_RAW") == 0) {
+                track.dataSize = c_cdSamplesBytes;
+            } else if (strcmp(type, "MODE2") == 0 || strcmp(type, "MODE2_FORM_MIX") == 0) {
+                track.dataSize = c_cookedMode2Bytes;
+            } else {
+                // Cooked 2048/2324 byte tracks would need their EDC/ECC rebuilt, no PlayStation disc uses them
+                DEBUG_PRINT("Unsupported CHD track type %s\n", type);
+                return false;
+            }
+            trackCount = std::max(trackCount, number);
+        }
+
+        offset = getBE64(header + 8);
+    }
+
+    if (trackCount == 0) {
+        DEBUG_PRINT("No CD track metadata in CHD\n");
+        return false;
+    }
+
+    // Lay the tracks out the same way the cue parser does; in the image each track is padded to 4 frames
+    uint32_t chdFrame = 0;
+    int32_t position = 0;
+    for (int i = 1; i <= trackCount; i++) {
+        Track &track = m_tracks[i];
+        CueTrack &cueTrack = disc.tracks[i];
+        if (track.frames == 0 || (track.pregapStored && track.pregap > track.frames)) {
+            DEBUG_PRINT("CHD track %d missing\n", i);
+            return false;
+        }
+
+        if (i == 1) {
+            // Track 1's pregap is the disc's fixed 2 seconds, which readSector never asks the image for
+            cueTrack.indices[0] = 0;
+            cueTrack.indices[1] = 0;
+        } else {
+            cueTrack.indices[0] = position;
+            cueTrack.indices[1] = position + track.pregap;
+        }
+        const uint32_t storedPregap = track.pregapStored ? track.pregap : 0;
+        track.firstSector = (int32_t)cueTrack.indices[1] - (int32_t)storedPregap;
+        track.chdFrame = chdFrame;
+
+        cueTrack.file = nullptr;
+        cueTrack.fileOffset = cueTrack.indices[1];
+        cueTrack.indexCount = 2;
+        cueTrack.size = track.frames - storedPregap + track.postgap;
+        cueTrack.postgap = track.postgap;
+        cueTrack.trackType = track.audio ? CueTrackType::TRACK_TYPE_AUDIO : CueTrackType::TRACK_TYPE_DATA;
+
+        position = cueTrack.indices[1] + cueTrack.size;
+        chdFrame += (track.frames + 3) & ~3u;
+    }
+    disc.trackCount = trackCount;
+
+    if (chdFrame > m_hunkCount * m_framesPerHunk + 3) {
+        DEBUG_PRINT("CHD tracks run past the end of the image\n");
+        return false;
+    }
+    return true;
+}
+
+void picostation::ChdImage::MapReader::init(FIL *file, const FSIZE_t base, const uint32_t length) {
+    m_file = file;
+    m_base = base;
+    m_length = length;
+    m_bufferStart = 0;
+    m_bufferLength = 0;
+    seek(0);
+}
+
+void picostation::ChdImage::MapReader::seek(const uint32_t bitPos) {
+    m_bytePos = bitPos >> 3;
+    m_accumulator = 0;
+    m_bits = 0;
+    read(bitPos & 7);
+}
+
+uint8_t picostation::ChdImage::MapReader::nextByte() {
+    const uint32_t pos = m_bytePos++;
+    if (pos >= m_length) {
+        // Past the end reads as zeros, like the reference implementation
+        return 0;
+    }
+    if (pos - m_bufferStart >= m_bufferLength) {
+        UINT br = 0;
+        m_bufferStart = pos;
+        m_bufferLength = 0;
+        if (f_lseek(m_file, m_base + pos) == FR_OK &&
+            f_read(m_file, m_buffer, std::min<uint32_t>(sizeof(m_buffer), m_length - pos), &br) == FR_OK) {
+            m_bufferLength = br;
+        }
+        if (m_bufferLength == 0) {
+            return 0;
+        }
+    }
+    return m_buffer[pos - m_bufferStart];
+}
+
+uint32_t picostation::ChdImage::MapReader::peek(const int count) {
+    while (m_bits < count) {
+        m_accumulator |= (uint32_t)nextByte() << (24 - m_bits);
+        m_bits += 8;
+    }
+    return count ? m_accumulator >> (32 - count) : 0;
+}
+
+uint32_t picostation::ChdImage::MapReader::read(const int count) {
+    if (count > 24) {
+        const uint32_t upper = read(count - 16);
+        return (upper << 16) | read(16);
+    }
+    const uint32_t value = peek(count);
+    remove(count);
+    return value;
+}
+
+bool picostation::ChdImage::readHuffmanTree() {
+    // 16 codes of at most 8 bits, code lengths stored 4 bits each with a run length escape
+    uint8_t lengths[16];
+    int node = 0;
+    while (node < 16) {
+        int length = m_typeReader.read(4);
+        if (length != 1) {
+            lengths[node++] = length;
+            continue;
+        }
+        length = m_typeReader.read(4);
+        if (length == 1) {
+            lengths[node++] = length;
+            continue;
+        }
+        int repeat = m_typeReader.read(4) + 3;
+        if (node + repeat > 16) {
+            return false;
+        }
+        while (repeat--) {
+            lengths[node++] = length;
+        }
+    }
+
+    // Canonical codes, assigned from the longest length down
+    uint32_t starts[9] = {0};
+    for (const uint8_t length : lengths) {
+        if (length > 8) {
+            return false;
+        }
+        starts[length]++;
+    }
+    uint32_t start = 0;
+    for (int length = 8; length > 0; length--) {
+        const uint32_t next = (start + starts[length]) >> 1;
+        if (length != 1 && next * 2 != start + starts[length]) {
+            return false;
+        }
+        starts[length] = start;
+        start = next;
+    }
+
+    memset(m_huffmanLookup, 0, sizeof(m_huffmanLookup));
+    for (int symbol = 0; symbol < 16; symbol++) {
+        const int length = lengths[symbol];
+        if (length == 0) {
+            continue;
+        }
+        const uint32_t code = starts[length]++;
+        const int shift = 8 - length;
+        for (uint32_t i = code << shift; i < ((code + 1) << shift); i++) {
+            m_huffmanLookup[i] = (symbol << 4) | length;
+        }
+    }
+    return true;
+}
+
+uint8_t picostation::ChdImage::decodeType() {
+    const uint8_t lookup = m_huffmanLookup[m_typeReader.peek(8)];
+    m_typeReader.remove(lookup & 0x0F);
+    return lookup >> 4;
+}
+
+uint8_t picostation::ChdImage::decodeNextType() {
+    if (m_mapState.repeat > 0) {
+        m_mapState.repeat--;
+        return m_mapState.lastType;
+    }
+
+    const uint8_t value = decodeType();
+    if (value == Compression::RleSmall) {
+        m_mapState.repeat = 2 + decodeType();
+    } else if (value == Compression::RleLarge) {
+        m_mapState.repeat = 2 + 16 + (decodeType() << 4);
+        m_mapState.repeat += decodeType();
+    } else {
+        m_mapState.lastType = value;
+    }
+    return m_mapState.lastType;
+}
+
+picostation::ChdImage::MapEntry picostation::ChdImage::decodeEntryData(const uint8_t type) {
+    MapEntry entry = {type, 0, 0};
+    switch (type) {
+        case Compression::None:
+            entry.length = m_hunkBytes;
+            entry.offset = m_mapState.offset;
+            m_mapState.offset += m_hunkBytes;
+            m_dataReader.read(16);  // CRC
+            break;
+
+        case Compression::Self:
+            entry.offset = m_mapState.lastSelf = m_dataReader.read(m_selfBits);
+            break;
+
+        case Compression::Parent:
+            m_dataReader.read(m_parentBits);
+            break;
+
+        case Compression::Self1:
+            m_mapState.lastSelf++;
+            [[fallthrough]];
+        case Compression::Self0:
+            entry.type = Compression::Self;
+            entry.offset = m_mapState.lastSelf;
+            break;
+
+        case Compression::ParentSelf:
+        case Compression::Parent0:
+        case Compression::Parent1:
+            entry.type = Compression::Parent;
+            break;
+
+        default:
+            // Compressed with one of the four codecs
+            entry.length = m_dataReader.read(m_lengthBits);
+            entry.offset = m_mapState.offset;
+            m_mapState.offset += entry.length;
+            m_dataReader.read(16);  // CRC
+            break;
+    }
+    return entry;
+}
+
+bool picostation::ChdImage::readMap() {
+    if (!m_compressedMap) {
+        // Uncompressed images have a flat map of 4 byte entries, read on demand
+        return true;
+    }
+
+    uint8_t header[16];
+    if (!readAt(m_mapOffset, header, sizeof(header))) {
+        return false;
+    }
+    const uint32_t mapBytes = getBE32(header);
+    const uint64_t firstOffset = getBE48(header + 4);
+    m_lengthBits = header[12];
+    m_selfBits = header[13];
+    m_parentBits = header[14];
+    if (m_lengthBits > 32 || m_selfBits > 32 || m_parentBits > 32) {
+        return false;
+    }
+
+    m_typeReader.init(m_file, m_mapOffset + sizeof(header), mapBytes);
+    m_dataReader.init(m_file, m_mapOffset + sizeof(header), mapBytes);
+    if (!readHuffmanTree()) {
+        DEBUG_PRINT("Bad CHD map\n");
+        return false;
+    }
+    const uint32_t typeStart = m_typeReader.getPosition();
+
+    // The entry types for every hunk come first, the lengths and offsets right after them
+    m_mapState = MapState();
+    for (uint32_t hunk = 0; hunk < m_hunkCount; hunk++) {
+        decodeNextType();
+    }
+    const uint32_t dataStart = m_typeReader.getPosition();
+
+    // Walk the whole map once more and keep the decoder state every few hunks, sized to a fixed budget
+    m_checkpointShift = 6;
+    while (((m_hunkCount >> m_checkpointShift) + 1) * sizeof(MapState) > c_checkpointBudget) {
+        m_checkpointShift++;
+    }
+    m_checkpoints = g_mountArena.allocate<MapState>((m_hunkCount >> m_checkpointShift) + 1);
+    if (!m_checkpoints) {
+        return false;
+    }
+
+    m_typeReader.seek(typeStart);
+    m_dataReader.seek(dataStart);
+    m_mapState = MapState();
+    m_mapState.offset = firstOffset;
+    const uint32_t checkpointMask = (1u << m_checkpointShift) - 1;
+    for (uint32_t hunk = 0; hunk < m_hunkCount; hunk++) {
+        if ((hunk & checkpointMask) == 0) {
+            MapState &checkpoint = m_checkpoints[hunk >> m_checkpointShift];
+            checkpoint = m_mapState;
+            checkpoint.typeBit = m_typeReader.getPosition();
+            checkpoint.dataBit = m_dataReader.getPosition();
+        }
+        decodeEntryData(decodeNextType());
+    }
+    m_mapHunk = m_hunkCount;
+
+    if (m_mapState.offset > f_size(m_file)) {
+        DEBUG_PRINT("CHD map points past the end of the file\n");
+        return false;
+    }
+    return true;
+}
+
+bool picostation::ChdImage::lookupEntry(const uint32_t hunk, MapEntry &entry) {
+    if (hunk >= m_hunkCount) {
+        return false;
+    }
+
+    const size_t cacheIndex = hunk % c_entryCacheSize;
+    if (m_entryCacheHunk[cacheIndex] == hunk) {
+        entry = m_entryCache[cacheIndex];
+        return true;
+    }
+
+    if (m_compressedMap) {
+        const uint32_t checkpoint = hunk >> m_checkpointShift;
+        if (hunk < m_mapHunk || (checkpoint << m_checkpointShift) > m_mapHunk) {
+            m_mapState = m_checkpoints[checkpoint];
+            m_typeReader.seek(m_mapState.typeBit);
+            m_dataReader.seek(m_mapState.dataBit);
+            m_mapHunk = checkpoint << m_checkpointShift;
+        }
+        while (m_mapHunk <= hunk) {
+            entry = decodeEntryData(decodeNextType());
+            m_mapHunk++;
+        }
+    } else {
+        uint8_t raw[4];
+        if (!readAt(m_mapOffset + (FSIZE_t)hunk * 4, raw, sizeof(raw))) {
+            return false;
+        }
+        // A zero entry is a hunk that was never written
+        const uint32_t block = getBE32(raw);
+        entry.type = block ? Compression::None : Compression::Parent;
+        entry.length = m_hunkBytes;
+        entry.offset = block * m_hunkBytes;
+    }
+
+    m_entryCacheHunk[cacheIndex] = hunk;
+    m_entryCache[cacheIndex] = entry;
+    return true;
+}
+
+bool picostation::ChdImage::resolveEntry(uint32_t &hunk, MapEntry &entry) {
+    if (!lookupEntry(hunk, entry)) {
+        return false;
+    }
+    // Hunks identical to an earlier one only point at it
+    for (int depth = 0; entry.type == Compression::Self && depth < 4; depth++) {
+        hunk = entry.offset;
+        if (!lookupEntry(hunk, entry)) {
+            return false;
+        }
+    }
+    return entry.type != Compression::Self;
+}
+
+picostation::ChdImage::HunkSlot *picostation::ChdImage::findSlot(const uint32_t hunk) {
+    for (size_t i = 0; i < m_slotCount; i++) {
+        if (m_slots[i].hunk == hunk) {
+            return &m_slots[i];
+        }
+    }
+    return nullptr;
+}
+
+picostation::ChdImage::HunkSlot *picostation::ChdImage::claimSlot(const HunkSlot *keep) {
+    HunkSlot *victim = nullptr;
+    for (size_t i = 0; i < m_slotCount; i++) {
+        HunkSlot *slot = &m_slots[i];
+        if (slot != keep && (!victim || slot->lastUse < victim->lastUse)) {
+            victim = slot;
+        }
+    }
+    if (!victim) {
+        victim = &m_slots[0];
+    }
+    if (victim == m_activeSlot) {
+        m_activeSlot = nullptr;
+    }
+    victim->hunk = UINT32_MAX;
+    victim->validBytes = 0;
+    return victim;
+}
+
+bool picostation::ChdImage::startDecode(HunkSlot &slot, const uint32_t hunk, const MapEntry &entry) {
+    if (m_activeSlot && m_activeSlot != &slot) {
+        // Whatever the other slot decoded so far stays usable, it just can't grow any more
+        m_activeSlot = nullptr;
+    }
+
+    slot.hunk = hunk;
+    slot.validBytes = 0;
+    slot.eccMask = 0;
+    slot.eccDone = 0;
+
+    const Codec codec = m_codecs[entry.type];
+    m_input.init(m_file, entry.offset, entry.length, m_inputBuffer, c_inputBufferSize);
+    const uint32_t outputSize = m_framesPerHunk * c_cdSamplesBytes;
+
+    switch (codec) {
+        case Codec::Zlib:
+        case Codec::Lzma: {
+            // ECC flags, one bit per frame, then the length of the sector data stream; the subcode stream after
+            // it is never needed since SubQ is generated
+            const uint32_t eccBytes = (m_framesPerHunk + 7) / 8;
+            for (uint32_t i = 0; i < eccBytes; i++) {
+                slot.eccMask |= (uint32_t)m_input.readByte() << (i * 8);
+            }
+            m_input.skip(m_hunkBytes < 65536 ? 2 : 3);
+            if (codec == Codec::Zlib) {
+                m_inflate.begin(&m_input, slot.data, outputSize);
+            } else {
+                m_lzma.begin(&m_input, slot.data, outputSize, static_cast<uint16_t *>(m_scratch), 3, 0, 2);
+            }
+            break;
+        }
+
+        case Codec::Flac:
+            // CHD keeps CD audio big endian
+            m_flac.begin(&m_input, slot.data, outputSize, static_cast<int32_t *>(m_scratch), m_flacBlockSize, true);
+            break;
+
+        default:
+            slot.hunk = UINT32_MAX;
+            return false;
+    }
+
+    m_activeSlot = &slot;
+    m_activeCodec = codec;
+    return true;
+}
+
+bool picostation::ChdImage::stepDecode(const uint32_t target) {
+    HunkSlot &slot = *m_activeSlot;
+    bool failed = false;
+    bool done = false;
+
+    switch (m_activeCodec) {
+        case Codec::Zlib: {
+            const Inflate::Status status = m_inflate.decode(target);
+            slot.validBytes = m_inflate.getOutputPos();
+            failed = status == Inflate::Status::Error;
+            done = status == Inflate::Status::Done;
+            break;
+        }
+        case Codec::Lzma: {
+            const LzmaDecoder::Status status = m_lzma.decode(target);
+            slot.validBytes = m_lzma.getOutputPos();
+            failed = status == LzmaDecoder::Status::Error;
+            done = status == LzmaDecoder::Status::Done;
+            break;
+        }
+        case Codec::Flac: {
+            const FlacDecoder::Status status = m_flac.decode(target);
+            slot.validBytes = m_flac.getOutputPos();
+            failed = status == FlacDecoder::Status::Error;
+            done = status == FlacDecoder::Status::Done;
+            break;
+        }
+        default:
+            failed = true;
+            break;
+    }
+
+    // A stream that ends short of the hunk is as broken as one that fails to decode
+    if (failed || (done && slot.validBytes < m_framesPerHunk * c_cdSamplesBytes)) {
+        DEBUG_PRINT("CHD hunk %lu failed to decode\n", slot.hunk);
+        slot.hunk = UINT32_MAX;
+        slot.validBytes = 0;
+        m_activeSlot = nullptr;
+        return false;
+    }
+    if (done) {
+        m_activeSlot = nullptr;
+    }
+    return true;
+}
+
+const uint8_t *picostation::ChdImage::getFrame(uint32_t hunk, const uint32_t frame, uint8_t *buffer) {
+    MapEntry entry;
+    if (!resolveEntry(hunk, entry)) {
+        return nullptr;
+    }
+
+    if (entry.type == Compression::None) {
+        // Stored as is, frames still carry their subcode
+        return readAt(entry.offset + (FSIZE_t)frame * m_unitBytes, buffer, c_cdSamplesBytes) ? buffer : nullptr;
+    }
+    if (entry.type > Compression::Type3) {
+        // Parent images aren't supported
+        return nullptr;
+    }
+
+    HunkSlot *slot = findSlot(hunk);
+    if (!slot) {
+        slot = claimSlot(nullptr);
+        if (!startDecode(*slot, hunk, entry)) {
+            return nullptr;
+        }
+    }
+    slot->lastUse = ++m_useCounter;
+
+    const uint32_t needed = (frame + 1) * c_cdSamplesBytes;
+    while (slot->validBytes < needed) {
+        if (slot != m_activeSlot && !startDecode(*slot, hunk, entry)) {
+            // Abandoned part way through earlier, start it over
+            return nullptr;
+        }
+        if (!stepDecode(needed)) {
+            return nullptr;
+        }
+    }
+
+    uint8_t *sector = slot->data + frame * c_cdSamplesBytes;
+    const uint32_t frameBit = 1u << frame;
+    if ((slot->eccMask & frameBit) && !(slot->eccDone & frameBit)) {
+        if (slot == m_activeSlot) {
+            // The decoder still copies back from this data, so only a copy can be fixed up for now
+            memcpy(buffer, sector, c_cdSamplesBytes);
+            sector = buffer;
+        } else {
+            slot->eccDone |= frameBit;
+        }
+        memcpy(sector, c_syncHeader, sizeof(c_syncHeader));
+        compute_ecc(sector);
+    }
+    return sector;
+}
+
+bool picostation::ChdImage::readSector(const int track, const int adjustedSector, uint8_t *buffer) {
+    if (!m_tracks) {
+        return false;
+    }
+    const Track &chdTrack = m_tracks[track];
+    const int32_t trackFrame = adjustedSector - chdTrack.firstSector;
+    if (trackFrame < 0 || (uint32_t)trackFrame >= chdTrack.frames) {
+        // Pregap or postgap that isn't in the image
+        return false;
+    }
+
+    const uint32_t chdFrame = chdTrack.chdFrame + trackFrame;
+    const uint8_t *frame = getFrame(chdFrame / m_framesPerHunk, chdFrame % m_framesPerHunk, buffer);
+    if (!frame) {
+        return false;
+    }
+
+    if (chdTrack.audio) {
+        // Back to the little endian samples a bin file would hold
+        const uint16_t *from = reinterpret_cast<const uint16_t *>(frame);
+        uint16_t *to = reinterpret_cast<uint16_t *>(buffer);
+        for (size_t i = 0; i < c_cdSamplesBytes / sizeof(uint16_t); i++) {
+            to[i] = __builtin_bswap16(from[i]);
+        }
+    } else if (chdTrack.dataSize == c_cookedMode2Bytes) {
+        // Sync and header aren't stored for 2336 byte tracks
+        const int sector = adjustedSector + c_preGap;
+        memmove(buffer + 16, frame, c_cookedMode2Bytes);
+        memcpy(buffer, c_syncHeader, sizeof(c_syncHeader));
+        buffer[12] = toBCD(sector / 75 / 60);
+        buffer[13] = toBCD((sector / 75) % 60);
+        buffer[14] = toBCD(sector % 75);
+        buffer[15] = 0x02;
+    } else if (frame != buffer) {
+        memcpy(buffer, frame, c_cdSamplesBytes);
+    }
+    return true;
+}
+
+void picostation::ChdImage::prefetch(const int track, const int adjustedSector) {
+    if (!m_tracks) {
+        return;
+    }
+    const Track &chdTrack = m_tracks[track];
+    const int32_t trackFrame = adjustedSector - chdTrack.firstSector;
+    if (trackFrame < 0 || (uint32_t)trackFrame >= chdTrack.frames) {
+        return;
+    }
+
+    const uint32_t currentHunk = (chdTrack.chdFrame + trackFrame) / m_framesPerHunk;
+    const uint32_t hunkSectorBytes = m_framesPerHunk * c_cdSamplesBytes;
+    const HunkSlot *currentSlot = nullptr;
+
+    // Finish the hunk being played, then get the next one going; at most a sector's worth of decoding per call
+    for (uint32_t ahead = currentHunk; ahead <= currentHunk + 1; ahead++) {
+        uint32_t hunk = ahead;
+        MapEntry entry;
+        if (!resolveEntry(hunk, entry) || entry.type > Compression::Type3 ||
+            m_codecs[entry.type] == Codec::Unsupported) {
+            continue;
+        }
+
+        HunkSlot *slot = findSlot(hunk);
+        if (ahead == currentHunk) {
+            currentSlot = slot;
+        }
+        if (slot && slot->validBytes >= hunkSectorBytes) {
+            continue;
+        }
+
+        if (!slot) {
+            if (ahead != currentHunk && m_slotCount < 2) {
+                // A single buffer is still busy with the hunk being played
+                return;
+            }
+            slot = claimSlot(currentSlot);
+            slot->lastUse = ++m_useCounter;
+            startDecode(*slot, hunk, entry);
+            return;
+        }
+
+        if (slot != m_activeSlot) {
+            startDecode(*slot, hunk, entry);
+            return;
+        }
+        stepDecode(slot->validBytes + c_cdSamplesBytes);
+        return;
+    }
+}
@@ -3,13 +3,16 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "drive_mechanics.h"
 #include "hardware/pio.h"
+#include "hardware/sync.h"
 #include "logging.h"
 #include "main.pio.h"
 #include "pico/bootrom.h"
 #include "picostation.h"
+#include "placement.h"
 #include "pseudo_atomics.h"
 #include "values.h"
 
@@ -64,7 +67,7 @@ inline void picostation::MechCommand::autoSequence(const uint32_t latched)  // $
 
     int tracks_to_move = 0;
 
-    m_sensData[SENS::XBUSY] = (subCommand != 0);
+    setSens(SENS::XBUSY, subCommand != 0);
     const int track = g_driveMechanics.getTrack();
 
     if (subCommand == 0x7)  // Focus-On
@@ -115,8 +118,8 @@ inline void picostation::MechCommand::autoSequence(const uint32_t latched)  // $
     }
 
     if (!m_autoSeqAlarmID) {
-        m_autoSeqAlarmID = add_alarm_in_ms(
-            15,
+        m_autoSeqAlarmID = add_alarm_in_us(
+            g_driveMechanics.getSeekTime(abs(tracks_to_move)),
             [](alarm_id_t id, void *user_data) -> int64_t {
                 picostation::MechCommand *mechCommand = static_cast<picostation::MechCommand *>(user_data);
 
@@ -198,6 +201,10 @@ inline void picostation::MechCommand::customCommand(const uint32_t latched) {
             //     }
             // }
             break;
+        case Command::COMMAND_SEEK_PROFILE:
+            DEBUG_PRINT("COMMAND_SEEK_PROFILE %x\n", arg);
+            g_driveMechanics.setSeekProfile(arg ? SeekProfile::FAST : SeekProfile::ACCURATE);
+            break;
         case Command::COMMAND_BOOTLOADER:
             if (arg == 0xBEEF) {
                 // Restart into bootloader
@@ -277,8 +284,8 @@ inline void picostation::MechCommand::trackingMode(const uint32_t latched)  // $
 inline void picostation::MechCommand::spindleControl(const uint32_t latched) {
     const uint32_t subCommand = (latched & 0x0F0000) >> 16;
 
-    m_sensData[SENS::GFS] = (subCommand == SpindleCommands::CLVA);
-    if (!m_sensData[SENS::GFS]) {
+    setSens(SENS::GFS, subCommand == SpindleCommands::CLVA);
+    if (!getSens(SENS::GFS)) {
         g_subqDelay = false;
         pio_sm_clear_fifos(PIOInstance::SUBQ, SM::SUBQ);
     }
@@ -315,10 +322,8 @@ inline void picostation::MechCommand::spindleControl(const uint32_t latched) {
     }*/
 }
 
-void __time_critical_func(picostation::MechCommand::processLatchedCommand)() {
-    const uint32_t latched = m_latched;
+void CORE0_FUNC(picostation::MechCommand::processLatchedCommand)(const uint32_t latched) {
     const uint32_t command = (latched & 0xF00000) >> 20;
-    m_latched = 0;
 
     switch (command) {
         case TopLevelCommands::TRACKING_MODE:  // $2X commands - Tracking and sled servo control
@@ -366,13 +371,28 @@ void __time_critical_func(picostation::MechCommand::processLatchedCommand)() {
     }
 }
 
-bool __time_critical_func(picostation::MechCommand::getSens)(const size_t what) const { return m_sensData[what]; }
+bool CORE0_FUNC(picostation::MechCommand::getSens)(const size_t what) const { return (m_sensData >> what) & 1; }
 
-void __time_critical_func(picostation::MechCommand::setSens)(const size_t what, const bool new_value) {
-    m_sensData[what] = new_value;
-    if (what == m_currentSens) {
-        gpio_put(Pin::SENS, new_value);
+// Called from the main loop, the command ring interrupt and alarm callbacks, the word and what the PIO was sent
+// can't be allowed to drift apart
+void CORE0_FUNC(picostation::MechCommand::setSens)(const size_t what, const bool new_value) {
+    const uint32_t irqState = save_and_disable_interrupts();
+    const uint16_t sens = new_value ? (m_sensData | (1u << what)) : (m_sensData & ~(1u << what));
+    if (sens != m_sensData) {
+        m_sensData = sens;
+        publishSens();
     }
+    restore_interrupts(irqState);
+}
+
+void CORE0_FUNC(picostation::MechCommand::publishSens)() {
+    // The state machine only keeps the newest word, so when it is stuck in a byte long enough to fill the FIFO the
+    // words waiting are stale. Flush them rather than lose this one, or block here with interrupts off.
+    if (pio_sm_is_tx_fifo_full(PIOInstance::SENS, SM::SENS)) {
+        pio_sm_clear_fifos(PIOInstance::SENS, SM::SENS);
+    }
+    // Shifted up by one for the state machine, its bit select loop always drops one bit too many
+    pio_sm_put(PIOInstance::SENS, SM::SENS, (uint32_t)m_sensData << 1);
 }
 
 bool picostation::MechCommand::getSoct() { return m_soctEnabled.Load(); }
@@ -381,15 +401,6 @@ void picostation::MechCommand::setSoct(const bool new_value) { m_soctEnabled = n
 void picostation::MechCommand::updateAutoSeqTrack() {
     m_autoSeqAlarmID = 0;
     g_driveMechanics.setTrack(m_autoSeqTrack);
-    m_sensData[SENS::XBUSY] = 0;
+    setSens(SENS::XBUSY, false);
 }
 
-void __time_critical_func(picostation::MechCommand::updateMechSens)() {
-    while (!pio_sm_is_rx_fifo_empty(PIOInstance::MECHACON, SM::MECHACON)) {
-        const uint32_t c = pio_sm_get_blocking(PIOInstance::MECHACON, SM::MECHACON) >> 24;
-        m_latched = m_latched >> 8;
-        m_latched = m_latched | (c << 16);
-        m_currentSens = c >> 4;
-    }
-    gpio_put(Pin::SENS, m_sensData[m_currentSens]);
-}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "command_ring.h"
+
+#include <stdio.h>
+
+#include "cmd.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+#include "logging.h"
+#include "placement.h"
+#include "values.h"
+
+#if DEBUG_CMD
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+picostation::CommandRing picostation::g_commandRing;
+
+// Never runs out: 4 billion bytes on RP2040, and the endless mode on RP2350, whose top nibble selects it
+static constexpr uint32_t c_endlessTransfers = 0xFFFFFFFF;
+
+void picostation::CommandRing::init(MechCommand *mechCommand) {
+    m_mechCommand = mechCommand;
+    m_byteChannel = dma_claim_unused_channel(true);
+    m_edgeChannel = dma_claim_unused_channel(true);
+    m_boundaryChannel = dma_claim_unused_channel(true);
+
+    // The mechacon program pushes each byte in the top 8 bits of a word, a byte read pops the word
+    dma_channel_config config = dma_channel_get_default_config(m_byteChannel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, c_byteRingBits);
+    channel_config_set_dreq(&config, pio_get_dreq(PIOInstance::MECHACON, SM::MECHACON, false));
+    dma_channel_configure(m_byteChannel, &config, m_bytes,
+                          reinterpret_cast<const volatile uint8_t *>(&PIOInstance::MECHACON->rxf[SM::MECHACON]) + 3,
+                          c_endlessTransfers, true);
+
+    config = dma_channel_get_default_config(m_edgeChannel);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, pio_get_dreq(PIOInstance::XLAT, SM::XLAT, false));
+    channel_config_set_chain_to(&config, m_boundaryChannel);
+    dma_channel_configure(m_edgeChannel, &config, &m_sink, &PIOInstance::XLAT->rxf[SM::XLAT], 1, false);
+
+    config = dma_channel_get_default_config(m_boundaryChannel);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, c_boundaryRingBits);
+    channel_config_set_chain_to(&config, m_edgeChannel);
+    dma_channel_configure(m_boundaryChannel, &config, m_boundaries, &dma_hw->ch[m_byteChannel].write_addr, 1, false);
+
+    dma_channel_set_irq1_enabled(m_boundaryChannel, true);
+    irq_add_shared_handler(DMA_IRQ_1, interruptHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    dma_channel_start(m_edgeChannel);
+}
+
+void picostation::CommandRing::flush() {
+    const uint32_t irqState = save_and_disable_interrupts();
+    m_bytePosition = (dma_hw->ch[m_byteChannel].write_addr - (uintptr_t)m_bytes) & (c_byteRingSize - 1);
+    m_boundaryRead = getBoundaryWriteIndex();
+    restore_interrupts(irqState);
+}
+
+size_t CORE0_FUNC(picostation::CommandRing::getBoundaryWriteIndex)() const {
+    return (dma_hw->ch[m_boundaryChannel].write_addr - (uintptr_t)m_boundaries) / sizeof(uint32_t) &
+           (c_boundaryRingSize - 1);
+}
+
+void CORE0_FUNC(picostation::CommandRing::interruptHandler)() {
+    if (dma_hw->ints1 & (1u << g_commandRing.m_boundaryChannel)) {
+        dma_hw->ints1 = 1u << g_commandRing.m_boundaryChannel;
+        g_commandRing.decode();
+    }
+}
+
+void CORE0_FUNC(picostation::CommandRing::decode)() {
+    // Everything the DMA has marked so far, a late interrupt just finds several commands waiting
+    const size_t boundaryWrite = getBoundaryWriteIndex();
+    while (m_boundaryRead != boundaryWrite) {
+        const size_t end = (m_boundaries[m_boundaryRead] - (uintptr_t)m_bytes) & (c_byteRingSize - 1);
+        m_boundaryRead = (m_boundaryRead + 1) & (c_boundaryRingSize - 1);
+
+        size_t count = (end - m_bytePosition) & (c_byteRingSize - 1);
+        if (count == 0) {
+            // A latch edge with no byte clocked in since the last one, there is no command to hand on
+            continue;
+        }
+        if (count > c_maxCommandBytes) {
+            // Only the last 3 bytes count, same as the latch always did
+            m_overruns = m_overruns + 1;
+            DEBUG_PRINT("Mechacon command of %u bytes, %lu overruns\n", count, m_overruns);
+            m_bytePosition = (end - c_maxCommandBytes) & (c_byteRingSize - 1);
+            count = c_maxCommandBytes;
+        }
+
+        // Last byte on top, as the bytes were clocked in
+        uint32_t latched = 0;
+        for (; count > 0; count--) {
+            latched = (latched >> 8) | ((uint32_t)m_bytes[m_bytePosition] << 16);
+            m_bytePosition = (m_bytePosition + 1) & (c_byteRingSize - 1);
+        }
+        m_mechCommand->processLatchedCommand(latched);
+    }
+}
@@ -0,0 +1,281 @@
+#include "cue_cache.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "f_util.h"
+#include "ff.h"
+#include "flac_file.h"
+#include "global.h"
+#include "logging.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr uint32_t c_cacheMagic = 0x43435350;  // "PSCC"
+constexpr uint16_t c_cacheVersion = 3;
+constexpr char c_cacheExtension[] = ".pscache";
+
+namespace TrackFlags {
+enum : uint8_t {
+    Compressed = 1 << 0,
+    DigitalCopyPermitted = 1 << 1,
+    FourChannelAudio = 1 << 2,
+    PreEmphasis = 1 << 3,
+    SerialCopyManagement = 1 << 4,
+};
+}
+
+struct CacheHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t maxIndex;  // MAXINDEX the snapshot was built with, the track records depend on it
+    uint64_t cueSize;
+    uint16_t cueDate;
+    uint16_t cueTime;
+    uint16_t trackCount;
+    uint16_t fileCount;
+    uint16_t namePoolSize;
+    uint16_t reserved;
+};
+
+struct CacheTrack {
+    uint32_t size;
+    uint32_t fileOffset;
+    uint32_t postgap;
+    uint32_t indices[MAXINDEX];
+    uint8_t indexCount;
+    uint8_t trackType;
+    uint8_t fileIndex;
+    uint8_t flags;
+};
+
+// What a referenced file looked like when the snapshot was taken
+struct CacheFile {
+    uint64_t size;
+    uint16_t date;
+    uint16_t time;
+    uint32_t reserved;
+};
+
+bool statFile(const TCHAR *parentPath, const char *name, CacheFile &record) {
+    TCHAR path[c_maxFilePathLength + 1];
+    const int length = snprintf(path, sizeof(path), "%s/%s", parentPath, name);
+    FILINFO info;
+    if (length < 0 || (size_t)length >= sizeof(path) || f_stat(path, &info) != FR_OK) {
+        return false;
+    }
+    record = {};
+    record.size = info.fsize;
+    record.date = info.fdate;
+    record.time = info.ftime;
+    return true;
+}
+
+bool readExact(FIL *fp, void *buffer, const UINT size) {
+    UINT br = 0;
+    return f_read(fp, buffer, size, &br) == FR_OK && br == size;
+}
+
+bool writeExact(FIL *fp, const void *buffer, const UINT size) {
+    UINT bw = 0;
+    return f_write(fp, buffer, size, &bw) == FR_OK && bw == size;
+}
+}  // namespace
+
+void picostation::CueFileTable::clear() {
+    fileCount = 0;
+    poolUsed = 0;
+    memset(trackFile, c_noFile, sizeof(trackFile));
+}
+
+int picostation::CueFileTable::addFile(const char *name) {
+    const size_t length = strnlen(name, c_maxFilePathLength) + 1;
+    if (fileCount >= MAXTRACK || poolUsed + length > c_namePoolSize) {
+        return -1;
+    }
+
+    nameOffsets[fileCount] = poolUsed;
+    dataOffsets[fileCount] = 0;
+    flacFiles[fileCount] = FlacFile::isFlacPath(name);
+    memcpy(&namePool[poolUsed], name, length - 1);
+    namePool[poolUsed + length - 1] = '\0';
+    poolUsed += length;
+
+    return fileCount++;
+}
+
+bool picostation::CueCache::getCachePath(const TCHAR *cuePath, TCHAR *cachePath) {
+    const size_t length = strnlen(cuePath, c_maxFilePathLength);
+    if (length + sizeof(c_cacheExtension) > c_maxFilePathLength + 1) {
+        return false;
+    }
+    memcpy(cachePath, cuePath, length);
+    memcpy(cachePath + length, c_cacheExtension, sizeof(c_cacheExtension));
+    return true;
+}
+
+bool picostation::CueCache::load(const TCHAR *cuePath, const TCHAR *parentPath, const FILINFO &cueInfo, CueDisc &disc,
+                                 CueFileTable &files) {
+    TCHAR cachePath[c_maxFilePathLength + 1];
+    if (!getCachePath(cuePath, cachePath)) {
+        return false;
+    }
+
+    FIL fp;
+    if (f_open(&fp, cachePath, FA_READ | FA_OPEN_EXISTING) != FR_OK) {
+        return false;
+    }
+
+    bool valid = false;
+    CacheHeader header;
+    if (readExact(&fp, &header, sizeof(header)) && header.magic == c_cacheMagic && header.version == c_cacheVersion &&
+        header.maxIndex == MAXINDEX && header.cueSize == cueInfo.fsize && header.cueDate == cueInfo.fdate &&
+        header.cueTime == cueInfo.ftime && header.trackCount > 0 && header.trackCount < MAXTRACK - 1 &&
+        header.fileCount <= header.trackCount && header.namePoolSize <= CueFileTable::c_namePoolSize) {
+        valid = true;
+        disc.trackCount = header.trackCount;
+        disc.catalog[0] = 0;
+        disc.isrc[0] = 0;
+        files.clear();
+
+        for (size_t i = 0; valid && i <= header.trackCount; i++) {
+            CacheTrack record;
+            if (!readExact(&fp, &record, sizeof(record)) ||
+                (record.fileIndex != CueFileTable::c_noFile && record.fileIndex >= header.fileCount)) {
+                valid = false;
+                break;
+            }
+
+            CueTrack &track = disc.tracks[i];
+            track.file = nullptr;
+            track.size = record.size;
+            track.fileOffset = record.fileOffset;
+            track.postgap = record.postgap;
+            track.indexCount = record.indexCount;
+            memcpy(track.indices, record.indices, sizeof(track.indices));
+            track.trackType = static_cast<CueTrackType>(record.trackType);
+            track.compressed = (record.flags & TrackFlags::Compressed) != 0;
+            track.digitalCopyPermitted = (record.flags & TrackFlags::DigitalCopyPermitted) != 0;
+            track.fourChannelAudio = (record.flags & TrackFlags::FourChannelAudio) != 0;
+            track.preEmphasis = (record.flags & TrackFlags::PreEmphasis) != 0;
+            track.serialCopyManagementSystem = (record.flags & TrackFlags::SerialCopyManagement) != 0;
+            files.trackFile[i] = record.fileIndex;
+        }
+
+        valid = valid && readExact(&fp, files.nameOffsets, header.fileCount * sizeof(files.nameOffsets[0])) &&
+                readExact(&fp, files.dataOffsets, header.fileCount * sizeof(files.dataOffsets[0])) &&
+                readExact(&fp, files.namePool, header.namePoolSize);
+
+        if (valid) {
+            files.fileCount = header.fileCount;
+            files.poolUsed = header.namePoolSize;
+            for (int i = 0; i < files.fileCount; i++) {
+                if (files.nameOffsets[i] >= files.poolUsed) {
+                    valid = false;
+                    break;
+                }
+            }
+            if (header.namePoolSize == 0 || files.namePool[header.namePoolSize - 1] != '\0') {
+                valid = false;
+            }
+            for (int i = 0; valid && i < files.fileCount; i++) {
+                files.flacFiles[i] = FlacFile::isFlacPath(files.getFileName(i));
+            }
+        }
+
+        // One f_stat per file, a bin that was replaced or re-dumped has other sizes and offsets than the snapshot
+        for (int i = 0; valid && i < files.fileCount; i++) {
+            CacheFile stored;
+            CacheFile current;
+            valid = readExact(&fp, &stored, sizeof(stored)) && statFile(parentPath, files.getFileName(i), current) &&
+                    stored.size == current.size && stored.date == current.date && stored.time == current.time;
+        }
+    }
+
+    f_close(&fp);
+
+    if (!valid) {
+        files.clear();
+        DEBUG_PRINT("Cue cache %s is stale or invalid\n", cachePath);
+    }
+    return valid;
+}
+
+bool picostation::CueCache::save(const TCHAR *cuePath, const TCHAR *parentPath, const FILINFO &cueInfo,
+                                 const CueDisc &disc, const CueFileTable &files) {
+    TCHAR cachePath[c_maxFilePathLength + 1];
+    if (!getCachePath(cuePath, cachePath)) {
+        return false;
+    }
+
+    FIL fp;
+    FRESULT fr = f_open(&fp, cachePath, FA_WRITE | FA_CREATE_ALWAYS);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_open(%s) error: %s (%d)\n", cachePath, FRESULT_str(fr), fr);
+        return false;
+    }
+
+    CacheHeader header = {};
+    header.version = c_cacheVersion;
+    header.maxIndex = MAXINDEX;
+    header.cueSize = cueInfo.fsize;
+    header.cueDate = cueInfo.fdate;
+    header.cueTime = cueInfo.ftime;
+    header.trackCount = disc.trackCount;
+    header.fileCount = files.fileCount;
+    header.namePoolSize = files.poolUsed;
+
+    // The header goes out without its magic first, and is only completed once everything else made it to the
+    // card, so a snapshot cut short by a power-off is never mistaken for a valid one.
+    bool ok = writeExact(&fp, &header, sizeof(header));
+
+    for (int i = 0; ok && i <= disc.trackCount; i++) {
+        const CueTrack &track = disc.tracks[i];
+        CacheTrack record = {};
+        record.size = track.size;
+        record.fileOffset = track.fileOffset;
+        record.postgap = track.postgap;
+        record.indexCount = track.indexCount;
+        memcpy(record.indices, track.indices, sizeof(record.indices));
+        record.trackType = track.trackType;
+        record.fileIndex = files.trackFile[i];
+        record.flags = (track.compressed ? TrackFlags::Compressed : 0) |
+                       (track.digitalCopyPermitted ? TrackFlags::DigitalCopyPermitted : 0) |
+                       (track.fourChannelAudio ? TrackFlags::FourChannelAudio : 0) |
+                       (track.preEmphasis ? TrackFlags::PreEmphasis : 0) |
+                       (track.serialCopyManagementSystem ? TrackFlags::SerialCopyManagement : 0);
+        ok = writeExact(&fp, &record, sizeof(record));
+    }
+
+    ok = ok && writeExact(&fp, files.nameOffsets, files.fileCount * sizeof(files.nameOffsets[0])) &&
+         writeExact(&fp, files.dataOffsets, files.fileCount * sizeof(files.dataOffsets[0])) &&
+         writeExact(&fp, files.namePool, files.poolUsed);
+
+    for (int i = 0; ok && i < files.fileCount; i++) {
+        CacheFile record;
+        ok = statFile(parentPath, files.getFileName(i), record) && writeExact(&fp, &record, sizeof(record));
+    }
+
+    if (ok) {
+        header.magic = c_cacheMagic;
+        ok = f_lseek(&fp, 0) == FR_OK && writeExact(&fp, &header, sizeof(header));
+    }
+
+    f_close(&fp);
+
+    if (ok) {
+        // Keep the snapshot out of the directory listing
+        f_chmod(cachePath, AM_HID, AM_HID);
+    } else {
+        DEBUG_PRINT("Failed to write cue cache %s\n", cachePath);
+        f_unlink(cachePath);
+    }
+    return ok;
+}
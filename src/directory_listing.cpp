@@ -22,11 +22,11 @@ namespace picostation {
 
 namespace {
     char currentDirectory[c_maxFilePathLength + 1];
-    listingBuilder* fileListing;
+    listingBuilder fileListing;
 }  // namespace
 
 void DirectoryListing::init() {
-    fileListing = new listingBuilder();
+    fileListing.clear();
     gotoRoot();
 }
 
@@ -98,57 +98,51 @@ void DirectoryListing::getPathWithoutExtension(const char* filePath, char* newPa
     }
 }
 
+// Each walk keeps a single FILINFO (~280 bytes) on the stack
+
 bool DirectoryListing::getDirectoryEntries(const uint32_t offset) {
     DIR dir;
-    FILINFO currentEntry;
-    FILINFO nextEntry;
+    FILINFO entry;
     FRESULT res = f_opendir(&dir, currentDirectory);
     if (res != FR_OK) {
         picostation::debug::print("f_opendir error: %s (%d)\n", FRESULT_str(res), res);
         return false;
     }
 
-    fileListing->clear();
+    fileListing.clear();
 
     uint16_t fileEntryCount = 0;
     uint16_t filesProcessed = 0;
     bool hasNext = false;
 
-    res = f_readdir(&dir, &currentEntry);
-    if (res == FR_OK && currentEntry.fname[0] != '\0') {
-        res = f_readdir(&dir, &nextEntry);
-        hasNext = (res == FR_OK && nextEntry.fname[0] != '\0');
-        while (true) {
-            if (!(currentEntry.fattrib & AM_HID)) {
-                if (filesProcessed >= offset) {
-                    if (fileListing->addString(currentEntry.fname, currentEntry.fattrib & AM_DIR ? 1 : 0) == false) {
-                        break;
-                    }
-                    fileEntryCount++;
-                }
-                filesProcessed++;
-                if (filesProcessed >= 4096)
-                {
-                    hasNext = 0;
+    res = f_readdir(&dir, &entry);
+    while (res == FR_OK && entry.fname[0] != '\0') {
+        if (!(entry.fattrib & AM_HID)) {
+            if (filesProcessed >= offset) {
+                if (fileListing.addString(entry.fname, entry.fattrib & AM_DIR ? 1 : 0) == false) {
+                    // This entry didn't fit, it starts the next page
+                    hasNext = true;
+                    break;
                 }
+                fileEntryCount++;
             }
-            if (hasNext == 0) {
+            filesProcessed++;
+            if (filesProcessed >= 4096)
+            {
                 break;
             }
-            currentEntry = nextEntry;
-            res = f_readdir(&dir, &nextEntry);
-            hasNext = (res == FR_OK && nextEntry.fname[0] != '\0');
         }
+        res = f_readdir(&dir, &entry);
     }
     if (offset == 0)
     {
         uint16_t totalCount = getDirectoryEntriesCount();
-        fileListing->addTerminator(hasNext ? 1 : 0, totalCount);
+        fileListing.addTerminator(hasNext ? 1 : 0, totalCount);
         picostation::debug::print("file count: %d\n", totalCount);
     }
     else
     {
-        fileListing->addTerminator(hasNext ? 1 : 0, 0xffff);
+        fileListing.addTerminator(hasNext ? 1 : 0, 0xffff);
     }
     
     f_closedir(&dir);
@@ -157,8 +151,7 @@ bool DirectoryListing::getDirectoryEntries(const uint32_t offset) {
 
 uint16_t DirectoryListing::getDirectoryEntriesCount() {
     DIR dir;
-    FILINFO currentEntry;
-    FILINFO nextEntry;
+    FILINFO entry;
     FRESULT res = f_opendir(&dir, currentDirectory);
     if (res != FR_OK) {
         picostation::debug::print("f_opendir error: %s (%d)\n", FRESULT_str(res), res);
@@ -166,34 +159,24 @@ uint16_t DirectoryListing::getDirectoryEntriesCount() {
     }
 
     uint16_t fileEntryCount = 0;
-    bool hasNext = false;
 
-    res = f_readdir(&dir, &currentEntry);
-    if (res == FR_OK && currentEntry.fname[0] != '\0') {
-        res = f_readdir(&dir, &nextEntry);
-        hasNext = (res == FR_OK && nextEntry.fname[0] != '\0');
-        while (true) {
-            if (!(currentEntry.fattrib & AM_HID)) {
-                fileEntryCount++;
-                if (fileEntryCount >= 4096)
-                {
-                    hasNext = 0;
-                }
-            }
-            if (hasNext == 0) {
+    res = f_readdir(&dir, &entry);
+    while (res == FR_OK && entry.fname[0] != '\0') {
+        if (!(entry.fattrib & AM_HID)) {
+            fileEntryCount++;
+            if (fileEntryCount >= 4096)
+            {
                 break;
             }
-            currentEntry = nextEntry;
-            res = f_readdir(&dir, &nextEntry);
-            hasNext = (res == FR_OK && nextEntry.fname[0] != '\0');
         }
+        res = f_readdir(&dir, &entry);
     }
     f_closedir(&dir);
     return fileEntryCount;
 }
 
 uint8_t* DirectoryListing::getFileListingData() {
-    return fileListing->getData();
+    return fileListing.getData();
 }
 
 // Private
@@ -217,8 +200,7 @@ bool DirectoryListing::getDirectoryEntry(const uint32_t index, char* filePath) {
     }
 
     DIR dir;
-    FILINFO currentEntry;
-    FILINFO nextEntry;
+    FILINFO entry;
     FRESULT res = f_opendir(&dir, currentDirectory);
     if (res != FR_OK) {
         picostation::debug::print("f_opendir error: %s (%d)\n", FRESULT_str(res), res);
@@ -227,26 +209,17 @@ bool DirectoryListing::getDirectoryEntry(const uint32_t index, char* filePath) {
 
     uint32_t filesProcessed = 0;
 
-    res = f_readdir(&dir, &currentEntry);
-    if (res == FR_OK && currentEntry.fname[0] != '\0') {
-        res = f_readdir(&dir, &nextEntry);
-        bool hasNext = (res == FR_OK && nextEntry.fname[0] != '\0');
-        while (true) {
-            if (!(currentEntry.fattrib & AM_HID)) {
-                if (filesProcessed == index) {
-                    strncpy(filePath, currentEntry.fname, c_maxFilePathLength);
-                    f_closedir(&dir);
-                    return true;
-                }
-                filesProcessed++;
-            }
-            if (!hasNext) {
-                break;
+    res = f_readdir(&dir, &entry);
+    while (res == FR_OK && entry.fname[0] != '\0') {
+        if (!(entry.fattrib & AM_HID)) {
+            if (filesProcessed == index) {
+                strncpy(filePath, entry.fname, c_maxFilePathLength);
+                f_closedir(&dir);
+                return true;
             }
-            currentEntry = nextEntry;
-            res = f_readdir(&dir, &nextEntry);
-            hasNext = (res == FR_OK && nextEntry.fname[0] != '\0');
+            filesProcessed++;
         }
+        res = f_readdir(&dir, &entry);
     }
 
     f_closedir(&dir);
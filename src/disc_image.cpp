@@ -7,15 +7,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+
+#include "cue_cache.h"
 #include "f_util.h"
 #include "ff.h"
+#include "global.h"
+#include "hardware/timer.h"
 //#include "loaderImage.h"
 #include "logging.h"
+#include "mount_arena.h"
 #include "picostation.h"
 #include "subq.h"
 #include "third_party/iec-60908b/edcecc.h"
 #include "third_party/posix_file.h"
 #include "values.h"
+#include "wave_file.h"
 
 #if DEBUG_CUE
 #define DEBUG_PRINT(...) printf(__VA_ARGS__)
@@ -23,10 +30,6 @@
 #define DEBUG_PRINT(...) while (0)
 #endif
 
-extern const uint8_t  loaderImage[];
-extern const uint32_t loaderImageSize;
-
-
 struct MSF {
     int mm;
     int ss;
@@ -71,6 +74,14 @@ static constexpr uint16_t crc16_lut[256] = {
 
 static uint8_t s_userData[c_cdSamplesBytes] = {0};
 
+// Mode 2 form 2 sector with 2324 bytes of user data (Green book), address left blank
+static constexpr uint8_t c_sectorTemplate[24] = {
+    0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00,  // Sync - 12 bytes
+    0x00, 0x00, 0x00, 0x02,                                                  // Header - 4 bytes, Mode = 2
+    0x00, 0x00, Submode::Form, 0x00,                                         // Sub-Header - 8 bytes
+    0x00, 0x00, Submode::Form, 0x00,
+};
+
 static MSF sectorToMSF(const int sector) {
     MSF msf;
     msf.mm = abs(sector / 75 / 60);
@@ -102,43 +113,21 @@ static void getParentPath(const TCHAR *path, TCHAR *parentPath) {
 }
 
 void picostation::DiscImage::buildSector(const int sector, uint8_t *buffer, uint8_t *userData) {
-    // Clear the buffer to avoid garbage data
-    memset(buffer, 0, c_cdSamplesBytes);
-
-    // Sync - 12 bytes
-    buffer[0] = 0;
-    memset(buffer + 1, 0xFF, 10);
-    buffer[11] = 0;
+    // Sync, header and subheader only differ by the address, every byte after them is overwritten below
+    memcpy(buffer, c_sectorTemplate, sizeof(c_sectorTemplate));
 
-    // Header - 4 bytes
     const MSF msf = sectorToMSF(sector);
     buffer[12] = toBCD(msf.mm);  // M Minutes
     buffer[13] = toBCD(msf.ss);  // S Seconds
     buffer[14] = toBCD(msf.ff);  // F Frame/Sectors
-    buffer[15] = 0x02;           // Mode = 2
-
-    // Sub-Header - 8 bytes (Green book)
-    // buffer[16] = 0;                // File number
-    // buffer[17] = 0;                // Channel number
-    buffer[18] = (Submode::Form);  // Submode = Form 2, 2324 bytes of user data
-    // buffer[19] = 0;                // Coding information
-    // buffer[20] = 0;                // File number
-    // buffer[21] = 0;                // Channel number
-    // buffer[22] = 0;                // Submode
-    // buffer[23] = 0;                // Coding information
 
     memcpy(buffer + 24, userData, 2324);
 
-    // EDC/ECC - 4 bytes
-    // compute_edcecc(buffer);
-    // Don't need to compute EDC/ECC for now, just leave it as 0
-    // buffer[2348] = 0;
-    // buffer[2349] = 0;
-    // buffer[2350] = 0;
-    // buffer[2351] = 0;
+    // EDC - 4 bytes, form 2 has no ECC
+    compute_mode2_edcecc(buffer, 2);
 }
 
-picostation::SubQ::Data picostation::DiscImage::generateSubQ(const int sector) {
+picostation::SubQ::Data __time_critical_func(picostation::DiscImage::generateSubQ)(const int sector) {
     SubQ::Data subqdata;
 
     int sector_track;
@@ -248,16 +237,35 @@ picostation::SubQ::Data picostation::DiscImage::generateSubQ(const int sector) {
         subqdata.aframe = toBCD(msf_abs.ff);
     }
 
+    // Recorded Q goes out as it is, unless a meter display takes over the CRC bytes
+    if (sector >= c_leadIn && g_audioCtrlMode != audioControlModes::LEVELMETER &&
+        g_audioCtrlMode != audioControlModes::PEAKMETER &&
+        ((m_format == ImageFormat::Ccd && m_ccdImage.getSubQ(sector - c_leadIn - c_preGap, subqdata)) ||
+         (m_format == ImageFormat::Encoded && m_encodedImage.getSubQ(sector - c_leadIn - c_preGap, subqdata)))) {
+        return subqdata;
+    }
+
+    // LibCrypt sectors get the frame dumped from the original disc
     subqdata.crc = 0;
+    const SubQPatches::Patched patched =
+        (sector >= c_leadIn) ? m_subQPatches.apply(sector - c_leadIn - c_preGap, subqdata) : SubQPatches::Patched::None;
+
     switch (g_audioCtrlMode) {
         case audioControlModes::NORMAL:
         case audioControlModes::ALTNORMAL:
         default:
+            if (patched == SubQPatches::Patched::WithCrc) {
+                break;
+            }
             for (size_t i = 0; i < 10; i++) {
                 subqdata.crc = (subqdata.crc << 8) ^ crc16_lut[((subqdata.crc >> 8) ^ subqdata.raw[i]) & 0xFF];
             }
             subqdata.crc = (subqdata.crc << 8) | (subqdata.crc >> 8);  // swap endianness
             // There's probably a better way to do this in the calculation, but I'm sleepy
+            if (patched == SubQPatches::Patched::WithoutCrc) {
+                // .sbi dumps leave the CRC out, a protected sector's never matches its frame
+                subqdata.crc = ~subqdata.crc;
+            }
             break;
 
         case audioControlModes::LEVELMETER:
@@ -274,8 +282,12 @@ picostation::SubQ::Data picostation::DiscImage::generateSubQ(const int sector) {
     return subqdata;
 }
 
+// Taken from the mount arena rather than core1's stack, like the path fileopen builds in it
 struct Context {
     TCHAR parentPath[128];
+    picostation::CueFileTable *files;
+    struct CueFile *openedFiles[MAXTRACK];
+    TCHAR fullpath[256];
 };
 
 static void close_cb(struct CueParser *parser, struct CueScheduler *scheduler, const char *error) {
@@ -294,34 +306,98 @@ static void parser_cb(struct CueParser *parser, struct CueScheduler *scheduler,
     }
 }
 
-static struct CueFile *fileopen(struct CueFile *file, struct CueScheduler *scheduler, const char *filename) {
-    Context *context = reinterpret_cast<Context *>(scheduler->opaque);
-    TCHAR fullpath[256];
-    strcpy(fullpath, context->parentPath);
+static void getFilePath(const TCHAR *parentPath, const char *filename, TCHAR *fullpath) {
+    strcpy(fullpath, parentPath);
     strcat(fullpath, "/");
     strcat(fullpath, filename);
-    return create_posix_file(file, fullpath, "r");
 }
 
-FRESULT picostation::DiscImage::load(const TCHAR *targetCue) {
+static const TCHAR *getFileName(const TCHAR *path, const TCHAR *parentPath) {
+    const TCHAR *fileName = path + strlen(parentPath);
+    while (*fileName == '/' || *fileName == '\\') {
+        fileName++;
+    }
+    return fileName;
+}
+
+static struct CueFile *fileopen(struct CueFile *file, struct CueScheduler *scheduler, const char *filename) {
+    Context *context = reinterpret_cast<Context *>(scheduler->opaque);
+    TCHAR *fullpath = context->fullpath;
+    getFilePath(context->parentPath, filename, fullpath);
+    // Track files only need their size while parsing, FilePool opens them on demand afterwards
+    struct CueFile *opened = nullptr;
+    uint32_t dataOffset = 0;
+    uint32_t dataSize;
+    const picostation::WaveFile::Header waveHeader =
+        picostation::WaveFile::isWavePath(fullpath) ? picostation::WaveFile::readHeader(fullpath, dataOffset, dataSize)
+                                                    : picostation::WaveFile::Header::Raw;
+    if (picostation::FlacFile::isFlacPath(fullpath)) {
+        // Sized as the PCM it decodes to
+        uint64_t decodedSize;
+        uint32_t maxBlockSize;
+        if (picostation::FlacFile::prepare(fullpath, decodedSize, maxBlockSize)) {
+            opened = create_posix_sized_file(file, decodedSize);
+        }
+    } else if (waveHeader == picostation::WaveFile::Header::Pcm) {
+        // Only the samples count, reads start past the header
+        opened = create_posix_sized_file(file, dataSize);
+    } else if (waveHeader == picostation::WaveFile::Header::Unsupported) {
+        // Fail the parse rather than play the file as noise
+        DEBUG_PRINT("Unsupported WAVE format in %s\n", fullpath);
+        return nullptr;
+    } else {
+        opened = create_posix_stat_file(file, fullpath);
+    }
+    const char *storedName = filename;
+    if (!opened && strlen(fullpath) + sizeof(picostation::EcmFile::c_extension) <= sizeof(context->fullpath)) {
+        // The cue still names the bin from before it was shrunk with ECM
+        uint64_t decodedSize;
+        strcat(fullpath, picostation::EcmFile::c_extension);
+        if (picostation::EcmFile::prepare(fullpath, decodedSize)) {
+            opened = create_posix_sized_file(file, decodedSize);
+            storedName = fullpath + strlen(context->parentPath) + 1;  // The cue's name with the extension added
+        }
+    }
+    if (opened) {
+        const int fileIndex = context->files->addFile(storedName);
+        if (fileIndex >= 0) {
+            context->openedFiles[fileIndex] = opened;
+            context->files->dataOffsets[fileIndex] = dataOffset;
+        }
+    }
+    return opened;
+}
+
+FRESULT picostation::DiscImage::load(const TCHAR *targetImage) {
     // To-do: Need alternate code paths here for parsing cue from alternate sources.
-    struct CueScheduler scheduler;
-    Scheduler_construct(&scheduler);
-    Context context;
-    getParentPath(targetCue, context.parentPath);
-    scheduler.opaque = &context;
+    unload();
 
-    struct CueFile cue;
-    struct CueParser parser;
+    TCHAR parentPath[128];
+    getParentPath(targetImage, parentPath);
 
-    if (!create_posix_file(&cue, targetCue, "r")) {
-        DEBUG_PRINT("create_posix_file failed for: %s.\n", targetCue);
+    FRESULT fr;
+    if (ChdImage::isChdPath(targetImage)) {
+        m_format = ImageFormat::Chd;
+        fr = loadChd(targetImage, parentPath);
+    } else if (PbpImage::isPbpPath(targetImage)) {
+        m_format = ImageFormat::Pbp;
+        fr = loadPbp(targetImage, parentPath);
+    } else if (CcdImage::isCcdPath(targetImage)) {
+        m_format = ImageFormat::Ccd;
+        fr = loadCcd(targetImage, parentPath);
+    } else if (EncodedImage::isEncodedPath(targetImage)) {
+        m_format = ImageFormat::Encoded;
+        fr = loadEncoded(targetImage, parentPath);
+    } else if (IsoImage::isIsoPath(targetImage)) {
+        m_format = ImageFormat::Iso;
+        fr = loadIso(targetImage, parentPath);
+    } else {
+        m_format = ImageFormat::Cue;
+        fr = loadCue(targetImage, parentPath);
+    }
+    if (FR_OK != fr) {
+        return fr;
     }
-    cue.cfilename = targetCue;
-    CueParser_construct(&parser, &m_cueDisc);
-    CueParser_parse(&parser, &cue, &scheduler, fileopen, parser_cb);
-    Scheduler_run(&scheduler);
-    CueParser_close(&parser, &scheduler, close_cb);
 
     DEBUG_PRINT("Disc track count: %d\n", m_cueDisc.trackCount);
 
@@ -341,9 +417,252 @@ FRESULT picostation::DiscImage::load(const TCHAR *targetCue) {
                     m_cueDisc.tracks[i].indices[1] - m_cueDisc.tracks[i].indices[0]);
     }
 
+    if (m_format == ImageFormat::Cue || m_format == ImageFormat::Iso) {
+        m_filePool.reset(parentPath, &m_fileTable);
+        m_filePool.buildLinkMaps();
+
+        for (int i = 0; i < m_fileTable.fileCount; i++) {
+            if (!EcmFile::isEcmPath(m_fileTable.getFileName(i))) {
+                continue;
+            }
+            TCHAR ecmPath[256];
+            getFilePath(parentPath, m_fileTable.getFileName(i), ecmPath);
+            if (m_ecmFileIndex >= 0 || !m_ecmFile.open(ecmPath)) {
+                // Only the data track is worth shrinking with ECM, one file per disc is all that's supported. Any
+                // other would be read as a plain bin and send its compressed bytes as sector data.
+                DEBUG_PRINT("Can't read %s\n", ecmPath);
+                unload();
+                return FR_INVALID_OBJECT;
+            }
+            m_ecmFileIndex = i;
+        }
+
+        // One decoder serves every FLAC track, sized for the largest frames among them
+        uint32_t flacBlockSize = 0;
+        for (int i = 0; i < m_fileTable.fileCount; i++) {
+            TCHAR flacPath[256];
+            getFilePath(parentPath, m_fileTable.getFileName(i), flacPath);
+            uint64_t decodedSize;
+            uint32_t maxBlockSize;
+            if (FlacFile::isFlacPath(flacPath) && FlacFile::prepare(flacPath, decodedSize, maxBlockSize)) {
+                flacBlockSize = std::max(flacBlockSize, maxBlockSize);
+            }
+        }
+        if (flacBlockSize && !m_flacFile.open(flacBlockSize)) {
+            DEBUG_PRINT("No room for the FLAC decoder\n");
+        }
+    }
+    if (m_format != ImageFormat::Ccd) {
+        m_subQPatches.load(targetImage);
+    }
+    TCHAR ppfPath[c_maxFilePathLength + 1];
+    FILINFO ppfInfo;
+    // Encoded images never go through a sector buffer a patch could be applied to, the tool takes patched bins
+    if (m_format != ImageFormat::Encoded && CcdImage::getSiblingPath(targetImage, ".ppf", ppfPath) &&
+        f_stat(ppfPath, &ppfInfo) == FR_OK) {
+        // The patch goes through the file pool like the image's own files
+        const int ppfIndex = m_fileTable.addFile(getFileName(ppfPath, parentPath));
+        if (ppfIndex < 0 || !m_ppfPatch.load(m_filePool, ppfIndex)) {
+            DEBUG_PRINT("Can't use %s\n", ppfPath);
+        }
+    }
+    if (m_format != ImageFormat::Chd && m_format != ImageFormat::Encoded) {
+        // The fast-seek maps are all built by now, whatever the arena has left becomes sector cache
+        m_sectorCache.init(g_mountArena.getFree());
+        DEBUG_PRINT("Sector cache: %u lines\n", m_sectorCache.getLineCount());
+    }
+    g_mountArena.printStats();
+    DEBUG_PRINT("Core1 stack: %u bytes used at most\n", getCore1StackUsed());
+
+    return FR_OK;
+}
+
+FRESULT picostation::DiscImage::loadCue(const TCHAR *targetCue, const TCHAR *parentPath) {
+    FILINFO cueInfo;
+    FRESULT fr = f_stat(targetCue, &cueInfo);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_stat(%s) error: %s (%d)\n", targetCue, FRESULT_str(fr), fr);
+        return fr;
+    }
+
+    if (CueCache::load(targetCue, parentPath, cueInfo, m_cueDisc, m_fileTable)) {
+        DEBUG_PRINT("Using cached cue sheet for %s\n", targetCue);
+        return FR_OK;
+    }
+
+    Context *context = g_mountArena.allocate<Context>();
+    if (!context) {
+        return FR_NOT_ENOUGH_CORE;
+    }
+    strcpy(context->parentPath, parentPath);
+    context->files = &m_fileTable;
+
+    struct CueScheduler scheduler;
+    Scheduler_construct(&scheduler);
+    scheduler.opaque = context;
+    m_fileTable.clear();
+
+    struct CueFile cue;
+    struct CueParser parser;
+
+    if (!create_posix_file(&cue, targetCue, "r", &fr)) {
+        DEBUG_PRINT("create_posix_file(%s) error: %s (%d)\n", targetCue, FRESULT_str(fr), fr);
+        return fr;
+    }
+    cue.cfilename = targetCue;
+    const unsigned int arenaFailures = g_mountArena.getFailures();
+    CueParser_construct(&parser, &m_cueDisc);
+    CueParser_parse(&parser, &cue, &scheduler, fileopen, parser_cb);
+    Scheduler_run(&scheduler);
+    if (scheduler.error || g_mountArena.getFailures() != arenaFailures) {
+        // The arena ran out mid parse, either a callback was lost or the parser ended early, the disc is incomplete
+        DEBUG_PRINT("Cue parse of %s ran out of memory: %s\n", targetCue, scheduler.error ? scheduler.error : "");
+        f_close(static_cast<FIL *>(cue.opaque));
+        return FR_NOT_ENOUGH_CORE;
+    }
+    CueParser_close(&parser, &scheduler, close_cb);
+    if (cue.opaque) {
+        f_close(static_cast<FIL *>(cue.opaque));
+    }
+
+    // Map each track back to the file table so the parse can be replayed from the cache next time
+    bool allTracksMapped = m_cueDisc.trackCount > 0;
+    for (int i = 1; i <= m_cueDisc.trackCount; i++) {
+        for (int j = 0; j < m_fileTable.fileCount; j++) {
+            if (context->openedFiles[j] == m_cueDisc.tracks[i].file) {
+                m_fileTable.trackFile[i] = j;
+                break;
+            }
+        }
+        allTracksMapped = allTracksMapped && m_fileTable.trackFile[i] != CueFileTable::c_noFile;
+    }
+
+    if (allTracksMapped) {
+        CueCache::save(targetCue, parentPath, cueInfo, m_cueDisc, m_fileTable);
+    }
+    return FR_OK;
+}
+
+FRESULT picostation::DiscImage::loadChd(const TCHAR *targetChd, const TCHAR *parentPath) {
+    // The image is the only file, every track reads from it through the file pool
+    if (m_fileTable.addFile(getFileName(targetChd, parentPath)) != 0) {
+        return FR_INVALID_NAME;
+    }
+    m_filePool.reset(parentPath, &m_fileTable);
+
+    const FRESULT fr = m_chdImage.open(m_filePool, m_cueDisc);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("CHD open(%s) error: %s (%d)\n", targetChd, FRESULT_str(fr), fr);
+        unload();
+        return fr;
+    }
+    for (int i = 1; i <= m_cueDisc.trackCount; i++) {
+        m_fileTable.trackFile[i] = 0;
+    }
+    return FR_OK;
+}
+
+FRESULT picostation::DiscImage::loadPbp(const TCHAR *targetPbp, const TCHAR *parentPath) {
+    if (m_fileTable.addFile(getFileName(targetPbp, parentPath)) != 0) {
+        return FR_INVALID_NAME;
+    }
+    m_filePool.reset(parentPath, &m_fileTable);
+
+    const FRESULT fr = m_pbpImage.open(m_filePool, m_cueDisc);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("PBP open(%s) error: %s (%d)\n", targetPbp, FRESULT_str(fr), fr);
+        unload();
+        return fr;
+    }
+    for (int i = 1; i <= m_cueDisc.trackCount; i++) {
+        m_fileTable.trackFile[i] = 0;
+    }
+    return FR_OK;
+}
+
+FRESULT picostation::DiscImage::loadCcd(const TCHAR *targetCcd, const TCHAR *parentPath) {
+    FRESULT fr = m_ccdImage.open(targetCcd, m_cueDisc);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("CCD open(%s) error: %s (%d)\n", targetCcd, FRESULT_str(fr), fr);
+        unload();
+        return fr;
+    }
+
+    // The main channel and subchannel dumps are named after the .ccd, and are files 0 and 1
+    TCHAR path[c_maxFilePathLength + 1];
+    CcdImage::getSiblingPath(targetCcd, ".img", path);
+    bool added = m_fileTable.addFile(getFileName(path, parentPath)) == 0;
+    if (added && m_ccdImage.hasSubchannel()) {
+        CcdImage::getSiblingPath(targetCcd, ".sub", path);
+        added = m_fileTable.addFile(getFileName(path, parentPath)) == CcdImage::c_subFileIndex;
+    }
+    if (!added) {
+        unload();
+        return FR_INVALID_NAME;
+    }
+    m_filePool.reset(parentPath, &m_fileTable);
+    for (int i = 1; i <= m_cueDisc.trackCount; i++) {
+        m_fileTable.trackFile[i] = 0;
+    }
     return FR_OK;
 }
 
+FRESULT picostation::DiscImage::loadEncoded(const TCHAR *targetEncoded, const TCHAR *parentPath) {
+    if (m_fileTable.addFile(getFileName(targetEncoded, parentPath)) != 0) {
+        return FR_INVALID_NAME;
+    }
+    m_filePool.reset(parentPath, &m_fileTable);
+
+    const FRESULT fr = m_encodedImage.open(m_filePool, m_cueDisc);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("Encoded open(%s) error: %s (%d)\n", targetEncoded, FRESULT_str(fr), fr);
+        unload();
+        return fr;
+    }
+    for (int i = 1; i <= m_cueDisc.trackCount; i++) {
+        m_fileTable.trackFile[i] = 0;
+    }
+    return FR_OK;
+}
+
+FRESULT picostation::DiscImage::loadIso(const TCHAR *targetIso, const TCHAR *parentPath) {
+    if (m_fileTable.addFile(getFileName(targetIso, parentPath)) != 0) {
+        return FR_INVALID_NAME;
+    }
+
+    const FRESULT fr = m_isoImage.open(targetIso, m_cueDisc);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("ISO open(%s) error: %s (%d)\n", targetIso, FRESULT_str(fr), fr);
+        unload();
+        return fr;
+    }
+    m_fileTable.trackFile[1] = 0;
+    return FR_OK;
+}
+
+void picostation::DiscImage::unload() {
+    // Close whatever the previous image left open, then release all of its mount state in one go
+    m_chdImage.close();
+    m_pbpImage.close();
+    m_ccdImage.close();
+    m_encodedImage.close();
+    m_subQPatches.clear();
+    m_ppfPatch.clear();
+    m_isoImage.close();
+    m_ecmFile.close();
+    m_ecmFileIndex = -1;
+    m_flacFile.close();
+    m_filePool.closeAll();
+    for (int i = 1; i <= m_cueDisc.trackCount; i++) {
+        m_cueDisc.tracks[i].file = nullptr;
+    }
+    m_cueDisc.trackCount = 0;
+    m_fileTable.clear();
+    g_mountArena.reset();
+    m_sectorCache.init(0);
+    m_prefetchFailedSector = -1;
+}
+
 void picostation::DiscImage::makeDummyCue() {
     // Create a dummy cue disc with a single data track, as well as lead-in and lead-out tracks.
 
@@ -382,13 +701,16 @@ void picostation::DiscImage::readSector(void *buffer, const int sector, DataLoca
     const int adjustedSector = sector - c_preGap;
     if (adjustedSector >= 0 && adjustedSector < c_licenseSectors) {
         // License sectors, read from our embedded image
-        memcpy(buffer, &loaderImage[adjustedSector * c_cdSamplesBytes], c_cdSamplesBytes);
+        if (!m_menuImage.readSector(adjustedSector, static_cast<uint8_t *>(buffer))) {
+            buildSector(sector, static_cast<uint8_t *>(buffer), s_userData);
+        }
         return;
     }
 
     switch (location) {
         case DataLocation::SDCard:
             readSectorSD(buffer, sector);
+            m_ppfPatch.apply(adjustedSector, static_cast<uint8_t *>(buffer));
             break;
         case DataLocation::RAM:
             readSectorRAM(buffer, sector);
@@ -406,57 +728,211 @@ void picostation::DiscImage::readSector(void *buffer, const int sector, DataLoca
     }
 }
 
+// Sectors of an encoded image go straight into the PIO buffer, anything else is read and encoded by the caller
+bool picostation::DiscImage::readEncodedSector(uint32_t *pioWords, const int sector, DataLocation location) {
+    const int adjustedSector = sector - c_preGap;
+    if (location != DataLocation::SDCard || m_format != ImageFormat::Encoded || adjustedSector < c_licenseSectors) {
+        return false;
+    }
+    return m_encodedImage.readSector(adjustedSector, pioWords);
+}
+
 void picostation::DiscImage::readSectorRAM(void *buffer, const int sector) {
     const int adjustedSector = sector - c_preGap;
-    size_t targetOffset = adjustedSector * c_cdSamplesBytes;
-    if (targetOffset >= 0 && targetOffset <= loaderImageSize - c_cdSamplesBytes) {
-        memcpy(buffer, &loaderImage[targetOffset], c_cdSamplesBytes);
-    } else {
+    if (!m_menuImage.readSector(adjustedSector, static_cast<uint8_t *>(buffer))) {
         buildSector(sector, static_cast<uint8_t *>(buffer), s_userData);
     }
 }
 
 void picostation::DiscImage::readSectorSD(void *buffer, const int sector) {
-    FRESULT fr;
+    const int adjustedSector = sector - c_preGap;
     UINT br = 0;
 
-    const int adjustedSector = sector - c_preGap;
+    if (m_format == ImageFormat::Encoded) {
+        // Only left with what the image doesn't store, or a sector that couldn't be read
+        buildSector(sector, static_cast<uint8_t *>(buffer), s_userData);
+        return;
+    }
 
-    for (size_t i = 1; i <= m_cueDisc.trackCount + 1; i++) {
-        if (adjustedSector < m_cueDisc.tracks[i + 1].indices[0]) {
-            if (m_cueDisc.tracks[i].file->opaque) {
-                const int64_t seekBytes = (adjustedSector - m_cueDisc.tracks[i].fileOffset) * c_cdSamplesBytes;
-                if (seekBytes >= 0) {
-                    fr = f_lseek((FIL *)m_cueDisc.tracks[i].file->opaque, seekBytes);
-                    if (FR_OK != fr) {
-                        f_rewind((FIL *)m_cueDisc.tracks[i].file->opaque);
-                        // panic("f_lseek(%s) error: (%d)\n", FRESULT_str(fr), fr);
-                        DEBUG_PRINT("f_lseek(%s) error: (%d)\n", FRESULT_str(fr), fr);
-                    }
-                }
+    if (m_format == ImageFormat::Chd) {
+        const int track = findTrack(adjustedSector);
+        if (track <= 0 || !m_chdImage.readSector(track, adjustedSector, static_cast<uint8_t *>(buffer))) {
+            buildSector(sector, static_cast<uint8_t *>(buffer), s_userData);
+        }
+        return;
+    }
 
-                fr = f_read((FIL *)m_cueDisc.tracks[i].file->opaque, buffer, c_cdSamplesBytes, &br);
-                if (FR_OK != fr) {
-                    // panic("f_read(%s) error: (%d)\n", FRESULT_str(fr), fr);
-                    DEBUG_PRINT("f_read(%s) error: (%d)\n", FRESULT_str(fr), fr);
-                } else if (br != c_cdSamplesBytes) {
-                    // DEBUG_PRINT("Logical track: %d, sector: %d, read: %d\n", i, sector, br);
-                    // DEBUG_PRINT("Seek bytes: %llu\n", seekBytes);
-                    // DEBUG_PRINT("f_read(%s) error: (%d) read: %d\n", FRESULT_str(fr), fr, br);
-                }
-                break;
-            }
+    const uint8_t *cached = m_sectorCache.find(adjustedSector);
+    if (cached) {
+        memcpy(buffer, cached, c_cdSamplesBytes);
+        if (m_format == ImageFormat::Ccd && m_ccdImage.needsSubchannel(adjustedSector)) {
+            // The line outlived its Q in the ring
+            m_ccdImage.readSubchannel(m_filePool, adjustedSector, 1);
+        }
+        return;
+    }
+
+    const int track = findTrack(adjustedSector);
+    if (m_format == ImageFormat::Pbp) {
+        if (track > 0 && m_pbpImage.readSector(adjustedSector, static_cast<uint8_t *>(buffer))) {
+            br = c_cdSamplesBytes;
         }
+    } else if (track > 0) {
+        br = readTrackSectors(track, adjustedSector, static_cast<uint8_t *>(buffer));
     }
 
     if (br < c_cdSamplesBytes) {
         buildSector(sector, static_cast<uint8_t *>(buffer), s_userData);
         br = c_cdSamplesBytes;
     }
+}
+
+// Grows at once to a slower access, shrinks slowly after one card hiccup
+void picostation::DiscImage::updateTimeEstimate(uint32_t &estimate, const uint32_t measured) {
+    if (measured > estimate) {
+        estimate = measured;
+    } else {
+        estimate -= (estimate - measured) / 8;
+    }
+}
+
+// Called by core1 while the DMA is still sending, does at most one card access per call and only one that is
+// expected to finish within budgetUs
+void picostation::DiscImage::prefetch(const int sector, const uint32_t budgetUs) {
+    const int adjustedSector = sector - c_preGap;
+    const int track = findTrack(adjustedSector);
+    if (track <= 0) {
+        return;
+    }
+
+    if (m_format == ImageFormat::Chd) {
+        // Decompression is the slow part here, the hunk buffers take the place of the sector cache
+        m_chdImage.prefetch(track, adjustedSector);
+        return;
+    } else if (m_format == ImageFormat::Pbp) {
+        // Same for PBP blocks, the sector cache only takes the tail of a block so the next one can start. A step
+        // reads a sector's worth of the block at most, and only starts if that has recently fit the time left.
+        if (budgetUs >= m_blockStepTime) {
+            const uint32_t startTime = time_us_32();
+            if (m_pbpImage.prefetch(adjustedSector, m_sectorCache)) {
+                updateTimeEstimate(m_blockStepTime, time_us_32() - startTime);
+            }
+        }
+        return;
+    } else if (m_format == ImageFormat::Encoded) {
+        // Sectors are read on demand, there is nothing to decode ahead, only the Q frames to stay in front of
+        m_encodedImage.prefetch(adjustedSector);
+        return;
+    }
+
+    // Keep the next cache line loaded, this runs straight into the following track and its file
+    for (int ahead = adjustedSector + 1; ahead <= adjustedSector + c_prefetchSectors; ahead++) {
+        if (ahead == m_prefetchFailedSector || m_sectorCache.contains(ahead)) {
+            continue;
+        }
+        const int aheadTrack = findTrack(ahead);
+        if (aheadTrack <= 0 || budgetUs < m_lineReadTime) {
+            return;
+        }
+        const uint32_t startTime = time_us_32();
+        if (readTrackSectors(aheadTrack, ahead, nullptr) == 0) {
+            // Pregap not in the file or a read error, don't retry it on every pass
+            m_prefetchFailedSector = ahead;
+        } else {
+            updateTimeEstimate(m_lineReadTime, time_us_32() - startTime);
+        }
+        return;
+    }
+
+    // Open the next track's file well before the boundary, so the transition doesn't stall on f_open. The
+    // fast-seek map was built at mount, a pool hit only refreshes the handle's LRU position.
+    if (track < m_cueDisc.trackCount && budgetUs >= m_fileOpenTime) {
+        const int sectorsToBoundary = (int)m_cueDisc.tracks[track + 1].indices[0] - adjustedSector;
+        const uint8_t nextFile = m_fileTable.trackFile[track + 1];
+        if (sectorsToBoundary <= c_prefetchOpenSectors && nextFile != m_fileTable.trackFile[track]) {
+            const uint32_t startTime = time_us_32();
+            m_filePool.acquire(nextFile);
+            updateTimeEstimate(m_fileOpenTime, time_us_32() - startTime);
+        }
+    }
+}
 
-    /*if (br < c_cdSamplesBytes) {
-        memset(static_cast<uint8_t *>(buffer) + br, 0, c_cdSamplesBytes - br);
-        DEBUG_PRINT("Bytes read less than sampleBytes by %d\n", c_cdSamplesBytes - br);
-    }*/
-    // DEBUG_PRINT("Sector not found: %d\n", sector);
-}
\ No newline at end of file
+int picostation::DiscImage::findTrack(const int adjustedSector) const {
+    for (int i = 1; i <= m_cueDisc.trackCount; i++) {
+        if (adjustedSector < (int)m_cueDisc.tracks[i + 1].indices[0]) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+UINT picostation::DiscImage::readTrackSectors(const int track, const int adjustedSector, uint8_t *buffer) {
+    const CueTrack &cueTrack = m_cueDisc.tracks[track];
+    const int fileSector = adjustedSector - (int)cueTrack.fileOffset;
+    if (fileSector < 0) {
+        // Pregap that isn't stored in the file
+        return 0;
+    }
+
+    const int fileIndex = m_fileTable.trackFile[track];
+    FIL *fp = m_filePool.acquire(fileIndex);
+    if (!fp) {
+        return 0;
+    }
+
+    // Read ahead a whole cache line in one transfer, without running into the next track
+    const int sectorsLeftInTrack = (int)m_cueDisc.tracks[track + 1].indices[0] - adjustedSector;
+    const int sectorCount = std::min<int>(SectorCache::c_sectorsPerLine, sectorsLeftInTrack);
+    // A lone sector is only worth a line when it is being read ahead
+    uint8_t *line = (sectorCount > 1 || !buffer) ? m_sectorCache.beginFill(adjustedSector) : nullptr;
+
+    if (line) {
+        const int sectorsRead = readFileSectors(fileIndex, fp, fileSector, line, sectorCount);
+        m_sectorCache.endFill(line, sectorsRead);
+        if (sectorsRead == 0) {
+            return 0;
+        }
+        if (m_format == ImageFormat::Ccd) {
+            // Subchannel follows the main channel in lockstep, read ahead included
+            m_ccdImage.readSubchannel(m_filePool, fileSector, sectorsRead);
+        }
+        if (buffer) {
+            memcpy(buffer, line, c_cdSamplesBytes);
+        }
+        return c_cdSamplesBytes;
+    } else if (buffer) {
+        const int sectorsRead = readFileSectors(fileIndex, fp, fileSector, buffer, 1);
+        if (m_format == ImageFormat::Ccd) {
+            m_ccdImage.readSubchannel(m_filePool, fileSector, sectorsRead);
+        }
+        return sectorsRead * c_cdSamplesBytes;
+    }
+
+    // Nothing to read ahead into
+    return 0;
+}
+
+int picostation::DiscImage::readFileSectors(const int fileIndex, FIL *fp, const int fileSector, uint8_t *buffer,
+                                            const int sectorCount) {
+    if (m_format == ImageFormat::Iso) {
+        return m_isoImage.read(fp, fileSector, buffer, sectorCount);
+    } else if (fileIndex == m_ecmFileIndex) {
+        return m_ecmFile.read(fp, fileSector, buffer, sectorCount);
+    } else if (m_fileTable.isFlacFile(fileIndex)) {
+        return m_flacFile.read(fp, fileIndex, fileSector, buffer, sectorCount);
+    }
+
+    FRESULT fr = f_lseek(fp, m_fileTable.dataOffsets[fileIndex] + (FSIZE_t)fileSector * c_cdSamplesBytes);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_lseek(%s) error: (%d)\n", FRESULT_str(fr), fr);
+        return 0;
+    }
+
+    UINT br = 0;
+    fr = f_read(fp, buffer, sectorCount * c_cdSamplesBytes, &br);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_read(%s) error: (%d)\n", FRESULT_str(fr), fr);
+        return 0;
+    }
+    return br / c_cdSamplesBytes;
+}
@@ -4,11 +4,58 @@
 #include <math.h>
 
 #include "cmd.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "placement.h"
 #include "utils.h"
 #include "values.h"
 
 picostation::DriveMechanics picostation::g_driveMechanics;
 
+namespace {
+struct SeekPoint {
+    uint32_t tracks;
+    uint32_t time;  // uS
+};
+
+// Interpolated between points, distances past the last one take its time. The jumps the controller asks for are
+// short, long seeks go through sled moves, whose COUT edges it counts and which are timed by the sled alarm.
+// Until the distance curve is measured on a real PU-8/PU-18, no jump is quicker than the fixed 15 ms XBUSY every
+// jump used to get
+constexpr SeekPoint c_accurateSeekTable[] = {
+    {1, 15000}, {1000, 20000}, {5000, 45000}, {c_trackMax, 90000},
+};
+constexpr SeekPoint c_fastSeekTable[] = {
+    {1, 500}, {c_trackMax, 1000},
+};
+
+template <size_t N>
+uint32_t interpolateSeekTime(const SeekPoint (&table)[N], const uint32_t tracks) {
+    if (tracks <= table[0].tracks) {
+        return table[0].time;
+    }
+    for (size_t i = 1; i < N; i++) {
+        if (tracks <= table[i].tracks) {
+            const SeekPoint &from = table[i - 1];
+            const SeekPoint &to = table[i];
+            return from.time + (uint64_t)(to.time - from.time) * (tracks - from.tracks) / (to.tracks - from.tracks);
+        }
+    }
+    return table[N - 1].time;
+}
+}  // namespace
+
+void picostation::DriveMechanics::init(MechCommand *mechCommand) {
+    m_mechCommand = mechCommand;
+    m_sledAlarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(m_sledAlarm, sledAlarmHandler);
+}
+
+uint32_t picostation::DriveMechanics::getSeekTime(const uint32_t tracks) const {
+    return (m_seekProfile == SeekProfile::FAST) ? interpolateSeekTime(c_fastSeekTable, tracks)
+                                                : interpolateSeekTime(c_accurateSeekTable, tracks);
+}
+
 void picostation::DriveMechanics::moveToNextSector() {
     const int nextSector = std::clamp(m_sector.Load() + 1, c_sectorMin, c_sectorMax);
     m_sector = nextSector;
@@ -19,26 +66,43 @@ void picostation::DriveMechanics::moveToNextSector() {
     }
 }
 
-void picostation::DriveMechanics::moveSled(picostation::MechCommand &mechCommand) {
-    if ((time_us_64() - m_sledTimer) > c_MaxTrackMoveTime) {
+void CORE0_FUNC(picostation::DriveMechanics::sledAlarmHandler)(unsigned int alarmNum) { g_driveMechanics.stepSled(); }
+
+void CORE0_FUNC(picostation::DriveMechanics::stepSled)() {
+    // Steps off the previous target rather than the time it ran, if the interrupt was held off the missed tracks
+    // are crossed here and the move still takes the modelled time
+    do {
+        if (m_sledMoveDirection == SledMove::STOP) {
+            return;
+        }
         setTrack(m_track + m_sledMoveDirection);
 
         const int tracks_moved = m_track - m_originalTrack;
         if (abs(tracks_moved) >= m_countTrack) {
             m_originalTrack = m_track;
-            mechCommand.setSens(SENS::COUT, !mechCommand.getSens(SENS::COUT));
+            m_mechCommand->setSens(SENS::COUT, !m_mechCommand->getSens(SENS::COUT));
         }
 
-        m_sledTimer = time_us_64();
-    }
+        m_sledTarget += c_MaxTrackMoveTime;
+    } while (hardware_alarm_set_target(m_sledAlarm, from_us_since_boot(m_sledTarget)));
 }
 
+// Direction and alarm change together, a step can't land between them
 void picostation::DriveMechanics::setSledMoveDirection(int sledMoveDirection) {
+    const uint32_t irqState = save_and_disable_interrupts();
     if (sledMoveDirection == SledMove::STOP && m_sledMoveDirection != SledMove::STOP) {
         m_sectorForTrackUpdate = trackToSector(m_track);
         m_sector = m_sectorForTrackUpdate;
     }
     m_sledMoveDirection = sledMoveDirection;
     m_originalTrack = m_track;
-    m_sledTimer = time_us_64();
-}
\ No newline at end of file
+    if (sledMoveDirection == SledMove::STOP) {
+        hardware_alarm_cancel(m_sledAlarm);
+    } else {
+        m_sledTarget = time_us_64() + c_MaxTrackMoveTime;
+        if (hardware_alarm_set_target(m_sledAlarm, from_us_since_boot(m_sledTarget))) {
+            stepSled();
+        }
+    }
+    restore_interrupts(irqState);
+}
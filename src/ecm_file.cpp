@@ -0,0 +1,412 @@
+#include "ecm_file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "global.h"
+#include "logging.h"
+#include "mount_arena.h"
+#include "third_party/iec-60908b/edcecc.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr uint32_t c_indexMagic = 0x49455350;  // "PSEI"
+constexpr uint16_t c_indexVersion = 1;
+constexpr char c_indexExtension[] = ".psindex";
+constexpr uint8_t c_ecmMagic[4] = {'E', 'C', 'M', 0};
+constexpr uint8_t c_syncHeader[12] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+
+namespace ItemType {
+enum : uint8_t {
+    Raw = 0,         // Literal bytes
+    Mode1 = 1,       // Address and user data of a mode 1 sector
+    Mode2Form1 = 2,  // Subheader and user data of a mode 2 sector, without its sync and header
+    Mode2Form2 = 3,
+};
+}
+
+// Bytes each item takes in the ECM file, and what it expands to
+constexpr uint32_t c_itemInputBytes[4] = {1, 3 + 2048, 4 + 2048, 4 + 2324};
+constexpr uint32_t c_itemOutputBytes[4] = {1, 2352, 2336, 2336};
+
+struct IndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entrySize;
+    uint64_t ecmSize;
+    uint16_t ecmDate;
+    uint16_t ecmTime;
+    uint32_t sectorCount;
+    uint64_t decodedSize;
+};
+
+bool readExact(FIL *fp, void *buffer, const UINT size) {
+    UINT br = 0;
+    return f_read(fp, buffer, size, &br) == FR_OK && br == size;
+}
+
+bool writeExact(FIL *fp, const void *buffer, const UINT size) {
+    UINT bw = 0;
+    return f_write(fp, buffer, size, &bw) == FR_OK && bw == size;
+}
+}  // namespace
+
+bool picostation::EcmFile::isEcmPath(const TCHAR *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcasecmp(extension, c_extension) == 0;
+}
+
+bool picostation::EcmFile::getIndexPath(const TCHAR *ecmPath, TCHAR *indexPath) {
+    const size_t length = strnlen(ecmPath, c_maxFilePathLength);
+    if (length + sizeof(c_indexExtension) > c_maxFilePathLength + 1) {
+        return false;
+    }
+    memcpy(indexPath, ecmPath, length);
+    memcpy(indexPath + length, c_indexExtension, sizeof(c_indexExtension));
+    return true;
+}
+
+bool picostation::EcmFile::readRecordHeader(InputStream &input, uint8_t &type, uint32_t &count) {
+    // Type in the low 2 bits, then the item count minus one, 5 bits and 7 more per continuation byte
+    uint8_t c = input.readByte();
+    type = c & 3;
+    uint32_t num = (c >> 2) & 0x1F;
+    int bits = 5;
+    while (c & 0x80) {
+        if (bits > 31) {
+            return false;
+        }
+        c = input.readByte();
+        num |= (uint32_t)(c & 0x7F) << bits;
+        bits += 7;
+    }
+    // The end marker is a count of 0xFFFFFFFF, which wraps to 0 here
+    count = num + 1;
+    return !input.isOverrun();
+}
+
+bool picostation::EcmFile::openIndex(const TCHAR *ecmPath, FIL *indexFile, uint32_t &ecmSize,
+                                     uint32_t &sectorCount, uint64_t &decodedSize) {
+    FILINFO ecmInfo;
+    TCHAR indexPath[c_maxFilePathLength + 1];
+    if (f_stat(ecmPath, &ecmInfo) != FR_OK || ecmInfo.fsize > UINT32_MAX || !getIndexPath(ecmPath, indexPath)) {
+        return false;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (f_open(indexFile, indexPath, FA_READ | FA_OPEN_EXISTING) == FR_OK) {
+            IndexHeader header;
+            if (readExact(indexFile, &header, sizeof(header)) && header.magic == c_indexMagic &&
+                header.version == c_indexVersion && header.entrySize == sizeof(IndexEntry) &&
+                header.ecmSize == ecmInfo.fsize && header.ecmDate == ecmInfo.fdate &&
+                header.ecmTime == ecmInfo.ftime &&
+                f_size(indexFile) == sizeof(header) + (FSIZE_t)header.sectorCount * sizeof(IndexEntry)) {
+                ecmSize = ecmInfo.fsize;
+                sectorCount = header.sectorCount;
+                decodedSize = header.decodedSize;
+                return true;
+            }
+            f_close(indexFile);
+            DEBUG_PRINT("ECM index %s is stale or invalid\n", indexPath);
+        }
+        if (attempt == 0 && !buildIndex(ecmPath, indexPath, ecmInfo)) {
+            break;
+        }
+    }
+    return false;
+}
+
+bool picostation::EcmFile::buildIndex(const TCHAR *ecmPath, const TCHAR *indexPath, const FILINFO &ecmInfo) {
+    // Everything here is scratch, handed back to the arena once the index is written
+    const size_t arenaMark = g_mountArena.getUsed();
+    FIL *ecmFile = g_mountArena.allocate<FIL>();
+    FIL *indexFile = g_mountArena.allocate<FIL>();
+    uint8_t *scanBuffer = g_mountArena.allocate<uint8_t>(c_scanBufferSize);
+    IndexEntry *entries = g_mountArena.allocate<IndexEntry>(c_entriesPerBlock);
+    if (!ecmFile || !indexFile || !scanBuffer || !entries) {
+        g_mountArena.release(arenaMark);
+        return false;
+    }
+
+    FRESULT fr = f_open(ecmFile, ecmPath, FA_READ | FA_OPEN_EXISTING);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_open(%s) error: %s (%d)\n", ecmPath, FRESULT_str(fr), fr);
+        g_mountArena.release(arenaMark);
+        return false;
+    }
+    fr = f_open(indexFile, indexPath, FA_WRITE | FA_CREATE_ALWAYS);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_open(%s) error: %s (%d)\n", indexPath, FRESULT_str(fr), fr);
+        f_close(ecmFile);
+        g_mountArena.release(arenaMark);
+        return false;
+    }
+
+    DEBUG_PRINT("Building ECM index for %s\n", ecmPath);
+
+    InputStream input;
+    input.init(ecmFile, 0, ecmInfo.fsize, scanBuffer, c_scanBufferSize);
+    uint8_t magic[sizeof(c_ecmMagic)];
+    bool ok = input.read(magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, c_ecmMagic, sizeof(magic)) == 0;
+
+    // The header goes out without its magic first, same as the cue cache
+    IndexHeader header = {};
+    header.version = c_indexVersion;
+    header.entrySize = sizeof(IndexEntry);
+    header.ecmSize = ecmInfo.fsize;
+    header.ecmDate = ecmInfo.fdate;
+    header.ecmTime = ecmInfo.ftime;
+    ok = ok && writeExact(indexFile, &header, sizeof(header));
+
+    // Only the record headers are read, the items in between are skipped over
+    uint64_t outputPos = 0;
+    uint64_t nextSectorPos = 0;
+    size_t pending = 0;
+    while (ok) {
+        uint8_t type;
+        uint32_t count;
+        if (!readRecordHeader(input, type, count)) {
+            ok = false;
+            break;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        const uint64_t inputPos = input.getPosition();
+        const uint64_t inputBytes = (uint64_t)count * c_itemInputBytes[type];
+        const uint64_t outputBytes = (uint64_t)count * c_itemOutputBytes[type];
+        if (inputPos + inputBytes > ecmInfo.fsize) {
+            ok = false;
+            break;
+        }
+
+        for (; nextSectorPos < outputPos + outputBytes; nextSectorPos += c_cdSamplesBytes) {
+            const uint64_t into = nextSectorPos - outputPos;
+            const uint32_t item = into / c_itemOutputBytes[type];
+            IndexEntry &entry = entries[pending++];
+            entry.inputOffset = inputPos + (uint64_t)item * c_itemInputBytes[type];
+            entry.remaining = count - item;
+            entry.skip = into % c_itemOutputBytes[type];
+            entry.type = type;
+            entry.reserved = 0;
+            header.sectorCount++;
+
+            if (pending == c_entriesPerBlock) {
+                ok = writeExact(indexFile, entries, pending * sizeof(IndexEntry));
+                pending = 0;
+                if (!ok) {
+                    break;
+                }
+            }
+        }
+
+        input.skip(inputBytes);
+        outputPos += outputBytes;
+    }
+
+    ok = ok && !input.isOverrun() && writeExact(indexFile, entries, pending * sizeof(IndexEntry));
+    if (ok) {
+        header.magic = c_indexMagic;
+        header.decodedSize = outputPos;
+        ok = f_lseek(indexFile, 0) == FR_OK && writeExact(indexFile, &header, sizeof(header));
+    }
+
+    f_close(indexFile);
+    f_close(ecmFile);
+    g_mountArena.release(arenaMark);
+
+    if (ok) {
+        // Keep the index out of the directory listing
+        f_chmod(indexPath, AM_HID, AM_HID);
+        DEBUG_PRINT("ECM index: %lu sectors, %llu bytes decoded\n", header.sectorCount, header.decodedSize);
+    } else {
+        DEBUG_PRINT("Failed to index %s\n", ecmPath);
+        f_unlink(indexPath);
+    }
+    return ok;
+}
+
+bool picostation::EcmFile::prepare(const TCHAR *ecmPath, uint64_t &decodedSize) {
+    const size_t arenaMark = g_mountArena.getUsed();
+    FIL *indexFile = g_mountArena.allocate<FIL>();
+    uint32_t ecmSize;
+    uint32_t sectorCount;
+    const bool ok = indexFile && openIndex(ecmPath, indexFile, ecmSize, sectorCount, decodedSize);
+    if (ok) {
+        f_close(indexFile);
+    }
+    g_mountArena.release(arenaMark);
+    return ok;
+}
+
+bool picostation::EcmFile::open(const TCHAR *ecmPath) {
+    close();
+
+    uint64_t decodedSize;
+    m_indexFile = g_mountArena.allocate<FIL>();
+    if (!m_indexFile || !openIndex(ecmPath, m_indexFile, m_ecmSize, m_sectorCount, decodedSize)) {
+        m_indexFile = nullptr;
+        return false;
+    }
+
+    m_entries = g_mountArena.allocate<IndexEntry>(c_entriesPerBlock);
+    m_inputBuffer = g_mountArena.allocate<uint8_t>(c_inputBufferSize);
+    m_item = static_cast<uint8_t *>(g_mountArena.allocate(c_cdSamplesBytes, 4));
+    if (!m_entries || !m_inputBuffer || !m_item) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void picostation::EcmFile::close() {
+    if (m_indexFile) {
+        f_close(m_indexFile);
+        m_indexFile = nullptr;
+    }
+    m_entries = nullptr;
+    m_inputBuffer = nullptr;
+    m_item = nullptr;
+    m_sectorCount = 0;
+    m_entryBlock = UINT32_MAX;
+    m_nextSector = -1;
+}
+
+bool picostation::EcmFile::seek(FIL *file, const int sector) {
+    const uint32_t block = sector / c_entriesPerBlock;
+    if (block != m_entryBlock) {
+        const uint32_t first = block * c_entriesPerBlock;
+        const uint32_t count = std::min<uint32_t>(c_entriesPerBlock, m_sectorCount - first);
+        m_entryBlock = UINT32_MAX;
+        if (f_lseek(m_indexFile, sizeof(IndexHeader) + (FSIZE_t)first * sizeof(IndexEntry)) != FR_OK ||
+            !readExact(m_indexFile, m_entries, count * sizeof(IndexEntry))) {
+            DEBUG_PRINT("ECM index read error\n");
+            return false;
+        }
+        m_entryBlock = block;
+    }
+
+    const IndexEntry &entry = m_entries[sector % c_entriesPerBlock];
+    m_input.init(file, entry.inputOffset, m_ecmSize - entry.inputOffset, m_inputBuffer, c_inputBufferSize);
+    m_type = entry.type & 3;
+    m_remaining = entry.remaining;
+    m_skip = entry.skip;
+    m_itemReady = false;
+    m_nextSector = sector;
+    return true;
+}
+
+int picostation::EcmFile::read(FIL *file, const int sector, uint8_t *buffer, const int sectorCount) {
+    if (!m_indexFile || sector < 0 || (uint32_t)sector >= m_sectorCount) {
+        return 0;
+    }
+    if (sector != m_nextSector && !seek(file, sector)) {
+        return 0;
+    }
+
+    // The pool may hand out a different handle each time, what's already buffered is still good
+    m_input.setFile(file);
+
+    int done = 0;
+    while (done < sectorCount && (uint32_t)m_nextSector < m_sectorCount) {
+        if (!decodeSector(buffer + done * c_cdSamplesBytes)) {
+            DEBUG_PRINT("ECM decode error at sector %d\n", m_nextSector);
+            m_nextSector = -1;
+            break;
+        }
+        done++;
+        m_nextSector++;
+    }
+    return done;
+}
+
+bool picostation::EcmFile::decodeSector(uint8_t *out) {
+    uint32_t produced = 0;
+    while (produced < c_cdSamplesBytes) {
+        if (m_remaining == 0) {
+            if (!readRecordHeader(m_input, m_type, m_remaining) || m_remaining == 0) {
+                return false;
+            }
+            m_skip = 0;
+            m_itemReady = false;
+        }
+
+        if (m_type == ItemType::Raw) {
+            const uint32_t size = std::min<uint32_t>(m_remaining, c_cdSamplesBytes - produced);
+            if (m_input.read(out + produced, size) != size) {
+                return false;
+            }
+            produced += size;
+            m_remaining -= size;
+            continue;
+        }
+
+        // Mode 2 items leave out the sync and header, which come before them as literal bytes
+        const uint32_t itemBytes = c_itemOutputBytes[m_type];
+        const uint32_t itemStart = c_cdSamplesBytes - itemBytes;
+        if (m_skip == 0 && produced == itemStart) {
+            // Lines up with the output sector, rebuild it in place
+            if (!decodeItem(out)) {
+                return false;
+            }
+            produced = c_cdSamplesBytes;
+            m_remaining--;
+            continue;
+        }
+
+        if (!m_itemReady) {
+            if (!decodeItem(m_item)) {
+                return false;
+            }
+            m_itemReady = true;
+        }
+        const uint32_t size = std::min<uint32_t>(itemBytes - m_skip, c_cdSamplesBytes - produced);
+        memcpy(out + produced, m_item + itemStart + m_skip, size);
+        produced += size;
+        m_skip += size;
+        if (m_skip == itemBytes) {
+            m_skip = 0;
+            m_remaining--;
+            m_itemReady = false;
+        }
+    }
+    return true;
+}
+
+bool picostation::EcmFile::decodeItem(uint8_t *sector) {
+    switch (m_type) {
+        case ItemType::Mode1:
+            memcpy(sector, c_syncHeader, sizeof(c_syncHeader));
+            m_input.read(sector + 12, 3);
+            sector[15] = 1;
+            m_input.read(sector + 16, 2048);
+            compute_mode1_edcecc(sector);
+            break;
+
+        case ItemType::Mode2Form1:
+        case ItemType::Mode2Form2:
+            // Only the second copy of the subheader is stored
+            m_input.read(sector + 20, c_itemInputBytes[m_type]);
+            memcpy(sector + 16, sector + 20, 4);
+            compute_mode2_edcecc(sector, m_type == ItemType::Mode2Form1 ? 1 : 2);
+            break;
+
+        default:
+            return false;
+    }
+    return !m_input.isOverrun();
+}
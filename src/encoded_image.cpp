@@ -0,0 +1,160 @@
+#include "encoded_image.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+#include "mount_arena.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr uint32_t c_encodedMagic = 0x4E455350;  // "PSEN"
+constexpr uint32_t c_encodedVersion = 1;
+constexpr uint32_t c_trackTableOffset = 32;
+constexpr uint32_t c_trackEntryBytes = 12;
+constexpr uint32_t c_subQBytes = 12;
+constexpr uint32_t c_trackTypeData = 2;
+
+uint32_t getLE16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+uint32_t getLE32(const uint8_t *data) { return getLE16(data) | (getLE16(data + 2) << 16); }
+}  // namespace
+
+bool picostation::EncodedImage::isEncodedPath(const TCHAR *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcasecmp(extension, ".psenc") == 0;
+}
+
+bool picostation::EncodedImage::readAt(const FSIZE_t offset, void *buffer, const UINT size) {
+    UINT br = 0;
+    FRESULT fr = f_lseek(m_file, offset);
+    if (FR_OK == fr) {
+        fr = f_read(m_file, buffer, size, &br);
+    }
+    if (FR_OK != fr || br != size) {
+        DEBUG_PRINT("Encoded image read error at %llu: %s (%d)\n", (unsigned long long)offset, FRESULT_str(fr), fr);
+        return false;
+    }
+    return true;
+}
+
+FRESULT picostation::EncodedImage::open(FilePool &filePool, CueDisc &disc) {
+    close();
+
+    m_file = filePool.acquire(0);
+    if (!m_file) {
+        return FR_NO_FILE;
+    }
+
+    const size_t mark = g_mountArena.getUsed();
+    uint8_t *header = g_mountArena.allocate<uint8_t>(c_headerBytes);
+    const bool parsed = header && readAt(0, header, c_headerBytes) && parseHeader(header, disc);
+    g_mountArena.release(mark);
+    if (!parsed) {
+        close();
+        return FR_INVALID_OBJECT;
+    }
+
+    m_records = g_mountArena.allocate<uint8_t>(c_subQPerRead * c_subQBytes);
+    if (!m_records || !m_subQ.init(c_subQEntries)) {
+        close();
+        return FR_NOT_ENOUGH_CORE;
+    }
+
+    DEBUG_PRINT("Encoded image: %d sectors, data at %llu\n", m_sectorCount, (unsigned long long)m_dataOffset);
+    return FR_OK;
+}
+
+void picostation::EncodedImage::close() {
+    m_file = nullptr;
+    m_subQOffset = 0;
+    m_dataOffset = 0;
+    m_sectorCount = 0;
+    m_subQ.reset();
+    m_records = nullptr;
+}
+
+bool picostation::EncodedImage::parseHeader(const uint8_t *header, CueDisc &disc) {
+    const int trackCount = getLE16(header + 6);
+    m_sectorCount = getLE32(header + 8);
+    m_subQOffset = getLE32(header + 12);
+    m_dataOffset = getLE32(header + 16);
+    if (getLE32(header) != c_encodedMagic || getLE16(header + 4) != c_encodedVersion || trackCount < 1 ||
+        trackCount > MAXTRACK - 2 || m_sectorCount <= 0 || m_subQOffset < c_headerBytes ||
+        m_dataOffset < m_subQOffset + (FSIZE_t)m_sectorCount * c_subQBytes ||
+        f_size(m_file) < m_dataOffset + (FSIZE_t)m_sectorCount * c_sectorBytes) {
+        DEBUG_PRINT("Not an encoded image, or a truncated one\n");
+        return false;
+    }
+
+    // One continuous image from the start of track 1, pregaps included, like a PBP
+    memset(&disc, 0, sizeof(disc));
+    disc.tracks[0].trackType = CueTrackType::TRACK_TYPE_UNKNOWN;
+    for (int i = 1; i <= trackCount; i++) {
+        const uint8_t *entry = header + c_trackTableOffset + (i - 1) * c_trackEntryBytes;
+        CueTrack &cueTrack = disc.tracks[i];
+        cueTrack.indices[0] = getLE32(entry);
+        cueTrack.indices[1] = getLE32(entry + 4);
+        cueTrack.indexCount = 2;
+        cueTrack.fileOffset = 0;
+        cueTrack.trackType =
+            (getLE32(entry + 8) == c_trackTypeData) ? CueTrackType::TRACK_TYPE_DATA : CueTrackType::TRACK_TYPE_AUDIO;
+        if (cueTrack.indices[0] > cueTrack.indices[1] ||
+            (i > 1 && cueTrack.indices[0] < disc.tracks[i - 1].indices[1])) {
+            DEBUG_PRINT("Bad encoded image track table: track %d out of order\n", i);
+            return false;
+        }
+    }
+    for (int i = 1; i <= trackCount; i++) {
+        const uint32_t end = (i < trackCount) ? disc.tracks[i + 1].indices[1] : (uint32_t)m_sectorCount;
+        if (end <= disc.tracks[i].indices[1]) {
+            return false;
+        }
+        disc.tracks[i].size = end - disc.tracks[i].indices[1];
+    }
+    disc.trackCount = trackCount;
+    return true;
+}
+
+bool picostation::EncodedImage::readSubQ(const int firstSector) {
+    const int count = std::min(c_subQPerRead, m_sectorCount - firstSector);
+    if (!readAt(m_subQOffset + (FSIZE_t)firstSector * c_subQBytes, m_records, count * c_subQBytes)) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        m_subQ.store(firstSector + i, m_records + i * c_subQBytes);
+    }
+    return true;
+}
+
+bool picostation::EncodedImage::readSector(const int adjustedSector, uint32_t *pioWords) {
+    if (!m_file || adjustedSector < 0 || adjustedSector >= m_sectorCount) {
+        return false;
+    }
+    if (!m_subQ.contains(adjustedSector)) {
+        // A seek, the Q frames have to be there before the sector goes out
+        readSubQ(adjustedSector);
+    }
+    return readAt(m_dataOffset + (FSIZE_t)adjustedSector * c_sectorBytes, pioWords, c_sectorBytes);
+}
+
+// Called by core1 while the DMA is still sending, one small read every c_subQPerRead sectors
+void picostation::EncodedImage::prefetch(const int adjustedSector) {
+    const int ahead = adjustedSector + c_subQLead;
+    if (!m_file || adjustedSector < 0 || ahead >= m_sectorCount || m_subQ.contains(ahead)) {
+        return;
+    }
+    readSubQ(ahead);
+}
@@ -0,0 +1,118 @@
+#include "file_pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+#include "mount_arena.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+void picostation::FilePool::reset(const TCHAR *parentPath, const CueFileTable *files) {
+    closeAll();
+    strncpy(m_parentPath, parentPath, sizeof(m_parentPath) - 1);
+    m_parentPath[sizeof(m_parentPath) - 1] = '\0';
+    m_files = files;
+    m_useCounter = 0;
+    memset(m_linkMaps, 0, sizeof(m_linkMaps));
+    memset(m_linkMapTried, 0, sizeof(m_linkMapTried));
+}
+
+void picostation::FilePool::closeAll() {
+    for (Handle &handle : m_handles) {
+        if (handle.fileIndex >= 0) {
+            f_close(&handle.fil);
+            handle.fileIndex = -1;
+        }
+    }
+}
+
+FIL *picostation::FilePool::acquire(const int fileIndex) {
+    if (!m_files || fileIndex < 0 || fileIndex >= m_files->fileCount) {
+        return nullptr;
+    }
+
+    Handle *victim = &m_handles[0];
+    for (Handle &handle : m_handles) {
+        if (handle.fileIndex == fileIndex) {
+            handle.lastUse = ++m_useCounter;
+            return &handle.fil;
+        }
+        if (handle.fileIndex < 0 || (victim->fileIndex >= 0 && handle.lastUse < victim->lastUse)) {
+            victim = &handle;
+        }
+    }
+
+    if (victim->fileIndex >= 0) {
+        f_close(&victim->fil);
+        victim->fileIndex = -1;
+    }
+
+    TCHAR fullpath[256];
+    snprintf(fullpath, sizeof(fullpath), "%s/%s", m_parentPath, m_files->getFileName(fileIndex));
+    const FRESULT fr = f_open(&victim->fil, fullpath, FA_READ | FA_OPEN_EXISTING);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_open(%s) error: %s (%d)\n", fullpath, FRESULT_str(fr), fr);
+        return nullptr;
+    }
+
+    victim->fileIndex = fileIndex;
+    victim->lastUse = ++m_useCounter;
+    attachLinkMap(*victim);
+
+    return &victim->fil;
+}
+
+void picostation::FilePool::buildLinkMaps() {
+    if (!m_files) {
+        return;
+    }
+    // Building a map walks the file's whole FAT chain, tens of ms for a large fragmented bin. Done here, an open
+    // from core1 between sectors only looks the file up and reattaches the map.
+    for (int i = 0; i < m_files->fileCount; i++) {
+        if (!m_linkMapTried[i]) {
+            acquire(i);
+        }
+    }
+}
+
+void picostation::FilePool::attachLinkMap(Handle &handle) {
+    const int fileIndex = handle.fileIndex;
+
+    if (!m_linkMapTried[fileIndex]) {
+        m_linkMapTried[fileIndex] = true;
+
+        DWORD *linkMap = g_mountArena.allocate<DWORD>(c_linkMapEntries);
+        if (linkMap) {
+            linkMap[0] = c_linkMapEntries;
+            handle.fil.cltbl = linkMap;
+            FRESULT fr = f_lseek(&handle.fil, CREATE_LINKMAP);
+            if (fr == FR_NOT_ENOUGH_CORE) {
+                // linkMap[0] now holds the size the map actually needs
+                const DWORD required = linkMap[0];
+                linkMap = g_mountArena.allocate<DWORD>(required);
+                if (linkMap) {
+                    linkMap[0] = required;
+                    handle.fil.cltbl = linkMap;
+                    fr = f_lseek(&handle.fil, CREATE_LINKMAP);
+                }
+            }
+            if (linkMap && FR_OK == fr) {
+                m_linkMaps[fileIndex] = linkMap;
+            } else {
+                DEBUG_PRINT("No fast-seek map for file %d\n", fileIndex);
+            }
+        }
+    }
+
+    // A map from an earlier open is still valid, the cluster chain doesn't change for a read-only file
+    handle.fil.cltbl = m_linkMaps[fileIndex];
+}
@@ -0,0 +1,327 @@
+#include "flac_decoder.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+namespace {
+namespace ChannelAssignment {
+enum : uint32_t {
+    LeftSide = 8,
+    SideRight = 9,
+    MidSide = 10,
+};
+}
+
+constexpr int c_sampleSizes[8] = {16, 8, 12, 0, 16, 20, 24, 0};  // 0 takes STREAMINFO's, which is 16 for CD audio
+}  // namespace
+
+void picostation::FlacDecoder::begin(InputStream *input, uint8_t *output, const uint32_t outputSize, int32_t *scratch,
+                                     const uint32_t maxBlockSize, const bool bigEndian) {
+    m_input = input;
+    m_output = output;
+    m_outputSize = outputSize & ~3u;
+    m_outPos = 0;
+    m_channels[0] = scratch;
+    m_channels[1] = scratch + maxBlockSize;
+    m_maxBlockSize = maxBlockSize;
+    m_bigEndian = bigEndian;
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    m_status = Status::Running;
+}
+
+picostation::FlacDecoder::Status picostation::FlacDecoder::decode(uint32_t target) {
+    target = std::min(target, m_outputSize);
+
+    while (m_status == Status::Running && m_outPos < target) {
+        if (!decodeFrame() || m_input->isOverrun()) {
+            m_status = Status::Error;
+        } else if (m_outPos == m_outputSize) {
+            m_status = Status::Done;
+        }
+    }
+    return m_status;
+}
+
+int32_t picostation::FlacDecoder::signedBits(const int count) {
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t value;
+    if (count > 24) {
+        value = bits(count - 16) << 16;
+        value |= bits(16);
+    } else {
+        value = bits(count);
+    }
+    const int shift = 32 - count;
+    return (int32_t)(value << shift) >> shift;
+}
+
+uint32_t picostation::FlacDecoder::unary() {
+    uint32_t zeros = 0;
+    while (true) {
+        if (m_bitCount == 0) {
+            m_bitBuffer = (uint32_t)m_input->readByte() << 24;
+            m_bitCount = 8;
+            if (m_input->isOverrun()) {
+                return zeros;
+            }
+        }
+        // Bits past m_bitCount are always zero, so any set bit is a valid one
+        if (m_bitBuffer != 0) {
+            const int leading = __builtin_clz(m_bitBuffer);
+            m_bitBuffer <<= leading + 1;
+            m_bitCount -= leading + 1;
+            return zeros + leading;
+        }
+        zeros += m_bitCount;
+        m_bitCount = 0;
+    }
+}
+
+bool picostation::FlacDecoder::decodeFrame() {
+    // Sync code, reserved bit and blocking strategy
+    if ((bits(16) & 0xFFFE) != 0xFFF8) {
+        return false;
+    }
+
+    const uint32_t blockSizeCode = bits(4);
+    const uint32_t sampleRateCode = bits(4);
+    const uint32_t channelAssignment = bits(4);
+    const uint32_t sampleSizeCode = bits(3);
+    bits(1);
+
+    // Frame or sample number, UTF-8 style: the leading ones of the first byte give the extra byte count
+    const uint32_t first = bits(8);
+    for (uint32_t mask = 0x40; (first & 0x80) && (first & mask); mask >>= 1) {
+        bits(8);
+    }
+
+    uint32_t blockSize;
+    if (blockSizeCode == 1) {
+        blockSize = 192;
+    } else if (blockSizeCode >= 2 && blockSizeCode <= 5) {
+        blockSize = 576u << (blockSizeCode - 2);
+    } else if (blockSizeCode == 6) {
+        blockSize = bits(8) + 1;
+    } else if (blockSizeCode == 7) {
+        blockSize = bits(16) + 1;
+    } else if (blockSizeCode >= 8) {
+        blockSize = 256u << (blockSizeCode - 8);
+    } else {
+        return false;
+    }
+
+    if (sampleRateCode == 12) {
+        bits(8);
+    } else if (sampleRateCode == 13 || sampleRateCode == 14) {
+        bits(16);
+    } else if (sampleRateCode == 15) {
+        return false;
+    }
+    bits(8);  // CRC-8, not checked
+
+    const int bitsPerSample = c_sampleSizes[sampleSizeCode];
+    if (blockSize > m_maxBlockSize || bitsPerSample != 16 || (channelAssignment != 1 && channelAssignment < 8) ||
+        channelAssignment > ChannelAssignment::MidSide) {
+        // Only 16-bit stereo is supported
+        return false;
+    }
+
+    // The side channel carries one extra bit
+    const bool sideFirst = channelAssignment == ChannelAssignment::SideRight;
+    const bool sideSecond = channelAssignment == ChannelAssignment::LeftSide || channelAssignment == ChannelAssignment::MidSide;
+    if (!decodeSubframe(m_channels[0], blockSize, bitsPerSample + (sideFirst ? 1 : 0)) ||
+        !decodeSubframe(m_channels[1], blockSize, bitsPerSample + (sideSecond ? 1 : 0))) {
+        return false;
+    }
+
+    alignToByte();
+    bits(16);  // CRC-16, not checked
+
+    int32_t *left = m_channels[0];
+    int32_t *right = m_channels[1];
+    switch (channelAssignment) {
+        case ChannelAssignment::LeftSide:
+            for (uint32_t i = 0; i < blockSize; i++) {
+                right[i] = left[i] - right[i];
+            }
+            break;
+        case ChannelAssignment::SideRight:
+            for (uint32_t i = 0; i < blockSize; i++) {
+                left[i] += right[i];
+            }
+            break;
+        case ChannelAssignment::MidSide:
+            for (uint32_t i = 0; i < blockSize; i++) {
+                const int32_t side = right[i];
+                const int32_t mid = ((uint32_t)left[i] << 1) | (side & 1);
+                left[i] = (mid + side) >> 1;
+                right[i] = (mid - side) >> 1;
+            }
+            break;
+    }
+
+    const uint32_t sampleCount = std::min(blockSize, (m_outputSize - m_outPos) / 4);
+    uint8_t *out = m_output + m_outPos;
+    for (uint32_t i = 0; i < sampleCount; i++) {
+        const uint16_t l = left[i];
+        const uint16_t r = right[i];
+        if (m_bigEndian) {
+            out[0] = l >> 8;
+            out[1] = l;
+            out[2] = r >> 8;
+            out[3] = r;
+        } else {
+            out[0] = l;
+            out[1] = l >> 8;
+            out[2] = r;
+            out[3] = r >> 8;
+        }
+        out += 4;
+    }
+    m_outPos += sampleCount * 4;
+    return true;
+}
+
+bool picostation::FlacDecoder::decodeSubframe(int32_t *samples, const uint32_t blockSize, int bitsPerSample) {
+    if (bits(1) != 0) {
+        return false;
+    }
+    const uint32_t type = bits(6);
+
+    int wasted = 0;
+    if (bits(1)) {
+        wasted = unary() + 1;
+        bitsPerSample -= wasted;
+    }
+
+    if (type == 0) {
+        const int32_t value = signedBits(bitsPerSample);
+        for (uint32_t i = 0; i < blockSize; i++) {
+            samples[i] = value;
+        }
+    } else if (type == 1) {
+        for (uint32_t i = 0; i < blockSize; i++) {
+            samples[i] = signedBits(bitsPerSample);
+        }
+    } else if (type >= 8 && type <= 12) {
+        const int order = type - 8;
+        if ((uint32_t)order > blockSize) {
+            return false;
+        }
+        for (int i = 0; i < order; i++) {
+            samples[i] = signedBits(bitsPerSample);
+        }
+        if (!decodeResidual(samples, blockSize, order)) {
+            return false;
+        }
+
+        switch (order) {
+            case 1:
+                for (uint32_t i = 1; i < blockSize; i++) {
+                    samples[i] += samples[i - 1];
+                }
+                break;
+            case 2:
+                for (uint32_t i = 2; i < blockSize; i++) {
+                    samples[i] += 2 * samples[i - 1] - samples[i - 2];
+                }
+                break;
+            case 3:
+                for (uint32_t i = 3; i < blockSize; i++) {
+                    samples[i] += 3 * samples[i - 1] - 3 * samples[i - 2] + samples[i - 3];
+                }
+                break;
+            case 4:
+                for (uint32_t i = 4; i < blockSize; i++) {
+                    samples[i] += 4 * samples[i - 1] - 6 * samples[i - 2] + 4 * samples[i - 3] - samples[i - 4];
+                }
+                break;
+        }
+    } else if (type >= 32) {
+        const int order = type - 31;
+        if ((uint32_t)order > blockSize) {
+            return false;
+        }
+        for (int i = 0; i < order; i++) {
+            samples[i] = signedBits(bitsPerSample);
+        }
+
+        const int precision = bits(4) + 1;
+        if (precision == 16) {
+            return false;
+        }
+        const int shift = signedBits(5);
+        if (shift < 0) {
+            return false;
+        }
+        int32_t coefficients[32];
+        for (int i = 0; i < order; i++) {
+            coefficients[i] = signedBits(precision);
+        }
+        if (!decodeResidual(samples, blockSize, order)) {
+            return false;
+        }
+
+        for (uint32_t i = order; i < blockSize; i++) {
+            // 16-bit samples with 15-bit coefficients and up to 32 taps can overflow 32 bits
+            int64_t sum = 0;
+            const int32_t *history = &samples[i];
+            for (int j = 0; j < order; j++) {
+                sum += (int64_t)coefficients[j] * history[-j - 1];
+            }
+            samples[i] += (int32_t)(sum >> shift);
+        }
+    } else {
+        return false;
+    }
+
+    if (wasted) {
+        for (uint32_t i = 0; i < blockSize; i++) {
+            samples[i] = (uint32_t)samples[i] << wasted;
+        }
+    }
+    return true;
+}
+
+bool picostation::FlacDecoder::decodeResidual(int32_t *samples, const uint32_t blockSize, const int predictorOrder) {
+    const uint32_t method = bits(2);
+    if (method > 1) {
+        return false;
+    }
+    const int parameterBits = method == 0 ? 4 : 5;
+    const uint32_t escape = (1u << parameterBits) - 1;
+
+    const int partitionOrder = bits(4);
+    const uint32_t partitionSamples = blockSize >> partitionOrder;
+    if ((partitionSamples << partitionOrder) != blockSize || partitionSamples < (uint32_t)predictorOrder) {
+        return false;
+    }
+
+    uint32_t index = predictorOrder;
+    for (int partition = 0; partition < (1 << partitionOrder); partition++) {
+        const uint32_t end = (partition + 1) * partitionSamples;
+        const uint32_t parameter = bits(parameterBits);
+        if (parameter == escape) {
+            const int rawBits = bits(5);
+            for (; index < end; index++) {
+                samples[index] = signedBits(rawBits);
+            }
+        } else if (parameter > 24) {
+            return false;
+        } else {
+            for (; index < end; index++) {
+                const uint32_t value = (unary() << parameter) | (parameter ? bits(parameter) : 0);
+                samples[index] = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+            }
+        }
+        if (m_input->isOverrun()) {
+            return false;
+        }
+    }
+    return true;
+}
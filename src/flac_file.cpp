@@ -0,0 +1,353 @@
+#include "flac_file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+#include "mount_arena.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr uint8_t c_flacMagic[4] = {'f', 'L', 'a', 'C'};
+constexpr uint32_t c_streamInfoBytes = 34;
+constexpr uint32_t c_seekPointBytes = 18;
+constexpr uint64_t c_placeholderPoint = UINT64_MAX;
+
+namespace BlockType {
+enum : uint8_t {
+    StreamInfo = 0,
+    SeekTable = 3,
+};
+}
+
+uint32_t getBE16(const uint8_t *data) { return (data[0] << 8) | data[1]; }
+uint32_t getBE24(const uint8_t *data) { return (data[0] << 16) | (data[1] << 8) | data[2]; }
+uint32_t getBE32(const uint8_t *data) { return (getBE16(data) << 16) | getBE16(data + 2); }
+uint64_t getBE64(const uint8_t *data) { return ((uint64_t)getBE32(data) << 32) | getBE32(data + 4); }
+
+uint8_t crc8(const uint8_t *data, const uint32_t length) {
+    uint8_t crc = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+}  // namespace
+
+bool picostation::FlacFile::isFlacPath(const TCHAR *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcasecmp(extension, ".flac") == 0;
+}
+
+bool picostation::FlacFile::readMetadata(InputStream &input, StreamInfo &info, SeekPoint *seekPoints,
+                                         uint32_t &seekPointCount) {
+    uint8_t buffer[c_streamInfoBytes];
+    if (input.read(buffer, sizeof(c_flacMagic)) != sizeof(c_flacMagic) ||
+        memcmp(buffer, c_flacMagic, sizeof(c_flacMagic)) != 0) {
+        return false;
+    }
+
+    bool hasStreamInfo = false;
+    seekPointCount = 0;
+    bool last = false;
+    while (!last && !input.isOverrun()) {
+        uint8_t header[4];
+        input.read(header, sizeof(header));
+        last = header[0] & 0x80;
+        const uint8_t type = header[0] & 0x7F;
+        const uint32_t length = getBE24(header + 1);
+
+        if (type == BlockType::StreamInfo && length == c_streamInfoBytes) {
+            input.read(buffer, c_streamInfoBytes);
+            info.minBlockSize = getBE16(buffer);
+            info.maxBlockSize = getBE16(buffer + 2);
+            const uint32_t sampleRate = (buffer[10] << 12) | (buffer[11] << 4) | (buffer[12] >> 4);
+            const uint32_t channels = ((buffer[12] >> 1) & 7) + 1;
+            const uint32_t bitsPerSample = (((buffer[12] & 1) << 4) | (buffer[13] >> 4)) + 1;
+            info.totalSamples = ((uint64_t)(buffer[13] & 0x0F) << 32) | getBE32(buffer + 14);
+            if (sampleRate != 44100 || channels != 2 || bitsPerSample != 16 || info.totalSamples == 0 ||
+                info.maxBlockSize < 16) {
+                DEBUG_PRINT("FLAC isn't 16-bit stereo 44.1kHz with a known length\n");
+                return false;
+            }
+            hasStreamInfo = true;
+        } else if (type == BlockType::SeekTable && seekPoints) {
+            // Keep an evenly spread subset of the points when there are too many
+            const uint32_t pointCount = length / c_seekPointBytes;
+            for (uint32_t i = 0; i < pointCount; i++) {
+                input.read(buffer, c_seekPointBytes);
+                const uint64_t sample = getBE64(buffer);
+                if (sample == c_placeholderPoint || seekPointCount == c_maxSeekPoints ||
+                    (uint64_t)seekPointCount * pointCount > (uint64_t)i * c_maxSeekPoints) {
+                    continue;
+                }
+                seekPoints[seekPointCount].sample = sample;
+                seekPoints[seekPointCount].offset = getBE64(buffer + 8);  // From the first frame, fixed up below
+                seekPointCount++;
+            }
+            input.skip(length - pointCount * c_seekPointBytes);
+        } else {
+            input.skip(length);
+        }
+    }
+    if (!hasStreamInfo || input.isOverrun()) {
+        return false;
+    }
+
+    info.audioOffset = input.getConsumed();
+    for (uint32_t i = 0; i < seekPointCount; i++) {
+        seekPoints[i].offset += info.audioOffset;
+    }
+    return true;
+}
+
+bool picostation::FlacFile::prepare(const TCHAR *path, uint64_t &decodedSize, uint32_t &maxBlockSize) {
+    const size_t arenaMark = g_mountArena.getUsed();
+    FIL *file = g_mountArena.allocate<FIL>();
+    uint8_t *buffer = g_mountArena.allocate<uint8_t>(c_inputBufferSize);
+    bool ok = false;
+    if (file && buffer && f_open(file, path, FA_READ | FA_OPEN_EXISTING) == FR_OK) {
+        InputStream input;
+        input.init(file, 0, std::min<FSIZE_t>(f_size(file), UINT32_MAX), buffer, c_inputBufferSize);
+        StreamInfo info;
+        uint32_t seekPointCount;
+        ok = readMetadata(input, info, nullptr, seekPointCount);
+        if (ok) {
+            decodedSize = info.totalSamples * 4;
+            maxBlockSize = info.maxBlockSize;
+        }
+        f_close(file);
+    }
+    g_mountArena.release(arenaMark);
+    return ok;
+}
+
+bool picostation::FlacFile::open(const uint32_t maxBlockSize) {
+    close();
+
+    m_frame = static_cast<int32_t *>(g_mountArena.allocate(FlacDecoder::getScratchSize(maxBlockSize), 4));
+    m_inputBuffer = g_mountArena.allocate<uint8_t>(c_inputBufferSize);
+    m_seekPoints = g_mountArena.allocate<SeekPoint>(c_maxSeekPoints);
+    if (!m_frame || !m_inputBuffer || !m_seekPoints) {
+        close();
+        return false;
+    }
+    m_maxBlockSize = maxBlockSize;
+    return true;
+}
+
+void picostation::FlacFile::close() {
+    m_fileIndex = -1;
+    m_frame = nullptr;
+    m_inputBuffer = nullptr;
+    m_seekPoints = nullptr;
+    m_seekPointCount = 0;
+    m_maxBlockSize = 0;
+    m_frameSamples = 0;
+    m_streamReady = false;
+}
+
+bool picostation::FlacFile::selectFile(FIL *file, const int fileIndex) {
+    m_fileIndex = -1;
+    m_frameSamples = 0;
+    m_streamReady = false;
+
+    m_input.init(file, 0, std::min<FSIZE_t>(f_size(file), UINT32_MAX), m_inputBuffer, c_inputBufferSize);
+    if (!readMetadata(m_input, m_info, m_seekPoints, m_seekPointCount) || m_info.maxBlockSize > m_maxBlockSize) {
+        return false;
+    }
+    m_info.fileSize = f_size(file);
+    m_fileIndex = fileIndex;
+    return true;
+}
+
+bool picostation::FlacFile::parseFrameHeader(const uint8_t *header, const uint32_t length, const StreamInfo &info,
+                                             uint64_t &sample) {
+    if (length < 6 || header[0] != 0xFF || (header[1] & 0xFE) != 0xF8) {
+        return false;
+    }
+    const uint8_t blockSizeCode = header[2] >> 4;
+    const uint8_t sampleRateCode = header[2] & 0x0F;
+    const uint8_t sampleSizeCode = (header[3] >> 1) & 7;
+    if (blockSizeCode == 0 || sampleRateCode == 15 || (header[3] >> 4) > 10 || sampleSizeCode == 3 ||
+        sampleSizeCode == 7 || (header[3] & 1)) {
+        return false;
+    }
+
+    // Frame or sample number, UTF-8 style
+    uint32_t pos = 4;
+    const uint8_t first = header[pos++];
+    int extraBytes = 0;
+    uint64_t number = first;
+    if (first & 0x80) {
+        while (extraBytes < 7 && (first & (0x40 >> extraBytes))) {
+            extraBytes++;
+        }
+        if (extraBytes == 0 || extraBytes > 6) {
+            return false;
+        }
+        number = first & (0x3F >> extraBytes);
+    }
+    for (int i = 0; i < extraBytes; i++) {
+        if (pos >= length || (header[pos] & 0xC0) != 0x80) {
+            return false;
+        }
+        number = (number << 6) | (header[pos++] & 0x3F);
+    }
+
+    pos += (blockSizeCode == 6) ? 1 : (blockSizeCode == 7) ? 2 : 0;
+    pos += (sampleRateCode == 12) ? 1 : (sampleRateCode == 13 || sampleRateCode == 14) ? 2 : 0;
+    if (pos >= length || crc8(header, pos) != header[pos]) {
+        return false;
+    }
+
+    // Fixed block size streams count frames instead of samples
+    sample = (header[1] & 1) ? number : number * info.maxBlockSize;
+    return true;
+}
+
+bool picostation::FlacFile::findFrame(FIL *file, const FSIZE_t from, const FSIZE_t to, SeekPoint &frame) {
+    uint8_t *window = m_inputBuffer;
+    FSIZE_t pos = from;
+    while (pos < to) {
+        UINT br = 0;
+        if (f_lseek(file, pos) != FR_OK || f_read(file, window, c_inputBufferSize, &br) != FR_OK || br < 2) {
+            return false;
+        }
+        // A header cut off by the end of the window is looked at again from the start of the next one
+        const bool atEnd = pos + br >= m_info.fileSize;
+        const UINT scanned = (atEnd || br <= c_frameHeaderMax) ? br : br - c_frameHeaderMax;
+        for (UINT i = 0; i < scanned && pos + i < to; i++) {
+            if (window[i] == 0xFF && parseFrameHeader(window + i, br - i, m_info, frame.sample)) {
+                frame.offset = pos + i;
+                return true;
+            }
+        }
+        if (atEnd) {
+            return false;
+        }
+        pos += scanned;
+    }
+    return false;
+}
+
+bool picostation::FlacFile::seek(FIL *file, const uint64_t sample) {
+    m_frameSamples = 0;
+    m_streamReady = false;
+
+    // Bracket the target between two known frames, narrowed down by the seek table
+    SeekPoint low = {0, m_info.audioOffset};
+    SeekPoint high = {m_info.totalSamples, m_info.fileSize};
+    for (uint32_t i = 0; i < m_seekPointCount; i++) {
+        if (m_seekPoints[i].sample <= sample) {
+            low = m_seekPoints[i];
+        } else {
+            high = m_seekPoints[i];
+            break;
+        }
+    }
+
+    // Then bisect on frame headers until decoding from the lower frame is cheap. The guess aims a block early, the
+    // next frame header from there is then likely the one holding the target
+    for (uint32_t step = 0; step < c_maxBisectSteps && sample - low.sample >= m_maxBlockSize; step++) {
+        if (high.offset <= low.offset + 1 || high.sample <= low.sample) {
+            break;
+        }
+        const FSIZE_t span = high.offset - low.offset;
+        FSIZE_t guess = low.offset + span * (sample - m_maxBlockSize - low.sample) / (high.sample - low.sample);
+        guess = std::max<FSIZE_t>(guess, low.offset + 1);
+
+        SeekPoint frame;
+        if (!findFrame(file, guess, high.offset, frame) || frame.sample <= low.sample ||
+            frame.sample >= high.sample) {
+            // No frame starts between the guess and the upper bound, nothing past the guess is of use
+            high.offset = guess;
+        } else if (frame.sample <= sample) {
+            low = frame;
+        } else {
+            high = frame;
+        }
+    }
+
+    m_input.init(file, low.offset, std::min<FSIZE_t>(m_info.fileSize - low.offset, UINT32_MAX), m_inputBuffer,
+                 c_inputBufferSize);
+    m_decoder.begin(&m_input, reinterpret_cast<uint8_t *>(m_frame), m_maxBlockSize * 4, m_frame, m_maxBlockSize,
+                    false);
+    m_frameSample = low.sample;
+    m_streamReady = true;
+    while (m_frameSample + m_frameSamples <= sample) {
+        if (!decodeFrame()) {
+            DEBUG_PRINT("FLAC seek to %llu failed\n", (unsigned long long)sample);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool picostation::FlacFile::decodeFrame() {
+    m_frameSample += m_frameSamples;
+    m_frameSamples = 0;
+    m_decoder.restartOutput();
+    if (m_decoder.decode(1) == FlacDecoder::Status::Error || m_decoder.getOutputPos() == 0) {
+        m_streamReady = false;
+        return false;
+    }
+    m_frameSamples = m_decoder.getOutputPos() / 4;
+    return true;
+}
+
+int picostation::FlacFile::read(FIL *file, const int fileIndex, const int sector, uint8_t *buffer,
+                                const int sectorCount) {
+    if (!m_frame || sector < 0 || (fileIndex != m_fileIndex && !selectFile(file, fileIndex))) {
+        return 0;
+    }
+    m_input.setFile(file);
+
+    for (int i = 0; i < sectorCount; i++) {
+        const uint64_t sectorSample = (uint64_t)(sector + i) * c_samplesPerSector;
+        if (sectorSample >= m_info.totalSamples) {
+            return i;
+        }
+        uint8_t *out = buffer + i * c_cdSamplesBytes;
+        uint32_t done = 0;
+        while (done < c_samplesPerSector) {
+            const uint64_t sample = sectorSample + done;
+            const uint64_t frameEnd = m_frameSample + m_frameSamples;
+            if (sample >= m_info.totalSamples) {
+                // A track that doesn't end on a sector boundary is padded with silence
+                memset(out + done * 4, 0, (c_samplesPerSector - done) * 4);
+                break;
+            } else if (m_frameSamples && sample >= m_frameSample && sample < frameEnd) {
+                const uint32_t offset = sample - m_frameSample;
+                const uint32_t count = std::min<uint64_t>(c_samplesPerSector - done, frameEnd - sample);
+                memcpy(out + done * 4, reinterpret_cast<const uint8_t *>(m_frame) + offset * 4, count * 4);
+                done += count;
+            } else if (m_streamReady && m_frameSamples && sample >= frameEnd &&
+                       sample - frameEnd < 2 * m_maxBlockSize) {
+                // Playing on, or a short skip ahead
+                if (!decodeFrame()) {
+                    return i;
+                }
+            } else if (!seek(file, sample)) {
+                return i;
+            }
+        }
+    }
+    return sectorCount;
+}
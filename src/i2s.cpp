@@ -24,8 +24,10 @@
 #include "modchip.h"
 #include "pico/stdlib.h"
 #include "picostation.h"
+#include "placement.h"
 #include "pseudo_atomics.h"
 #include "subq.h"
+#include "third_party/iec-60908b/edcecc.h"
 #include "values.h"
 
 #if DEBUG_I2S
@@ -68,6 +70,112 @@ constexpr std::array<uint16_t, 1176> picostation::I2S::generateScramblingLUT() {
     return cdScramblingLUT;
 }
 
+// The PIO shifts out the top 24 bits of each word, bit 0 of the sample is repeated into the unused low byte
+static inline uint32_t expandSample(const int sample) { return (sample << 8) | (0xFF & -(sample & 1)); }
+
+void CORE1_FUNC(picostation::I2S::encodeSector)(uint32_t *out, const int16_t *samples, const uint16_t *scramblingLUT) {
+    // Separate loops keep the track type check and the branch out of the per sample work
+    if (scramblingLUT) {
+        for (size_t i = 0; i < c_cdSamplesSize * 2; i += 2) {
+            out[i] = expandSample(samples[i] ^ scramblingLUT[i]);
+            out[i + 1] = expandSample(samples[i + 1] ^ scramblingLUT[i + 1]);
+        }
+    } else {
+        for (size_t i = 0; i < c_cdSamplesSize * 2; i += 2) {
+            out[i] = expandSample(samples[i]);
+            out[i + 1] = expandSample(samples[i + 1]);
+        }
+    }
+}
+
+#if BENCHMARK_I2S
+// The original per sample loop, kept to check and time encodeSector against
+void __time_critical_func(picostation::I2S::encodeSectorReference)(uint32_t *out, const int16_t *samples,
+                                                                   const uint16_t *scramblingLUT) {
+    for (size_t i = 0; i < c_cdSamplesSize * 2; i++) {
+        uint32_t i2sData;
+
+        if (scramblingLUT) {
+            i2sData = (samples[i] ^ scramblingLUT[i]) << 8;
+        } else {
+            i2sData = (samples[i]) << 8;
+        }
+
+        if (i2sData & 0x100) {
+            i2sData |= 0xFF;
+        }
+
+        out[i] = i2sData;
+    }
+}
+
+void picostation::I2S::benchmarkEncoder(const int16_t *samples, uint32_t *out, uint32_t *referenceOut,
+                                        const uint16_t *scramblingLUT) {
+    static constexpr unsigned c_runs = 32;
+
+    for (const uint16_t *lut : {scramblingLUT, static_cast<const uint16_t *>(nullptr)}) {
+        uint64_t startTime = time_us_64();
+        for (unsigned run = 0; run < c_runs; run++) {
+            encodeSectorReference(referenceOut, samples, lut);
+        }
+        const uint64_t referenceTime = time_us_64() - startTime;
+
+        startTime = time_us_64();
+        for (unsigned run = 0; run < c_runs; run++) {
+            encodeSector(out, samples, lut);
+        }
+        const uint64_t encoderTime = time_us_64() - startTime;
+
+        const bool match = memcmp(out, referenceOut, c_cdSamplesSize * 2 * sizeof(uint32_t)) == 0;
+        DEBUG_PRINT("%s sector encode: %lluus reference, %lluus now per %u sectors%s\n", lut ? "Data" : "Audio",
+                    referenceTime, encoderTime, c_runs, match ? "" : " MISMATCH");
+    }
+}
+#endif
+
+#if BENCHMARK_EDCECC
+void picostation::I2S::benchmarkEdcEcc(uint8_t *sector, uint8_t *referenceSector) {
+    static constexpr unsigned c_runs = 32;
+
+    // Noise for everything but the mode and submode bytes, which pick the form
+    uint32_t seed = 1;
+    for (size_t i = 0; i < c_cdSamplesBytes; i++) {
+        seed = seed * 1103515245 + 12345;
+        sector[i] = seed >> 24;
+    }
+    sector[15] = 2;
+
+    for (const unsigned form : {1u, 2u}) {
+        sector[18] = sector[22] = form == 2 ? 0x20 : 0x08;
+        memcpy(referenceSector, sector, c_cdSamplesBytes);
+
+        uint64_t startTime = time_us_64();
+        for (unsigned run = 0; run < c_runs; run++) {
+            compute_edcecc_reference(referenceSector);
+        }
+        const uint64_t referenceTime = time_us_64() - startTime;
+
+        startTime = time_us_64();
+        for (unsigned run = 0; run < c_runs; run++) {
+            compute_mode2_edcecc(sector, form);
+        }
+        const uint64_t edcEccTime = time_us_64() - startTime;
+
+        const bool match = memcmp(sector, referenceSector, c_cdSamplesBytes) == 0;
+        DEBUG_PRINT("Mode 2 form %u EDC/ECC: %lluus reference, %lluus now per %u sectors%s\n", form, referenceTime,
+                    edcEccTime, c_runs, match ? "" : " MISMATCH");
+    }
+
+    // The original code had no mode 1 path, nothing to compare against
+    sector[15] = 1;
+    const uint64_t startTime = time_us_64();
+    for (unsigned run = 0; run < c_runs; run++) {
+        compute_mode1_edcecc(sector);
+    }
+    DEBUG_PRINT("Mode 1 EDC/ECC: %lluus per %u sectors\n", time_us_64() - startTime, c_runs);
+}
+#endif
+
 void picostation::I2S::mountSDCard() {
     FRESULT fr = f_mount(&s_fatFS, "", 1);
     if (FR_OK != fr) {
@@ -101,7 +209,7 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
     static uint16_t cdSamples[c_cdSamplesBytes / sizeof(uint16_t)];  // Make static to move off stack
 
     static uint32_t pioSamples[2][(c_cdSamplesBytes * 2) / sizeof(uint32_t)];
-    static constexpr auto cdScramblingLUT = generateScramblingLUT();
+    static const std::array<uint16_t, 1176> __not_in_flash("scrambling") cdScramblingLUT = generateScramblingLUT();
 
     int bufferForDMA = 1;
     int bufferForSDRead = 0;
@@ -119,6 +227,13 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
 
     int dmaChannel = initDMA(pioSamples[0], c_cdSamplesSize * 2);
 
+#if BENCHMARK_I2S
+    benchmarkEncoder(reinterpret_cast<int16_t *>(cdSamples), pioSamples[0], pioSamples[1], cdScramblingLUT.data());
+#endif
+#if BENCHMARK_EDCECC
+    benchmarkEdcEcc(reinterpret_cast<uint8_t *>(pioSamples[0]), reinterpret_cast<uint8_t *>(pioSamples[1]));
+#endif
+
     g_coreReady[1] = true;          // Core 1 is ready
     while (!g_coreReady[0].Load())  // Wait for Core 0 to be ready
     {
@@ -182,7 +297,13 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
 
             // Copy CD samples to PIO buffer
             sectorNumber = currentSector - c_leadIn - c_preGap;
-            g_discImage.readSector(cdSamples, currentSector - c_leadIn, s_dataLocation);
+            // Encoded images are stored the way the PIO takes them, everything else is read then encoded below
+            bool encoded = needFileCheckAction.Load() == picostation::FileListingStates::IDLE &&
+                           g_discImage.readEncodedSector(pioSamples[bufferForSDRead], currentSector - c_leadIn,
+                                                         s_dataLocation);
+            if (!encoded) {
+                g_discImage.readSector(cdSamples, currentSector - c_leadIn, s_dataLocation);
+            }
 
             if (needFileCheckAction.Load() != picostation::FileListingStates::IDLE) {
                 switch (needFileCheckAction.Load()) {
@@ -228,34 +349,23 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
                 if (needFileCheckAction.Load() == picostation::FileListingStates::PROCESS_FILES) {
                     if (listReadyState.Load() == 0) {
                         g_discImage.buildSector(sectorNumber + c_preGap, (uint8_t *)&cdSamples, emptyBuffer2);
+                        encoded = false;
                     } else if (sectorNumber == 100) {
                         printf("sector 100 game read\n");
                         uint8_t *temp = picostation::DirectoryListing::getFileListingData();
                         g_discImage.buildSector(sectorNumber + c_preGap, (uint8_t *)&cdSamples, temp);
+                        encoded = false;
                         needFileCheckAction = picostation::FileListingStates::IDLE;
                     }
                 }
             }
 
-            int16_t const *sectorData = reinterpret_cast<int16_t *>(cdSamples);
-
-            // Copy CD samples to PIO buffer
-            for (size_t i = 0; i < c_cdSamplesSize * 2; i++) {
-                uint32_t i2sData;
-
-                if (g_discImage.isCurrentTrackData()) {
-                    // Scramble the data
-                    i2sData = (sectorData[i] ^ cdScramblingLUT[i]) << 8;
-                } else {
-                    // Audio track, just copy the data
-                    i2sData = (sectorData[i]) << 8;
-                }
-
-                if (i2sData & 0x100) {
-                    i2sData |= 0xFF;
-                }
+            if (!encoded) {
+                int16_t const *sectorData = reinterpret_cast<int16_t *>(cdSamples);
 
-                pioSamples[bufferForSDRead][i] = i2sData;
+                // Copy CD samples to PIO buffer, data tracks get scrambled
+                encodeSector(pioSamples[bufferForSDRead], sectorData,
+                             g_discImage.isCurrentTrackData() ? cdScramblingLUT.data() : nullptr);
             }
 
 #if DEBUG_I2S
@@ -271,14 +381,19 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
                 }*/
             sectorCount++;
 #endif
+        } else if (s_dataLocation == picostation::DiscImage::DataLocation::SDCard &&
+                   dma_channel_is_busy(dmaChannel)) {
+            // Next sector is already buffered, spend the rest of this one reading ahead. The time left is taken at
+            // double speed, at single speed there is twice as much
+            static constexpr uint32_t c_doubleSpeedSectorTime = 1000000 / 150;  // uS
+            const uint32_t wordsLeft = dma_hw->ch[dmaChannel].transfer_count;
+            g_discImage.prefetch(currentSector - c_leadIn,
+                                 wordsLeft * c_doubleSpeedSectorTime / (c_cdSamplesSize * 2));
         }
 
         // Start the next transfer if the DMA channel is not busy
         if (!dma_channel_is_busy(dmaChannel)) {
             bufferForDMA = (bufferForDMA + 1) % 2;
-            m_sectorSending = loadedSector[bufferForDMA];
-            m_lastSectorTime = time_us_64();
-
             dma_hw->ch[dmaChannel].read_addr = (uint32_t)pioSamples[bufferForDMA];
 
             // Sync with the I2S clock
@@ -290,6 +405,9 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
             }
 
             dma_channel_start(dmaChannel);
+            // Stamped once the sector is actually going out, core0's sector clock counts from here
+            m_lastSectorTime = time_us_64();
+            m_sectorSending = loadedSector[bufferForDMA];
         }
 
 #if DEBUG_I2S
@@ -0,0 +1,245 @@
+#include "inflate.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+constexpr uint16_t c_lengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                       31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t c_lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t c_distanceBase[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                         193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr uint8_t c_distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                         6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+constexpr uint8_t c_codeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+}  // namespace
+
+void picostation::Inflate::begin(InputStream *input, uint8_t *output, const uint32_t outputSize) {
+    m_input = input;
+    m_output = output;
+    m_outputSize = outputSize;
+    m_outPos = 0;
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    m_block = Block::None;
+    m_final = false;
+    m_storedRemaining = 0;
+    m_status = Status::Running;
+}
+
+picostation::Inflate::Status picostation::Inflate::decode(uint32_t target) {
+    target = std::min(target, m_outputSize);
+
+    while (m_status == Status::Running && m_outPos < target) {
+        if (m_block == Block::None) {
+            if (m_final) {
+                m_status = Status::Done;
+            } else if (!beginBlock()) {
+                m_status = Status::Error;
+            }
+        } else if (m_block == Block::Stored) {
+            const uint32_t count = std::min(m_storedRemaining, m_outputSize - m_outPos);
+            m_input->read(m_output + m_outPos, count);
+            m_outPos += count;
+            m_storedRemaining -= count;
+            m_block = Block::None;
+        } else {
+            const int symbol = decodeSymbol(m_lengthCodes);
+            if (symbol < 256) {
+                if (symbol < 0) {
+                    m_status = Status::Error;
+                    break;
+                }
+                m_output[m_outPos++] = symbol;
+            } else if (symbol == 256) {
+                m_block = Block::None;
+            } else {
+                const int lengthSymbol = symbol - 257;
+                if (lengthSymbol >= 29) {
+                    m_status = Status::Error;
+                    break;
+                }
+                uint32_t length = c_lengthBase[lengthSymbol] + bits(c_lengthExtra[lengthSymbol]);
+
+                const int distanceSymbol = decodeSymbol(m_distanceCodes);
+                if (distanceSymbol < 0 || distanceSymbol >= 30) {
+                    m_status = Status::Error;
+                    break;
+                }
+                const uint32_t distance = c_distanceBase[distanceSymbol] + bits(c_distanceExtra[distanceSymbol]);
+                if (distance > m_outPos) {
+                    m_status = Status::Error;
+                    break;
+                }
+
+                // Byte by byte, the source and destination overlap for runs
+                length = std::min(length, m_outputSize - m_outPos);
+                const uint8_t *from = m_output + m_outPos - distance;
+                uint8_t *to = m_output + m_outPos;
+                for (uint32_t i = 0; i < length; i++) {
+                    to[i] = from[i];
+                }
+                m_outPos += length;
+            }
+        }
+
+        if (m_input->isOverrun()) {
+            m_status = Status::Error;
+        }
+    }
+
+    if (m_status == Status::Running && m_outPos == m_outputSize) {
+        // Everything the caller asked for is there, whatever trails the last block doesn't matter
+        m_status = Status::Done;
+    }
+    return m_status;
+}
+
+bool picostation::Inflate::beginBlock() {
+    m_final = bits(1);
+    switch (bits(2)) {
+        case 0: {
+            // Stored, aligned to the next byte
+            bits(m_bitCount & 7);
+            const uint32_t length = bits(16);
+            const uint32_t lengthComplement = bits(16);
+            if ((length ^ 0xFFFF) != lengthComplement) {
+                return false;
+            }
+            m_storedRemaining = length;
+            m_block = Block::Stored;
+            return true;
+        }
+
+        case 1: {
+            uint8_t lengths[288 + 30];
+            memset(lengths, 8, 144);
+            memset(lengths + 144, 9, 112);
+            memset(lengths + 256, 7, 24);
+            memset(lengths + 280, 8, 8);
+            memset(lengths + 288, 5, 30);
+            buildHuffman(m_lengthCodes, lengths, 288);
+            buildHuffman(m_distanceCodes, lengths + 288, 30);
+            m_block = Block::Codes;
+            return true;
+        }
+
+        case 2:
+            if (!readDynamicTables()) {
+                return false;
+            }
+            m_block = Block::Codes;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool picostation::Inflate::readDynamicTables() {
+    const int lengthCount = bits(5) + 257;
+    const int distanceCount = bits(5) + 1;
+    const int codeLengthCount = bits(4) + 4;
+    if (lengthCount > 286 || distanceCount > 30) {
+        return false;
+    }
+
+    uint8_t lengths[288 + 30];
+    memset(lengths, 0, 19);
+    for (int i = 0; i < codeLengthCount; i++) {
+        lengths[c_codeLengthOrder[i]] = bits(3);
+    }
+    // The code length codes are only needed while reading the tables, borrow the distance table for them
+    if (!buildHuffman(m_distanceCodes, lengths, 19)) {
+        return false;
+    }
+
+    int index = 0;
+    while (index < lengthCount + distanceCount) {
+        int symbol = decodeSymbol(m_distanceCodes);
+        if (symbol < 0) {
+            return false;
+        }
+        if (symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+
+        uint8_t repeated = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (index == 0) {
+                return false;
+            }
+            repeated = lengths[index - 1];
+            repeat = 3 + bits(2);
+        } else if (symbol == 17) {
+            repeat = 3 + bits(3);
+        } else {
+            repeat = 11 + bits(7);
+        }
+        if (index + repeat > lengthCount + distanceCount) {
+            return false;
+        }
+        while (repeat--) {
+            lengths[index++] = repeated;
+        }
+    }
+
+    // The end of block code has to be there, or nothing could ever end
+    if (lengths[256] == 0) {
+        return false;
+    }
+
+    return buildHuffman(m_lengthCodes, lengths, lengthCount) &&
+           buildHuffman(m_distanceCodes, lengths + lengthCount, distanceCount) && !m_input->isOverrun();
+}
+
+int picostation::Inflate::decodeSymbol(const Huffman &huffman) {
+    // Canonical codes, walked one bit at a time: code lengths are short enough that a lookup table isn't worth the RAM
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length <= c_maxBits; length++) {
+        code |= bits(1);
+        const int count = huffman.count[length];
+        if (code - count < first) {
+            return huffman.symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool picostation::Inflate::buildHuffman(Huffman &huffman, const uint8_t *lengths, const int count) {
+    memset(huffman.count, 0, sizeof(huffman.count));
+    for (int symbol = 0; symbol < count; symbol++) {
+        huffman.count[lengths[symbol]]++;
+    }
+
+    // Over-subscribed sets can't be decoded, incomplete ones are allowed (single distance code streams)
+    int left = 1;
+    for (int length = 1; length <= c_maxBits; length++) {
+        left = (left << 1) - huffman.count[length];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    uint16_t offsets[c_maxBits + 1];
+    offsets[1] = 0;
+    for (int length = 1; length < c_maxBits; length++) {
+        offsets[length + 1] = offsets[length] + huffman.count[length];
+    }
+    for (int symbol = 0; symbol < count; symbol++) {
+        if (lengths[symbol] != 0) {
+            huffman.symbol[offsets[lengths[symbol]]++] = symbol;
+        }
+    }
+    return true;
+}
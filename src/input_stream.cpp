@@ -0,0 +1,103 @@
+#include "input_stream.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+void picostation::InputStream::init(FIL *file, const FSIZE_t offset, const uint32_t length, uint8_t *buffer,
+                                    const uint32_t bufferSize) {
+    m_file = file;
+    m_nextOffset = offset;
+    m_length = length;
+    m_pending = length;
+    m_buffer = buffer;
+    m_bufferSize = bufferSize;
+    m_data = buffer;
+    m_pos = 0;
+    m_end = 0;
+    m_overrun = false;
+}
+
+void picostation::InputStream::init(const uint8_t *data, const uint32_t length) {
+    m_file = nullptr;
+    m_nextOffset = 0;
+    m_length = length;
+    m_pending = 0;
+    m_buffer = nullptr;
+    m_bufferSize = 0;
+    m_data = data;
+    m_pos = 0;
+    m_end = length;
+    m_overrun = false;
+}
+
+bool picostation::InputStream::refill() {
+    if (!m_file || m_pending == 0) {
+        return false;
+    }
+
+    // The file may have been used for something else since the last refill, always seek
+    const UINT toRead = std::min(m_pending, m_bufferSize);
+    UINT br = 0;
+    FRESULT fr = f_lseek(m_file, m_nextOffset);
+    if (FR_OK == fr) {
+        fr = f_read(m_file, m_buffer, toRead, &br);
+    }
+    if (FR_OK != fr || br == 0) {
+        DEBUG_PRINT("InputStream refill error: %s (%d)\n", FRESULT_str(fr), fr);
+        m_pending = 0;
+        return false;
+    }
+
+    m_nextOffset += br;
+    m_pending -= br;
+    m_pos = 0;
+    m_end = br;
+    return true;
+}
+
+uint32_t picostation::InputStream::read(void *buffer, const uint32_t size) {
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    uint32_t done = 0;
+    while (done < size) {
+        if (m_pos == m_end && !refill()) {
+            m_overrun = true;
+            break;
+        }
+        const uint32_t chunk = std::min(size - done, m_end - m_pos);
+        memcpy(out + done, m_data + m_pos, chunk);
+        m_pos += chunk;
+        done += chunk;
+    }
+    return done;
+}
+
+void picostation::InputStream::skip(uint32_t size) {
+    const uint32_t buffered = m_end - m_pos;
+    if (size <= buffered) {
+        m_pos += size;
+        return;
+    }
+
+    size -= buffered;
+    m_pos = m_end;
+    if (size > m_pending) {
+        m_overrun = true;
+        size = m_pending;
+    }
+    m_nextOffset += size;
+    m_pending -= size;
+}
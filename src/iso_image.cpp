@@ -0,0 +1,110 @@
+#include "iso_image.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+#include "third_party/iec-60908b/edcecc.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr size_t c_userDataOffset = 24;
+
+constexpr uint8_t c_submodeData = 0x08;
+constexpr uint8_t c_submodeEndOfFile = 0x80 | 0x01;  // EOF and EOR, on the last sector of the image
+
+// Sync, a header that only needs its address filled in, and the data subheader written twice
+constexpr uint8_t c_sectorTemplate[c_userDataOffset] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                                        0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x02,
+                                                        0x00, 0x00, c_submodeData, 0x00, 0x00, 0x00, c_submodeData, 0x00};
+
+uint8_t toBCD(const int in) { return ((in / 10) << 4) | (in % 10); }
+}  // namespace
+
+bool picostation::IsoImage::isIsoPath(const TCHAR *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcasecmp(extension, ".iso") == 0;
+}
+
+FRESULT picostation::IsoImage::open(const TCHAR *path, CueDisc &disc) {
+    close();
+
+    FILINFO info;
+    const FRESULT fr = f_stat(path, &info);
+    if (FR_OK != fr) {
+        return fr;
+    }
+    if (info.fsize < c_sectorBytes || info.fsize / c_sectorBytes > UINT32_MAX) {
+        return FR_INVALID_OBJECT;
+    }
+    if (info.fsize % c_sectorBytes) {
+        DEBUG_PRINT("ISO size isn't a whole number of sectors, ignoring the last %u bytes\n",
+                    (unsigned)(info.fsize % c_sectorBytes));
+    }
+    m_sectorCount = info.fsize / c_sectorBytes;
+
+    memset(&disc, 0, sizeof(disc));
+    disc.trackCount = 1;
+    disc.tracks[0].trackType = CueTrackType::TRACK_TYPE_UNKNOWN;
+    disc.tracks[1].trackType = CueTrackType::TRACK_TYPE_DATA;
+    disc.tracks[1].indexCount = 2;
+    disc.tracks[1].size = m_sectorCount;
+    disc.tracks[1].fileOffset = 0;
+    return FR_OK;
+}
+
+int picostation::IsoImage::read(FIL *file, const int sector, uint8_t *buffer, const int sectorCount) {
+    if (sector < 0 || (uint32_t)sector >= m_sectorCount) {
+        return 0;
+    }
+    const int count = std::min<uint32_t>(sectorCount, m_sectorCount - sector);
+
+    // Read all the user data in one go into the tail of the buffer, then spread it out front to back.
+    // Sector i is read from behind where sector i is written, so nothing is overwritten before it is moved.
+    uint8_t *userData = buffer + count * (c_cdSamplesBytes - c_sectorBytes);
+    FRESULT fr = f_lseek(file, (FSIZE_t)sector * c_sectorBytes);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_lseek(%s) error: (%d)\n", FRESULT_str(fr), fr);
+        return 0;
+    }
+    UINT br = 0;
+    fr = f_read(file, userData, count * c_sectorBytes, &br);
+    if (FR_OK != fr) {
+        DEBUG_PRINT("f_read(%s) error: (%d)\n", FRESULT_str(fr), fr);
+        return 0;
+    }
+
+    const int sectorsRead = br / c_sectorBytes;
+    for (int i = 0; i < sectorsRead; i++) {
+        uint8_t *out = buffer + i * c_cdSamplesBytes;
+        memmove(out + c_userDataOffset, userData + i * c_sectorBytes, c_sectorBytes);
+        buildSector(out, sector + i);
+    }
+    return sectorsRead;
+}
+
+void picostation::IsoImage::buildSector(uint8_t *sector, const int fileSector) const {
+    memcpy(sector, c_sectorTemplate, c_userDataOffset);
+    const int lba = fileSector + c_preGap;  // The data track starts right after the pregap
+    sector[12] = toBCD(lba / 75 / 60);
+    sector[13] = toBCD((lba / 75) % 60);
+    sector[14] = toBCD(lba % 75);
+    if ((uint32_t)fileSector == m_sectorCount - 1) {
+        sector[18] = c_submodeData | c_submodeEndOfFile;
+        sector[22] = sector[18];
+    }
+    compute_mode2_edcecc(sector, 1);
+}
@@ -0,0 +1,238 @@
+#include "lzma_decoder.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+namespace {
+constexpr int c_bitModelTotalBits = 11;
+constexpr uint32_t c_bitModelTotal = 1u << c_bitModelTotalBits;
+constexpr int c_moveBits = 5;
+constexpr uint32_t c_topValue = 1u << 24;
+constexpr int c_matchMinLen = 2;
+}  // namespace
+
+void picostation::LzmaDecoder::begin(InputStream *input, uint8_t *output, const uint32_t outputSize, uint16_t *probs,
+                                     const int lc, const int lp, const int pb) {
+    m_input = input;
+    m_output = output;
+    m_outputSize = outputSize;
+    m_outPos = 0;
+    m_probs = probs;
+    m_lc = lc;
+    m_lpMask = (1u << lp) - 1;
+    m_pbMask = (1u << pb) - 1;
+
+    const size_t probCount = getProbCount(lc, lp);
+    for (size_t i = 0; i < probCount; i++) {
+        probs[i] = c_bitModelTotal >> 1;
+    }
+
+    m_state = 0;
+    m_reps[0] = m_reps[1] = m_reps[2] = m_reps[3] = 0;
+    m_range = 0xFFFFFFFF;
+    m_code = 0;
+    const uint8_t first = m_input->readByte();
+    for (int i = 0; i < 4; i++) {
+        m_code = (m_code << 8) | m_input->readByte();
+    }
+    m_status = (first == 0 && m_code != m_range) ? Status::Running : Status::Error;
+}
+
+picostation::LzmaDecoder::Status picostation::LzmaDecoder::decode(uint32_t target) {
+    if (m_status != Status::Running) {
+        return m_status;
+    }
+    target = std::min(target, m_outputSize);
+
+    // The range coder lives in locals for the hot loop, output writes would otherwise force it back to memory
+    uint32_t range = m_range;
+    uint32_t code = m_code;
+    uint32_t state = m_state;
+    uint32_t rep0 = m_reps[0];
+    uint32_t rep1 = m_reps[1];
+    uint32_t rep2 = m_reps[2];
+    uint32_t rep3 = m_reps[3];
+    uint16_t *const probs = m_probs;
+    uint8_t *const output = m_output;
+    uint32_t outPos = m_outPos;
+    InputStream *const input = m_input;
+
+    auto normalize = [&]() {
+        if (range < c_topValue) {
+            range <<= 8;
+            code = (code << 8) | input->readByte();
+        }
+    };
+    auto decodeBit = [&](uint16_t *prob) -> uint32_t {
+        const uint32_t bound = (range >> c_bitModelTotalBits) * *prob;
+        uint32_t bit;
+        if (code < bound) {
+            *prob += (c_bitModelTotal - *prob) >> c_moveBits;
+            range = bound;
+            bit = 0;
+        } else {
+            *prob -= *prob >> c_moveBits;
+            code -= bound;
+            range -= bound;
+            bit = 1;
+        }
+        normalize();
+        return bit;
+    };
+    auto decodeTree = [&](uint16_t *treeProbs, const int numBits) -> uint32_t {
+        uint32_t m = 1;
+        for (int i = 0; i < numBits; i++) {
+            m = (m << 1) + decodeBit(&treeProbs[m]);
+        }
+        return m - (1u << numBits);
+    };
+    auto decodeReverseTree = [&](uint16_t *treeProbs, const int numBits) -> uint32_t {
+        uint32_t m = 1;
+        uint32_t symbol = 0;
+        for (int i = 0; i < numBits; i++) {
+            const uint32_t bit = decodeBit(&treeProbs[m]);
+            m = (m << 1) + bit;
+            symbol |= bit << i;
+        }
+        return symbol;
+    };
+    auto decodeDirect = [&](int numBits) -> uint32_t {
+        uint32_t result = 0;
+        do {
+            range >>= 1;
+            code -= range;
+            const uint32_t t = 0 - (code >> 31);
+            code += range & t;
+            normalize();
+            result = (result << 1) + (t + 1);
+        } while (--numBits);
+        return result;
+    };
+    auto decodeLength = [&](uint16_t *lenProbs, const uint32_t posState) -> uint32_t {
+        if (decodeBit(&lenProbs[0]) == 0) {
+            return decodeTree(&lenProbs[2 + (posState << 3)], 3);
+        }
+        if (decodeBit(&lenProbs[1]) == 0) {
+            return 8 + decodeTree(&lenProbs[2 + (c_posStatesMax << 3) + (posState << 3)], 3);
+        }
+        return 16 + decodeTree(&lenProbs[2 + (c_posStatesMax << 3) * 2], 8);
+    };
+
+    while (outPos < target) {
+        const uint32_t posState = outPos & m_pbMask;
+
+        if (decodeBit(&probs[c_isMatch + (state << 4) + posState]) == 0) {
+            const uint32_t prevByte = outPos > 0 ? output[outPos - 1] : 0;
+            const uint32_t litState = ((outPos & m_lpMask) << m_lc) + (prevByte >> (8 - m_lc));
+            uint16_t *literalProbs = &probs[c_literal + 0x300 * litState];
+
+            uint32_t symbol = 1;
+            if (state >= 7) {
+                uint32_t matchByte = output[outPos - rep0 - 1];
+                do {
+                    const uint32_t matchBit = (matchByte >> 7) & 1;
+                    matchByte <<= 1;
+                    const uint32_t bit = decodeBit(&literalProbs[((1 + matchBit) << 8) + symbol]);
+                    symbol = (symbol << 1) | bit;
+                    if (matchBit != bit) {
+                        break;
+                    }
+                } while (symbol < 0x100);
+            }
+            while (symbol < 0x100) {
+                symbol = (symbol << 1) | decodeBit(&literalProbs[symbol]);
+            }
+            output[outPos++] = symbol - 0x100;
+            state = (state < 4) ? 0 : ((state < 10) ? state - 3 : state - 6);
+            continue;
+        }
+
+        uint32_t length;
+        if (decodeBit(&probs[c_isRep + state]) != 0) {
+            if (outPos == 0) {
+                m_status = Status::Error;
+                break;
+            }
+            if (decodeBit(&probs[c_isRepG0 + state]) == 0) {
+                if (decodeBit(&probs[c_isRep0Long + (state << 4) + posState]) == 0) {
+                    // Short rep, a single byte
+                    state = (state < 7) ? 9 : 11;
+                    output[outPos] = output[outPos - rep0 - 1];
+                    outPos++;
+                    continue;
+                }
+            } else {
+                uint32_t distance;
+                if (decodeBit(&probs[c_isRepG1 + state]) == 0) {
+                    distance = rep1;
+                } else {
+                    if (decodeBit(&probs[c_isRepG2 + state]) == 0) {
+                        distance = rep2;
+                    } else {
+                        distance = rep3;
+                        rep3 = rep2;
+                    }
+                    rep2 = rep1;
+                }
+                rep1 = rep0;
+                rep0 = distance;
+            }
+            length = decodeLength(&probs[c_repLenDecoder], posState);
+            state = (state < 7) ? 8 : 11;
+        } else {
+            rep3 = rep2;
+            rep2 = rep1;
+            rep1 = rep0;
+            length = decodeLength(&probs[c_lenDecoder], posState);
+            state = (state < 7) ? 7 : 10;
+
+            const uint32_t lenState = std::min<uint32_t>(length, c_lenToPosStates - 1);
+            const uint32_t posSlot = decodeTree(&probs[c_posSlot + (lenState << 6)], 6);
+            if (posSlot < 4) {
+                rep0 = posSlot;
+            } else {
+                const int directBits = (posSlot >> 1) - 1;
+                rep0 = (2 | (posSlot & 1)) << directBits;
+                if (posSlot < c_endPosModelIndex) {
+                    rep0 += decodeReverseTree(&probs[c_posDecoders + rep0 - posSlot], directBits);
+                } else {
+                    rep0 += decodeDirect(directBits - c_alignBits) << c_alignBits;
+                    rep0 += decodeReverseTree(&probs[c_align], c_alignBits);
+                }
+            }
+            // Also catches the end marker, which a stream of known size shouldn't carry
+            if (rep0 >= outPos) {
+                m_status = Status::Error;
+                break;
+            }
+        }
+
+        length = std::min(length + c_matchMinLen, m_outputSize - outPos);
+        const uint8_t *from = output + outPos - rep0 - 1;
+        uint8_t *to = output + outPos;
+        for (uint32_t i = 0; i < length; i++) {
+            to[i] = from[i];
+        }
+        outPos += length;
+    }
+
+    m_range = range;
+    m_code = code;
+    m_state = state;
+    m_reps[0] = rep0;
+    m_reps[1] = rep1;
+    m_reps[2] = rep2;
+    m_reps[3] = rep3;
+    m_outPos = outPos;
+
+    if (m_status == Status::Running) {
+        if (input->isOverrun()) {
+            m_status = Status::Error;
+        } else if (outPos == m_outputSize) {
+            m_status = Status::Done;
+        }
+    }
+    return m_status;
+}
@@ -14,7 +14,7 @@ int main() {
     initPseudoAtomics();
 
     picostation::initHW();
-    multicore_launch_core1(picostation::core1Entry);  // I2S Thread
+    picostation::launchCore1();  // I2S Thread
 
     picostation::core0Entry();  // Reset, playback speed, Sled, soct, subq
     __builtin_unreachable();
@@ -0,0 +1,128 @@
+#include "menu_image.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/regs/addressmap.h"
+#include "logging.h"
+#include "third_party/iec-60908b/edcecc.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+extern const uint8_t loaderImage[];
+extern const uint32_t loaderImageSize;
+
+namespace {
+constexpr uint8_t c_magic[4] = {'P', 'S', 'M', 'Z'};
+constexpr uint16_t c_version = 1;
+constexpr size_t c_headerSize = 12;
+constexpr uint8_t c_syncHeader[12] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+
+namespace RecordType {
+enum : uint8_t {
+    Raw = 0,         // The whole sector
+    Mode1 = 1,       // User data of a mode 1 sector
+    Mode2Form1 = 2,  // Second copy of the subheader and the user data of a mode 2 sector
+    Mode2Form2 = 3,
+};
+}
+
+inline uint32_t readLE32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+inline uint8_t toBCD(const int value) { return ((value / 10) << 4) | (value % 10); }
+}  // namespace
+
+bool picostation::MenuImage::init() {
+    uintptr_t image = reinterpret_cast<uintptr_t>(loaderImage);
+    if ((image >> 24) == (XIP_BASE >> 24)) {
+        image += XIP_NOCACHE_NOALLOC_BASE - XIP_BASE;
+    }
+    m_image = reinterpret_cast<const uint8_t *>(image);
+
+    if (loaderImageSize < c_headerSize || memcmp(m_image, c_magic, sizeof(c_magic)) != 0 ||
+        (m_image[4] | (m_image[5] << 8)) != c_version) {
+        DEBUG_PRINT("Menu image is not packed\n");
+        return false;
+    }
+    m_sectorCount = readLE32(m_image + 8);
+    if (c_headerSize + (m_sectorCount + 1) * 4 > loaderImageSize) {
+        m_sectorCount = 0;
+        return false;
+    }
+    return true;
+}
+
+bool picostation::MenuImage::readSector(const int adjustedSector, uint8_t *buffer) {
+    if (!m_image && !init()) {
+        return false;
+    }
+    if (adjustedSector < 0 || (uint32_t)adjustedSector >= m_sectorCount) {
+        return false;
+    }
+
+    const uint8_t *offsets = m_image + c_headerSize + adjustedSector * 4;
+    const uint32_t start = readLE32(offsets);
+    const uint32_t end = readLE32(offsets + 4);
+    if (start >= end || end > loaderImageSize) {
+        return false;
+    }
+    const uint8_t type = m_image[start];
+
+    uint8_t *output;
+    uint32_t size;
+    switch (type) {
+        case RecordType::Raw:
+            output = buffer;
+            size = c_cdSamplesBytes;
+            break;
+        case RecordType::Mode1:
+            output = buffer + 16;
+            size = 2048;
+            break;
+        case RecordType::Mode2Form1:
+            output = buffer + 20;
+            size = 4 + 2048;
+            break;
+        case RecordType::Mode2Form2:
+            output = buffer + 20;
+            size = 4 + 2324;
+            break;
+        default:
+            return false;
+    }
+
+    m_input.init(m_image + start + 1, end - start - 1);
+    m_inflate.begin(&m_input, output, size);
+    m_inflate.decode(size);
+    if (m_inflate.getStatus() == Inflate::Status::Error || m_inflate.getOutputPos() != size || m_input.isOverrun()) {
+        DEBUG_PRINT("Menu sector %d failed to decode\n", adjustedSector);
+        return false;
+    }
+    if (type == RecordType::Raw) {
+        return true;
+    }
+
+    const int sector = adjustedSector + c_preGap;
+    memcpy(buffer, c_syncHeader, sizeof(c_syncHeader));
+    buffer[12] = toBCD(sector / 75 / 60);
+    buffer[13] = toBCD((sector / 75) % 60);
+    buffer[14] = toBCD(sector % 75);
+    if (type == RecordType::Mode1) {
+        buffer[15] = 1;
+        compute_mode1_edcecc(buffer);
+    } else {
+        buffer[15] = 2;
+        memcpy(buffer + 16, buffer + 20, 4);
+        compute_mode2_edcecc(buffer, type == RecordType::Mode2Form1 ? 1 : 2);
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#include "mount_arena.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "logging.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+picostation::MountArena picostation::g_mountArena;
+
+void *picostation::MountArena::allocate(const size_t size, const size_t alignment) {
+    const size_t start = (m_used + alignment - 1) & ~(alignment - 1);
+    if (start + size > c_capacity) {
+        m_failures++;
+        DEBUG_PRINT("Mount arena exhausted: %u bytes requested, %u free\n", size, c_capacity - m_used);
+        return nullptr;
+    }
+
+    m_used = start + size;
+    if (m_used > m_peak) {
+        m_peak = m_used;
+    }
+    m_allocations++;
+
+    return &m_buffer[start];
+}
+
+void picostation::MountArena::reset() {
+    m_used = 0;
+    m_allocations = 0;
+}
+
+void picostation::MountArena::release(const size_t mark) {
+    if (mark < m_used) {
+        m_used = mark;
+    }
+}
+
+void picostation::MountArena::printStats() const {
+    DEBUG_PRINT("Mount arena: %u/%u bytes in %u allocations, peak %u, failures %u\n", m_used, c_capacity,
+                m_allocations, m_peak, m_failures);
+}
+
+void *mount_arena_malloc(size_t size) { return picostation::g_mountArena.allocate(size); }
+
+void mount_arena_free(void *ptr) {
+    // Released all at once by MountArena::reset()
+}
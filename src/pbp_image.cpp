@@ -0,0 +1,324 @@
+#include "pbp_image.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+#include "mount_arena.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr uint32_t c_pbpMagic = 0x50425000;  // "\0PBP"
+constexpr uint32_t c_psarOffsetField = 0x24;
+constexpr uint32_t c_discTableOffset = 0x200;  // Offsets of up to 5 discs in a PSTITLEIMG, relative to it
+constexpr uint32_t c_maxDiscs = 5;
+constexpr uint32_t c_tocOffset = 0x800;
+constexpr uint32_t c_indexOffset = 0x4000;
+constexpr uint32_t c_dataOffset = 0x100000;
+constexpr uint32_t c_indexEntryBytes = 32;
+constexpr uint32_t c_maxBlocks = (c_dataOffset - c_indexOffset) / c_indexEntryBytes;
+constexpr uint32_t c_tocEntryBytes = 10;
+
+uint32_t getLE16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+uint32_t getLE32(const uint8_t *data) { return getLE16(data) | (getLE16(data + 2) << 16); }
+int fromBCD(const uint8_t in) { return (in >> 4) * 10 + (in & 0x0F); }
+int msfToSector(const uint8_t *msf) { return (fromBCD(msf[0]) * 60 + fromBCD(msf[1])) * 75 + fromBCD(msf[2]); }
+}  // namespace
+
+bool picostation::PbpImage::isPbpPath(const TCHAR *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcasecmp(extension, ".pbp") == 0;
+}
+
+bool picostation::PbpImage::readAt(const FSIZE_t offset, void *buffer, const UINT size) {
+    UINT br = 0;
+    FRESULT fr = f_lseek(m_file, offset);
+    if (FR_OK == fr) {
+        fr = f_read(m_file, buffer, size, &br);
+    }
+    if (FR_OK != fr || br != size) {
+        DEBUG_PRINT("PBP read error at %llu: %s (%d)\n", (unsigned long long)offset, FRESULT_str(fr), fr);
+        return false;
+    }
+    return true;
+}
+
+FRESULT picostation::PbpImage::open(FilePool &filePool, CueDisc &disc) {
+    close();
+
+    m_file = filePool.acquire(0);
+    if (!m_file) {
+        return FR_NO_FILE;
+    }
+
+    m_discOffset = findDisc();
+    if (m_discOffset == 0 || !parseToc(disc)) {
+        close();
+        return FR_INVALID_OBJECT;
+    }
+
+    m_index = g_mountArena.allocate<uint8_t>(c_entriesPerRead * c_indexEntryBytes);
+    m_inputBuffer = g_mountArena.allocate<uint8_t>(c_inputBufferSize);
+    m_block = static_cast<uint8_t *>(g_mountArena.allocate(c_blockBytes, 4));
+    if (!m_index || !m_inputBuffer || !m_block) {
+        close();
+        return FR_NOT_ENOUGH_CORE;
+    }
+
+    DEBUG_PRINT("PBP: %lu sectors in %lu blocks\n", m_sectorCount, m_blockCount);
+    return FR_OK;
+}
+
+void picostation::PbpImage::close() {
+    m_file = nullptr;
+    m_discOffset = 0;
+    m_sectorCount = 0;
+    m_blockCount = 0;
+    m_index = nullptr;
+    m_indexFirst = UINT32_MAX;
+    m_block = nullptr;
+    m_blockNumber = UINT32_MAX;
+    m_validBytes = 0;
+    m_decoding = false;
+    m_stored = false;
+    m_storedOffset = 0;
+    m_inputBuffer = nullptr;
+}
+
+FSIZE_t picostation::PbpImage::findDisc() {
+    uint8_t header[c_psarOffsetField + 4];
+    if (!readAt(0, header, sizeof(header)) || getLE32(header) != c_pbpMagic) {
+        DEBUG_PRINT("Not a PBP file\n");
+        return 0;
+    }
+
+    FSIZE_t psar = getLE32(header + c_psarOffsetField);
+    char signature[12];
+    if (!readAt(psar, signature, sizeof(signature))) {
+        return 0;
+    }
+
+    if (memcmp(signature, "PSTITLEIMG", 10) == 0) {
+        // Multi-disc, the first disc is the one that boots
+        uint8_t discTable[c_maxDiscs * 4];
+        if (!readAt(psar + c_discTableOffset, discTable, sizeof(discTable))) {
+            return 0;
+        }
+        int discCount = 0;
+        while (discCount < (int)c_maxDiscs && getLE32(discTable + discCount * 4) != 0) {
+            discCount++;
+        }
+        DEBUG_PRINT("PBP holds %d discs, mounting the first\n", discCount);
+        psar += getLE32(discTable);
+        if (discCount == 0 || !readAt(psar, signature, sizeof(signature))) {
+            return 0;
+        }
+    }
+
+    if (memcmp(signature, "PSISOIMG", 8) != 0) {
+        DEBUG_PRINT("Not a PS1 PBP\n");
+        return 0;
+    }
+    return psar;
+}
+
+bool picostation::PbpImage::parseToc(CueDisc &disc) {
+    // Q subchannel style entries: control, zero, point, relative MSF, zero, absolute MSF, all BCD. The first three
+    // are the A0/A1/A2 points giving the first track, last track and lead-out, then one entry per track.
+    const size_t mark = g_mountArena.getUsed();
+    const size_t tocBytes = (MAXTRACK + 1) * c_tocEntryBytes;
+    uint8_t *toc = g_mountArena.allocate<uint8_t>(tocBytes);
+    const bool parsed = toc && readAt(m_discOffset + c_tocOffset, toc, tocBytes) && parseTocEntries(toc, disc);
+    g_mountArena.release(mark);
+    return parsed;
+}
+
+bool picostation::PbpImage::parseTocEntries(const uint8_t *toc, CueDisc &disc) {
+    const int trackCount = fromBCD(toc[c_tocEntryBytes + 7]);
+    const int leadOut = msfToSector(toc + 2 * c_tocEntryBytes + 7) - c_preGap;
+    if (trackCount < 1 || trackCount > MAXTRACK - 2 || leadOut <= 0) {
+        DEBUG_PRINT("Bad PBP TOC: %d tracks, lead-out %d\n", trackCount, leadOut);
+        return false;
+    }
+
+    // The image is one continuous dump, pregaps included, so every track reads from the same place
+    memset(&disc, 0, sizeof(disc));
+    disc.tracks[0].trackType = CueTrackType::TRACK_TYPE_UNKNOWN;
+    for (int i = 1; i <= trackCount; i++) {
+        const uint8_t *entry = toc + (i + 2) * c_tocEntryBytes;
+        CueTrack &cueTrack = disc.tracks[i];
+        cueTrack.indices[1] = (i == 1) ? 0 : msfToSector(entry + 7) - c_preGap;
+        cueTrack.indices[0] = cueTrack.indices[1];
+        cueTrack.indexCount = 2;
+        cueTrack.fileOffset = 0;
+        cueTrack.trackType = (entry[0] & 0x40) ? CueTrackType::TRACK_TYPE_DATA : CueTrackType::TRACK_TYPE_AUDIO;
+        if (i > 1 && cueTrack.indices[1] <= disc.tracks[i - 1].indices[1]) {
+            DEBUG_PRINT("Bad PBP TOC: track %d out of order\n", i);
+            return false;
+        }
+    }
+    for (int i = 1; i <= trackCount; i++) {
+        const uint32_t end = (i < trackCount) ? disc.tracks[i + 1].indices[1] : (uint32_t)leadOut;
+        if (end <= disc.tracks[i].indices[1]) {
+            return false;
+        }
+        disc.tracks[i].size = end - disc.tracks[i].indices[1];
+    }
+    disc.trackCount = trackCount;
+
+    m_sectorCount = leadOut;
+    m_blockCount = (m_sectorCount + c_sectorsPerBlock - 1) / c_sectorsPerBlock;
+    return m_blockCount <= c_maxBlocks;
+}
+
+bool picostation::PbpImage::lookupBlock(const uint32_t block, uint32_t &offset, uint32_t &length) {
+    if (block >= m_blockCount) {
+        return false;
+    }
+    if (m_indexFirst == UINT32_MAX || block - m_indexFirst >= c_entriesPerRead) {
+        // Entries are read a batch at a time, sequential playback only goes back to the index every 16 blocks
+        const uint32_t first = block - block % c_entriesPerRead;
+        const uint32_t count = std::min(c_entriesPerRead, m_blockCount - first);
+        m_indexFirst = UINT32_MAX;
+        if (!readAt(m_discOffset + c_indexOffset + (FSIZE_t)first * c_indexEntryBytes, m_index,
+                    count * c_indexEntryBytes)) {
+            return false;
+        }
+        m_indexFirst = first;
+    }
+    const uint8_t *entry = m_index + (block - m_indexFirst) * c_indexEntryBytes;
+    offset = getLE32(entry);
+    length = getLE16(entry + 4);
+    return length != 0;
+}
+
+bool picostation::PbpImage::startDecode(const uint32_t block) {
+    m_blockNumber = UINT32_MAX;
+    m_validBytes = 0;
+    m_decoding = false;
+    m_stored = false;
+
+    uint32_t offset;
+    uint32_t length;
+    if (!lookupBlock(block, offset, length)) {
+        return false;
+    }
+    const FSIZE_t dataOffset = m_discOffset + c_dataOffset + offset;
+
+    if (length == c_blockBytes) {
+        // Blocks that didn't shrink are stored as is, and read up to what's needed like the others are inflated
+        m_stored = true;
+        m_storedOffset = dataOffset;
+    } else {
+        m_input.init(m_file, dataOffset, length, m_inputBuffer, c_inputBufferSize);
+        m_inflate.begin(&m_input, m_block, c_blockBytes);
+    }
+    m_decoding = true;
+    m_blockNumber = block;
+    return true;
+}
+
+bool picostation::PbpImage::stepDecode(const uint32_t target) {
+    bool failed;
+    if (m_stored) {
+        const uint32_t end = std::min(target, c_blockBytes);
+        failed = !readAt(m_storedOffset + m_validBytes, m_block + m_validBytes, end - m_validBytes);
+        if (!failed) {
+            m_validBytes = end;
+            m_decoding = m_validBytes < c_blockBytes;
+        }
+    } else {
+        const Inflate::Status status = m_inflate.decode(target);
+        m_validBytes = m_inflate.getOutputPos();
+        failed = status == Inflate::Status::Error;
+        m_decoding = status == Inflate::Status::Running;
+    }
+    if (failed) {
+        DEBUG_PRINT("PBP block %lu failed to decode\n", m_blockNumber);
+        m_blockNumber = UINT32_MAX;
+        m_validBytes = 0;
+        m_decoding = false;
+        return false;
+    }
+    return true;
+}
+
+const uint8_t *picostation::PbpImage::getSector(const uint32_t sector) {
+    const uint32_t block = sector / c_sectorsPerBlock;
+    if (block != m_blockNumber && !startDecode(block)) {
+        return nullptr;
+    }
+
+    // The last block of a disc may stop short
+    const uint32_t needed = (sector % c_sectorsPerBlock + 1) * c_cdSamplesBytes;
+    while (m_validBytes < needed) {
+        if (!m_decoding || !stepDecode(needed)) {
+            return nullptr;
+        }
+    }
+    return m_block + (sector % c_sectorsPerBlock) * c_cdSamplesBytes;
+}
+
+bool picostation::PbpImage::readSector(const int adjustedSector, uint8_t *buffer) {
+    if (!m_block || adjustedSector < 0 || (uint32_t)adjustedSector >= m_sectorCount) {
+        return false;
+    }
+    const uint8_t *sector = getSector(adjustedSector);
+    if (!sector) {
+        return false;
+    }
+    memcpy(buffer, sector, c_cdSamplesBytes);
+    return true;
+}
+
+bool picostation::PbpImage::prefetch(const int adjustedSector, SectorCache &sectorCache) {
+    if (!m_block || adjustedSector < 0 || (uint32_t)adjustedSector >= m_sectorCount) {
+        return false;
+    }
+    const uint32_t block = adjustedSector / c_sectorsPerBlock;
+
+    if (m_decoding && (m_blockNumber == block || m_blockNumber == block + 1)) {
+        // At most a sector's worth of decoding per call
+        stepDecode(m_validBytes + c_cdSamplesBytes);
+        return true;
+    }
+    if (m_blockNumber != block || block + 1 >= m_blockCount) {
+        return false;
+    }
+
+    // The current block is complete. Once what's left of it fits a cache line, move it there and start on the next
+    // block, so sequential reads never decode a block twice.
+    const uint32_t blockEnd = (block + 1) * c_sectorsPerBlock;
+    const uint32_t remaining = blockEnd - adjustedSector;
+    if (remaining > SectorCache::c_sectorsPerLine || m_validBytes < c_blockBytes) {
+        return false;
+    }
+    bool cached = true;
+    for (uint32_t sector = adjustedSector; sector < blockEnd; sector++) {
+        cached = cached && sectorCache.contains(sector);
+    }
+    if (!cached) {
+        uint8_t *line = sectorCache.beginFill(adjustedSector);
+        if (!line) {
+            return false;
+        }
+        memcpy(line, m_block + (adjustedSector % c_sectorsPerBlock) * c_cdSamplesBytes, remaining * c_cdSamplesBytes);
+        sectorCache.endFill(line, remaining);
+    }
+    // Only the index may be read here, the block itself is read or inflated a sector per call from now on
+    startDecode(block + 1);
+    return true;
+}
@@ -4,6 +4,7 @@
 #include <time.h>
 
 #include "cmd.h"
+#include "command_ring.h"
 #include "disc_image.h"
 #include "drive_mechanics.h"
 #include "hardware/pwm.h"
@@ -12,7 +13,9 @@
 #include "main.pio.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
+#include "placement.h"
 #include "pseudo_atomics.h"
+#include "sector_clock.h"
 #include "subq.h"
 #include "values.h"
 #include <string.h>
@@ -38,7 +41,14 @@ extern pseudoatomic<int> listReadyState;
 extern pseudoatomic<int> g_listOffset;
 extern pseudoatomic<int> g_entryOffset;
 
-bool picostation::g_subqDelay = false;  // core0: r/w
+// The SDK gives core1 2KB at the top of scratch_x, under the hot code placed there. Mounting an image nests the cue
+// parser, FatFS and the SD driver well past that, so core1 gets its own stack in main SRAM instead. It is painted at
+// launch so the deepest use can be read back.
+static constexpr size_t c_core1StackSize = 8 * 1024;
+static constexpr uint32_t c_stackPaint = 0xC0DEC0DE;
+alignas(8) static uint32_t s_core1Stack[c_core1StackSize / sizeof(uint32_t)];
+
+volatile bool picostation::g_subqDelay = false;  // core0: r/w, also from the command ring and sector clock interrupts
 
 static int s_currentPlaybackSpeed = 1;
 int picostation::g_targetPlaybackSpeed = 1;  // core0: r/w
@@ -60,6 +70,8 @@ enum class ResetType {
 };
 
 static unsigned int s_mechachonOffset;
+static unsigned int s_sensOffset;
+static unsigned int s_xlatOffset;
 unsigned int picostation::g_soctOffset;
 unsigned int picostation::g_subqOffset;
 static ResetType s_resetPending = ResetType::RESET_NONE;
@@ -75,7 +87,7 @@ static picostation::PWMSettings pwmMainClock = {.gpio = Pin::CLK, .wrap = 1, .cl
 
 static void initPWM(picostation::PWMSettings *settings);
 static void interruptHandler(unsigned int gpio, uint32_t events);
-static void interruptHandler(unsigned int gpio, uint32_t events) {
+static void CORE0_FUNC(interruptHandler)(unsigned int gpio, uint32_t events) {
     static uint32_t lastLowEventReset = 0;
     static uint32_t lastLowEventDoor = 0;
     switch (gpio) {
@@ -123,15 +135,13 @@ static void interruptHandler(unsigned int gpio, uint32_t events) {
                 }
             }
         } break;
-        case Pin::XLAT: {
-            m_mechCommand.processLatchedCommand();
-        } break;
     }
 }
 
 [[noreturn]] void __time_critical_func(picostation::core0Entry)() {
     SubQ subq(&g_discImage);
-    uint64_t subqDelayTime = 0;
+    g_sectorClock.init(&subq);
+    g_driveMechanics.init(&m_mechCommand);
 
     g_coreReady[0] = true;
     while (!g_coreReady[1].Load()) {
@@ -146,9 +156,6 @@ static void interruptHandler(unsigned int gpio, uint32_t events) {
             reset();
         }
 
-        // Update latching, output SENS
-        m_mechCommand.updateMechSens();
-
         const int currentSector = g_driveMechanics.getSector();
 
         // Limit Switch
@@ -156,34 +163,25 @@ static void interruptHandler(unsigned int gpio, uint32_t events) {
 
         updatePlaybackSpeed();
 
-        // Soct/Sled/seek
+        // Soct/seek, the sled moves on its own alarm
         if (m_mechCommand.getSoct()) {
             if (pio_sm_get_rx_fifo_level(PIOInstance::SOCT, SM::SOCT)) {
                 pio_sm_drain_tx_fifo(PIOInstance::SOCT, SM::SOCT);
                 m_mechCommand.setSoct(false);
                 pio_sm_set_enabled(PIOInstance::SOCT, SM::SOCT, false);
             }
-        } else if (!g_driveMechanics.isSledStopped()) {
-            g_driveMechanics.moveSled(m_mechCommand);
-        } else if (m_mechCommand.getSens(SENS::GFS)) {
-            if (g_subqDelay) {
-                if ((time_us_64() - subqDelayTime) > c_MaxSubqDelayTime) {
-                    g_subqDelay = false;
-                    subq.start_subq(currentSector);
-
-                    gpio_put(Pin::SCOR, 1);
-                    add_alarm_in_us(
-                        135,
-                        [](alarm_id_t id, void *user_data) -> int64_t {
-                            gpio_put(Pin::SCOR, 0);
-                            return 0;
-                        },
-                        NULL, true);
+        } else if (g_driveMechanics.isSledStopped() && m_mechCommand.getSens(SENS::GFS)) {
+            // The sector clock's alarm sends SubQ and SCOR, this only hands it each sector as the DMA starts on it
+            if (!g_subqDelay && m_i2s.getSectorSending() == currentSector) {
+                subq.prepare_subq(currentSector);
+                // A spindle stop in the command interrupt clears g_subqDelay, it mustn't land between check and set
+                const uint32_t irqState = save_and_disable_interrupts();
+                if (!g_subqDelay && m_mechCommand.getSens(SENS::GFS)) {
+                    g_driveMechanics.moveToNextSector();
+                    g_subqDelay = true;
+                    g_sectorClock.schedule(m_i2s.getLastSectorTime());
                 }
-            } else if (m_i2s.getSectorSending() == currentSector) {
-                g_driveMechanics.moveToNextSector();
-                g_subqDelay = true;
-                subqDelayTime = m_i2s.getLastSectorTime();
+                restore_interrupts(irqState);
             }
         }
 
@@ -209,6 +207,22 @@ static void interruptHandler(unsigned int gpio, uint32_t events) {
     }
 }
 
+void picostation::launchCore1() {
+    for (uint32_t &word : s_core1Stack) {
+        word = c_stackPaint;
+    }
+    multicore_launch_core1_with_stack(core1Entry, s_core1Stack, sizeof(s_core1Stack));
+}
+
+size_t picostation::getCore1StackUsed() {
+    // The stack grows down, whatever is still painted at the bottom was never reached
+    size_t untouched = 0;
+    while (untouched < c_core1StackSize / sizeof(uint32_t) && s_core1Stack[untouched] == c_stackPaint) {
+        untouched++;
+    }
+    return sizeof(s_core1Stack) - untouched * sizeof(uint32_t);
+}
+
 [[noreturn]] void picostation::core1Entry() {
     m_i2s.start(m_mechCommand);
     while (1) asm("");
@@ -264,6 +278,12 @@ void picostation::initHW() {
 
     s_mechachonOffset = pio_add_program(PIOInstance::MECHACON, &mechacon_program);
     mechacon_program_init(PIOInstance::MECHACON, SM::MECHACON, s_mechachonOffset, Pin::CMD_DATA);
+    s_sensOffset = pio_add_program(PIOInstance::SENS, &sens_program);
+    sens_program_init(PIOInstance::SENS, SM::SENS, s_sensOffset, Pin::CMD_DATA, Pin::SENS);
+    m_mechCommand.publishSens();
+    s_xlatOffset = pio_add_program(PIOInstance::XLAT, &xlat_program);
+    xlat_program_init(PIOInstance::XLAT, SM::XLAT, s_xlatOffset, Pin::XLAT);
+    g_commandRing.init(&m_mechCommand);
 
     g_soctOffset = pio_add_program(PIOInstance::SOCT, &soct_program);
     g_subqOffset = pio_add_program(PIOInstance::SUBQ, &subq_program);
@@ -291,9 +311,11 @@ void picostation::initHW() {
 
     gpio_set_irq_enabled_with_callback(Pin::RESET, GPIO_IRQ_LEVEL_LOW, true, &interruptHandler);
     gpio_set_irq_enabled_with_callback(Pin::DOOR, GPIO_IRQ_LEVEL_HIGH, true, &interruptHandler);
-    gpio_set_irq_enabled_with_callback(Pin::XLAT, GPIO_IRQ_EDGE_FALL, true, &interruptHandler);
 
+    // Both count the same clock edges into bytes, they start together while the clock is idle
     pio_sm_set_enabled(PIOInstance::MECHACON, SM::MECHACON, true);
+    pio_sm_set_enabled(PIOInstance::SENS, SM::SENS, true);
+    pio_sm_set_enabled(PIOInstance::XLAT, SM::XLAT, true);
 
     g_coreReady[0] = false;
     g_coreReady[1] = false;
@@ -334,9 +356,11 @@ void picostation::reset() {
     DEBUG_PRINT("RESET!\n");
     pio_sm_set_enabled(PIOInstance::SUBQ, SM::SUBQ, false);
     pio_sm_set_enabled(PIOInstance::SOCT, SM::SOCT, false);
+    pio_sm_set_enabled(PIOInstance::XLAT, SM::XLAT, false);
     pio_sm_restart(PIOInstance::MECHACON, SM::MECHACON);
 
     pio_sm_clear_fifos(PIOInstance::MECHACON, SM::MECHACON);
+    pio_sm_clear_fifos(PIOInstance::XLAT, SM::XLAT);
     pio_sm_clear_fifos(PIOInstance::SOCT, SM::SOCT);
     pio_sm_clear_fifos(PIOInstance::SUBQ, SM::SUBQ);
 
@@ -344,6 +368,9 @@ void picostation::reset() {
     updatePlaybackSpeed();
 
     mechacon_program_init(PIOInstance::MECHACON, SM::MECHACON, s_mechachonOffset, Pin::CMD_DATA);
+    sens_program_init(PIOInstance::SENS, SM::SENS, s_sensOffset, Pin::CMD_DATA, Pin::SENS);
+    m_mechCommand.publishSens();
+    xlat_program_init(PIOInstance::XLAT, SM::XLAT, s_xlatOffset, Pin::XLAT);
     g_subqDelay = false;
     m_mechCommand.setSoct(false);
 
@@ -370,7 +397,11 @@ void picostation::reset() {
         picostation::DirectoryListing::gotoRoot();
     }
 
+    // Bytes from before the reset never get a command boundary of their own
+    g_commandRing.flush();
     pio_sm_set_enabled(PIOInstance::MECHACON, SM::MECHACON, true);
+    pio_sm_set_enabled(PIOInstance::SENS, SM::SENS, true);
+    pio_sm_set_enabled(PIOInstance::XLAT, SM::XLAT, true);
     s_resetPending = ResetType::RESET_NONE;
     gpio_set_irq_enabled(Pin::RESET, GPIO_IRQ_LEVEL_LOW, true);
     gpio_set_irq_enabled(Pin::DOOR, GPIO_IRQ_LEVEL_HIGH, true);
@@ -0,0 +1,250 @@
+#include "ppf_patch.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+#include "mount_arena.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr uint32_t c_headerBytes = 56;      // Magic, encoding and description
+constexpr uint32_t c_ppf3HeaderBytes = 60;  // Plus image type, block check, undo and a spare byte
+constexpr uint32_t c_blockCheckBytes = 1024;
+constexpr char c_dizMarker[4] = {'.', 'D', 'I', 'Z'};  // End of the "@END_FILE_ID.DIZ" trailer
+
+uint32_t getLE16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+uint32_t getLE32(const uint8_t *data) { return getLE16(data) | (getLE16(data + 2) << 16); }
+
+bool readAt(FIL *fp, const FSIZE_t offset, void *buffer, const UINT size) {
+    UINT br = 0;
+    return f_lseek(fp, offset) == FR_OK && f_read(fp, buffer, size, &br) == FR_OK && br == size;
+}
+}  // namespace
+
+bool picostation::PpfPatch::parseHeader(FIL *file, uint32_t &dataStart, uint32_t &dataEnd) {
+    const FSIZE_t fileSize = f_size(file);
+    uint8_t header[c_ppf3HeaderBytes];
+    if (fileSize < c_headerBytes || fileSize > UINT32_MAX ||
+        !readAt(file, 0, header, std::min<FSIZE_t>(fileSize, sizeof(header))) || memcmp(header, "PPF", 3) != 0) {
+        return false;
+    }
+
+    // PPF 2.0 and 3.0 may end with a FILE_ID.DIZ description, its length comes last
+    uint8_t trailer[8];
+    uint32_t dizBytes = 0;
+    if (header[3] == '1' && header[4] == '0') {
+        dataStart = c_headerBytes;
+    } else if (header[3] == '2' && header[4] == '0') {
+        dataStart = c_headerBytes + 4 + c_blockCheckBytes;
+        if (fileSize >= dataStart + sizeof(trailer) && readAt(file, fileSize - 8, trailer, 8) &&
+            memcmp(trailer, c_dizMarker, sizeof(c_dizMarker)) == 0) {
+            dizBytes = getLE32(trailer + 4) + 38;
+        }
+    } else if (header[3] == '3' && header[4] == '0' && fileSize >= c_ppf3HeaderBytes) {
+        // Image type 0 is a bin, the only kind there is here
+        if (header[56] != 0) {
+            return false;
+        }
+        dataStart = header[57] ? c_ppf3HeaderBytes + c_blockCheckBytes : c_ppf3HeaderBytes;
+        m_longOffsets = true;
+        m_hasUndo = header[58] != 0;
+        if (fileSize >= dataStart + 6 && readAt(file, fileSize - 6, trailer, 6) &&
+            memcmp(trailer, c_dizMarker, sizeof(c_dizMarker)) == 0) {
+            dizBytes = getLE16(trailer + 4) + 36;
+        }
+    } else {
+        return false;
+    }
+    DEBUG_PRINT("PPF %c.0, records from %u\n", header[3], dataStart);
+
+    dataEnd = fileSize - std::min<uint32_t>(dizBytes, fileSize);
+    return dataStart <= dataEnd;
+}
+
+bool picostation::PpfPatch::readRecordHeader(InputStream &input, uint64_t &offset, uint8_t &length) {
+    uint8_t header[9];
+    const uint32_t offsetBytes = m_longOffsets ? 8 : 4;
+    input.read(header, offsetBytes + 1);
+    offset = getLE32(header);
+    if (m_longOffsets) {
+        offset |= (uint64_t)getLE32(header + 4) << 32;
+    }
+    length = header[offsetBytes];
+    return !input.isOverrun();
+}
+
+void picostation::PpfPatch::addRecord(const uint32_t recordOffset, const uint32_t recordLength, const int first,
+                                      const int last) {
+    while (true) {
+        if (m_segmentCount > 0) {
+            // Carry on with the segment if the record is within its reach
+            Segment &current = m_segments[m_segmentCount - 1];
+            if (recordOffset == current.offset + current.length && first >= current.firstSector &&
+                last < current.firstSector + (int)m_segmentSpan) {
+                current.lastSector = std::max(current.lastSector, last);
+                current.length += recordLength;
+                return;
+            }
+        }
+        if (m_segmentCount < c_maxSegments) {
+            m_segments[m_segmentCount++] = {first, last, recordOffset, recordLength};
+            return;
+        }
+
+        // Index full: merge neighbours, which are always next to each other in the file, and double the reach
+        for (uint32_t i = 0; i < m_segmentCount / 2; i++) {
+            const Segment &a = m_segments[2 * i];
+            const Segment &b = m_segments[2 * i + 1];
+            m_segments[i] = {std::min(a.firstSector, b.firstSector), std::max(a.lastSector, b.lastSector), a.offset,
+                             a.length + b.length};
+        }
+        if (m_segmentCount & 1) {
+            m_segments[m_segmentCount / 2] = m_segments[m_segmentCount - 1];
+        }
+        m_segmentCount = (m_segmentCount + 1) / 2;
+        m_segmentSpan *= 2;
+    }
+}
+
+bool picostation::PpfPatch::load(FilePool &filePool, const int fileIndex) {
+    clear();
+    FIL *file = filePool.acquire(fileIndex);
+    uint32_t dataStart;
+    uint32_t dataEnd;
+    if (!file || !parseHeader(file, dataStart, dataEnd)) {
+        clear();
+        return false;
+    }
+
+    // Room for as many segments as the index may hold, what the scan doesn't use is handed back after it
+    const size_t mark = g_mountArena.getUsed();
+    m_segments = g_mountArena.allocate<Segment>(c_maxSegments);
+    uint8_t *scanBuffer = g_mountArena.allocate<uint8_t>(c_scanBufferSize);
+    bool valid = m_segments && scanBuffer;
+
+    InputStream input;
+    input.init(file, dataStart, dataEnd - dataStart, scanBuffer, c_scanBufferSize);
+    while (valid && input.getConsumed() < dataEnd - dataStart) {
+        const uint32_t recordOffset = dataStart + input.getConsumed();
+        uint64_t offset;
+        uint8_t length;
+        valid = readRecordHeader(input, offset, length);
+        input.skip(m_hasUndo ? 2 * length : length);
+        valid = valid && !input.isOverrun();
+        const uint64_t lastSector = (offset + length - 1) / c_cdSamplesBytes;
+        if (valid && length > 0 && lastSector <= INT32_MAX) {
+            addRecord(recordOffset, dataStart + input.getConsumed() - recordOffset, offset / c_cdSamplesBytes,
+                      lastSector);
+        }
+    }
+
+    // Same mark, same alignment: the segments stay where they are, only the tail and the scan buffer go
+    g_mountArena.release(mark);
+    if (!valid || m_segmentCount == 0 || g_mountArena.allocate<Segment>(m_segmentCount) != m_segments ||
+        !(m_readBuffer = g_mountArena.allocate<uint8_t>(c_readBufferSize))) {
+        DEBUG_PRINT("Bad or empty PPF\n");
+        g_mountArena.release(mark);
+        clear();
+        return false;
+    }
+
+    m_filePool = &filePool;
+    m_fileIndex = fileIndex;
+    int lastSector = 0;
+    for (uint32_t i = 0; i < m_segmentCount; i++) {
+        m_sorted = m_sorted && (i == 0 || m_segments[i].firstSector > m_segments[i - 1].lastSector);
+        lastSector = std::max(lastSector, m_segments[i].lastSector);
+    }
+    while (((uint32_t)lastSector >> m_bucketShift) >= c_bucketCount) {
+        m_bucketShift++;
+    }
+    for (uint32_t i = 0; i < m_segmentCount; i++) {
+        for (uint32_t bucket = (uint32_t)m_segments[i].firstSector >> m_bucketShift;
+             bucket <= ((uint32_t)m_segments[i].lastSector >> m_bucketShift); bucket++) {
+            m_buckets[bucket / 32] |= 1u << (bucket % 32);
+        }
+    }
+    DEBUG_PRINT("PPF: %u segments of up to %u sectors\n", m_segmentCount, m_segmentSpan);
+    return true;
+}
+
+void picostation::PpfPatch::clear() {
+    m_filePool = nullptr;
+    m_fileIndex = -1;
+    m_longOffsets = false;
+    m_hasUndo = false;
+    m_sorted = true;
+    m_segments = nullptr;
+    m_segmentCount = 0;
+    m_segmentSpan = 1;
+    m_readBuffer = nullptr;
+    m_bucketShift = 0;
+    memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+void picostation::PpfPatch::applySegment(const Segment &segment, const int sector, uint8_t *buffer) {
+    FIL *file = m_filePool->acquire(m_fileIndex);
+    if (!file) {
+        return;
+    }
+
+    const uint64_t sectorStart = (uint64_t)sector * c_cdSamplesBytes;
+    m_input.init(file, segment.offset, segment.length, m_readBuffer, c_readBufferSize);
+    while (m_input.getConsumed() < segment.length) {
+        uint64_t offset;
+        uint8_t length;
+        if (!readRecordHeader(m_input, offset, length)) {
+            return;
+        }
+        uint32_t used = 0;
+        if (offset + length > sectorStart && offset < sectorStart + c_cdSamplesBytes) {
+            const uint32_t skipped = (offset < sectorStart) ? sectorStart - offset : 0;
+            const uint32_t position = offset + skipped - sectorStart;
+            const uint32_t count = std::min<uint32_t>(length - skipped, c_cdSamplesBytes - position);
+            m_input.skip(skipped);
+            m_input.read(buffer + position, count);
+            used = skipped + count;
+        }
+        m_input.skip(length - used + (m_hasUndo ? length : 0));
+    }
+}
+
+void picostation::PpfPatch::applySegments(const int sector, uint8_t *buffer) {
+    if (!m_sorted) {
+        // Records out of order, every segment that reaches the sector is applied in file order
+        for (uint32_t i = 0; i < m_segmentCount; i++) {
+            if (sector >= m_segments[i].firstSector && sector <= m_segments[i].lastSector) {
+                applySegment(m_segments[i], sector, buffer);
+            }
+        }
+        return;
+    }
+
+    // Last segment starting at or before the sector
+    uint32_t low = 0;
+    uint32_t high = m_segmentCount;
+    while (low < high) {
+        const uint32_t middle = (low + high) / 2;
+        if (m_segments[middle].firstSector <= sector) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low > 0 && sector <= m_segments[low - 1].lastSector) {
+        applySegment(m_segments[low - 1], sector, buffer);
+    }
+}
@@ -0,0 +1,82 @@
+#include "sector_cache.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mount_arena.h"
+
+void picostation::SectorCache::init(const size_t budgetBytes) {
+    m_lineCount = 0;
+    m_useCounter = 0;
+
+    size_t lineCount = budgetBytes / c_lineBytes;
+    if (lineCount > c_maxLines) {
+        lineCount = c_maxLines;
+    }
+
+    for (size_t i = 0; i < lineCount; i++) {
+        uint8_t *data = static_cast<uint8_t *>(g_mountArena.allocate(c_lineBytes, 4));
+        if (!data) {
+            break;
+        }
+        m_lines[m_lineCount++].data = data;
+    }
+
+    clear();
+}
+
+void picostation::SectorCache::clear() {
+    for (size_t i = 0; i < m_lineCount; i++) {
+        m_lines[i].sectorCount = 0;
+        m_lines[i].lastUse = 0;
+    }
+}
+
+bool picostation::SectorCache::contains(const int sector) const {
+    for (size_t i = 0; i < m_lineCount; i++) {
+        const Line &line = m_lines[i];
+        if (sector >= line.firstSector && sector < line.firstSector + line.sectorCount) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const uint8_t *picostation::SectorCache::find(const int sector) {
+    for (size_t i = 0; i < m_lineCount; i++) {
+        Line &line = m_lines[i];
+        if (sector >= line.firstSector && sector < line.firstSector + line.sectorCount) {
+            line.lastUse = ++m_useCounter;
+            return line.data + (sector - line.firstSector) * c_cdSamplesBytes;
+        }
+    }
+    return nullptr;
+}
+
+uint8_t *picostation::SectorCache::beginFill(const int firstSector) {
+    if (m_lineCount == 0) {
+        return nullptr;
+    }
+
+    Line *victim = &m_lines[0];
+    for (size_t i = 1; i < m_lineCount; i++) {
+        if (m_lines[i].lastUse < victim->lastUse) {
+            victim = &m_lines[i];
+        }
+    }
+
+    // Invalid until the read completes
+    victim->firstSector = firstSector;
+    victim->sectorCount = 0;
+    victim->lastUse = ++m_useCounter;
+    return victim->data;
+}
+
+void picostation::SectorCache::endFill(uint8_t *data, const int sectorCount) {
+    for (size_t i = 0; i < m_lineCount; i++) {
+        if (m_lines[i].data == data) {
+            m_lines[i].sectorCount = sectorCount;
+            return;
+        }
+    }
+}
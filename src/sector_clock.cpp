@@ -0,0 +1,55 @@
+#include "sector_clock.h"
+
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include "picostation.h"
+#include "placement.h"
+#include "values.h"
+
+picostation::SectorClock picostation::g_sectorClock;
+
+void picostation::SectorClock::init(SubQ *subq) {
+    m_subq = subq;
+    m_alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(m_alarm, alarmHandler);
+}
+
+void CORE0_FUNC(picostation::SectorClock::schedule)(const uint64_t sectorStartTime) {
+    const uint32_t irqState = save_and_disable_interrupts();
+    if (m_scorHigh) {
+        // Only after a seek, the previous pulse is cut short rather than left high
+        gpio_put(Pin::SCOR, 0);
+        m_scorHigh = false;
+    }
+    const bool missed =
+        hardware_alarm_set_target(m_alarm, from_us_since_boot(sectorStartTime + c_MaxSubqDelayTime));
+    restore_interrupts(irqState);
+
+    if (missed) {
+        // The loop got here late, send it now like the polled version did
+        fire();
+    }
+}
+
+void CORE0_FUNC(picostation::SectorClock::alarmHandler)(unsigned int alarmNum) { g_sectorClock.fire(); }
+
+void CORE0_FUNC(picostation::SectorClock::fire)() {
+    if (m_scorHigh) {
+        gpio_put(Pin::SCOR, 0);
+        m_scorHigh = false;
+        return;
+    }
+    if (!g_subqDelay) {
+        return;
+    }
+    g_subqDelay = false;
+
+    m_subq->start_subq();
+    gpio_put(Pin::SCOR, 1);
+    m_scorHigh = true;
+    if (hardware_alarm_set_target(m_alarm, make_timeout_time_us(c_scorPulseTime))) {
+        gpio_put(Pin::SCOR, 0);
+        m_scorHigh = false;
+    }
+}
@@ -9,6 +9,7 @@
 #include "logging.h"
 #include "main.pio.h"
 #include "picostation.h"
+#include "placement.h"
 #include "values.h"
 
 #if DEBUG_SUBQ
@@ -23,8 +24,19 @@ void picostation::SubQ::printf_subq(const uint8_t *data) {
     }
 }
 
-void picostation::SubQ::start_subq(const int sector) {
-    const SubQ::Data tracksubq = m_discImage->generateSubQ(sector);
+void picostation::SubQ::prepare_subq(const int sector) {
+    m_frame = m_discImage->generateSubQ(sector);
+
+#if DEBUG_SUBQ
+    if (sector % 50 == 0) {
+        printf_subq(m_frame.raw);
+        DEBUG_PRINT("%d\n", sector);
+    }
+#endif
+}
+
+void CORE0_FUNC(picostation::SubQ::start_subq)() {
+    const SubQ::Data &tracksubq = m_frame;
     subq_program_init(PIOInstance::SUBQ, SM::SUBQ, g_subqOffset, Pin::SQSO, Pin::SQCK);
     pio_sm_clear_fifos(PIOInstance::SUBQ, SM::SUBQ);
     pio_sm_set_enabled(PIOInstance::SUBQ, SM::SUBQ, true);
@@ -36,16 +48,9 @@ void picostation::SubQ::start_subq(const int sector) {
     pio_sm_put_blocking(PIOInstance::SUBQ, SM::SUBQ, sub[0]);
     pio_sm_put_blocking(PIOInstance::SUBQ, SM::SUBQ, sub[1]);
     pio_sm_put_blocking(PIOInstance::SUBQ, SM::SUBQ, sub[2]);
-
-#if DEBUG_SUBQ
-    if (sector % 50 == 0) {
-        printf_subq(tracksubq.raw);
-        DEBUG_PRINT("%d\n", sector);
-    }
-#endif
 }
 
-void picostation::SubQ::stop_subq() {
+void CORE0_FUNC(picostation::SubQ::stop_subq)() {
     pio_sm_set_enabled(PIOInstance::SUBQ, SM::SUBQ, false);
     pio_sm_restart(PIOInstance::SUBQ, SM::SUBQ);
     pio_sm_clear_fifos(PIOInstance::SUBQ, SM::SUBQ);
@@ -0,0 +1,158 @@
+#include "subq_patches.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ccd_image.h"
+#include "f_util.h"
+#include "ff.h"
+#include "global.h"
+#include "input_stream.h"
+#include "logging.h"
+#include "mount_arena.h"
+#include "values.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr uint8_t c_sbiMagic[4] = {'S', 'B', 'I', '\0'};
+
+// SBI entry types: the whole frame without its CRC, or just the relative or absolute time
+constexpr uint8_t c_sbiFrame = 1;
+constexpr uint8_t c_sbiRelative = 2;
+constexpr uint8_t c_sbiAbsolute = 3;
+
+int fromBCD(const uint8_t in) { return (in >> 4) * 10 + (in & 0x0F); }
+int msfToSector(const uint8_t *msf) { return (fromBCD(msf[0]) * 60 + fromBCD(msf[1])) * 75 + fromBCD(msf[2]); }
+}  // namespace
+
+bool picostation::SubQPatches::load(const TCHAR *imagePath) {
+    clear();
+
+    static constexpr const char *c_extensions[] = {".sbi", ".lsd"};
+    for (const char *extension : c_extensions) {
+        TCHAR path[c_maxFilePathLength + 1];
+        FIL file;
+        if (!CcdImage::getSiblingPath(imagePath, extension, path) ||
+            f_open(&file, path, FA_READ | FA_OPEN_EXISTING) != FR_OK) {
+            continue;
+        }
+        const bool parsed = parse(&file, extension[1] == 'l');
+        f_close(&file);
+        if (parsed) {
+            DEBUG_PRINT("%u SubQ patches from %s\n", m_count, path);
+            return true;
+        }
+        DEBUG_PRINT("Can't use %s\n", path);
+        clear();
+    }
+    return false;
+}
+
+void picostation::SubQPatches::clear() {
+    m_patches = nullptr;
+    m_count = 0;
+    m_bucketShift = 0;
+    memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+bool picostation::SubQPatches::parse(FIL *file, const bool lsd) {
+    const FSIZE_t fileSize = f_size(file);
+    if (fileSize > c_maxFileSize) {
+        return false;
+    }
+
+    uint8_t buffer[256];
+    InputStream input;
+    input.init(file, 0, fileSize, buffer, sizeof(buffer));
+    uint32_t capacity = fileSize / c_lsdEntryBytes;
+    if (!lsd) {
+        uint8_t magic[sizeof(c_sbiMagic)];
+        if (input.read(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, c_sbiMagic, sizeof(magic)) != 0) {
+            return false;
+        }
+        capacity = (fileSize - sizeof(c_sbiMagic)) / 7;  // Shortest entry
+    }
+    m_patches = g_mountArena.allocate<Patch>(capacity);
+    if (!m_patches) {
+        return false;
+    }
+
+    while (m_count < capacity && input.getConsumed() < fileSize) {
+        uint8_t msf[3];
+        input.read(msf, sizeof(msf));
+        Patch &patch = m_patches[m_count];
+        patch.sector = msfToSector(msf) - c_preGap;
+        memset(patch.q, 0, sizeof(patch.q));
+        if (lsd) {
+            patch.offset = 0;
+            patch.length = sizeof(patch.q);
+            input.read(patch.q, sizeof(patch.q));
+            // Dumped straight off the disc, where the CRC is stored inverted
+            patch.q[10] = ~patch.q[10];
+            patch.q[11] = ~patch.q[11];
+        } else {
+            const uint8_t type = input.readByte();
+            if (type == c_sbiFrame) {
+                patch.offset = 0;
+                patch.length = 10;
+            } else if (type == c_sbiRelative || type == c_sbiAbsolute) {
+                patch.offset = (type == c_sbiRelative) ? 3 : 7;
+                patch.length = 3;
+            } else {
+                return false;
+            }
+            input.read(patch.q + patch.offset, patch.length);
+        }
+        if (input.isOverrun() || patch.sector < 0) {
+            return false;
+        }
+        m_count++;
+    }
+    if (m_count == 0) {
+        return false;
+    }
+
+    // Dumps are normally in order already, which makes this a single pass
+    for (uint32_t i = 1; i < m_count; i++) {
+        const Patch patch = m_patches[i];
+        uint32_t j = i;
+        for (; j > 0 && m_patches[j - 1].sector > patch.sector; j--) {
+            m_patches[j] = m_patches[j - 1];
+        }
+        m_patches[j] = patch;
+    }
+    while ((uint32_t)m_patches[m_count - 1].sector >> m_bucketShift >= c_bucketCount) {
+        m_bucketShift++;
+    }
+    for (uint32_t i = 0; i < m_count; i++) {
+        const uint32_t bucket = (uint32_t)m_patches[i].sector >> m_bucketShift;
+        m_buckets[bucket / 32] |= 1u << (bucket % 32);
+    }
+    return true;
+}
+
+picostation::SubQPatches::Patched picostation::SubQPatches::applyPatch(const int sector, SubQ::Data &data) const {
+    uint32_t low = 0;
+    uint32_t high = m_count;
+    while (low < high) {
+        const uint32_t middle = (low + high) / 2;
+        if (m_patches[middle].sector < sector) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == m_count || m_patches[low].sector != sector) {
+        return Patched::None;
+    }
+    const Patch &patch = m_patches[low];
+    memcpy(data.raw + patch.offset, patch.q + patch.offset, patch.length);
+    return (patch.length == sizeof(patch.q)) ? Patched::WithCrc : Patched::WithoutCrc;
+}
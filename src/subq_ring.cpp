@@ -0,0 +1,48 @@
+#include "subq_ring.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hardware/sync.h"
+#include "mount_arena.h"
+
+bool picostation::SubQRing::init(const size_t entries) {
+    m_entries = g_mountArena.allocate<Entry>(entries);
+    if (!m_entries) {
+        return false;
+    }
+    m_mask = entries - 1;
+    for (size_t i = 0; i < entries; i++) {
+        m_entries[i].sector = -1;
+    }
+    return true;
+}
+
+void picostation::SubQRing::store(const int sector, const uint8_t *q) {
+    Entry &entry = m_entries[sector & m_mask];
+    entry.sector = -1;
+    __dmb();
+    memcpy(entry.q, q, sizeof(entry.q));
+    __dmb();
+    entry.sector = sector;
+}
+
+bool picostation::SubQRing::load(const int sector, SubQ::Data &data) const {
+    if (!m_entries || sector < 0) {
+        return false;
+    }
+    const Entry &entry = m_entries[sector & m_mask];
+    if (entry.sector != sector) {
+        return false;
+    }
+    SubQ::Data copy;
+    __dmb();
+    memcpy(copy.raw, entry.q, sizeof(copy.raw));
+    __dmb();
+    if (entry.sector != sector) {
+        return false;
+    }
+    data = copy;
+    return true;
+}
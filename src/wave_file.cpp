@@ -0,0 +1,82 @@
+#include "wave_file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "f_util.h"
+#include "ff.h"
+#include "logging.h"
+#include "mount_arena.h"
+
+#if DEBUG_CUE
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINT(...) while (0)
+#endif
+
+namespace {
+constexpr int c_maxChunks = 32;
+
+constexpr uint16_t c_formatPcm = 0x0001;
+constexpr uint16_t c_formatExtensible = 0xFFFE;
+
+uint32_t getLE16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+uint32_t getLE32(const uint8_t *data) { return getLE16(data) | (getLE16(data + 2) << 16); }
+
+bool readAt(FIL *fp, const FSIZE_t offset, void *buffer, const UINT size) {
+    UINT br = 0;
+    return f_lseek(fp, offset) == FR_OK && f_read(fp, buffer, size, &br) == FR_OK && br == size;
+}
+}  // namespace
+
+bool picostation::WaveFile::isWavePath(const TCHAR *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcasecmp(extension, ".wav") == 0;
+}
+
+picostation::WaveFile::Header picostation::WaveFile::readHeader(const TCHAR *path, uint32_t &dataOffset,
+                                                               uint32_t &dataSize) {
+    // The handle is only needed for the parse, core1's stack has no room for it
+    const size_t arenaMark = g_mountArena.getUsed();
+    FIL *fp = g_mountArena.allocate<FIL>();
+    if (!fp || f_open(fp, path, FA_READ | FA_OPEN_EXISTING) != FR_OK) {
+        g_mountArena.release(arenaMark);
+        return Header::Raw;
+    }
+    const FSIZE_t fileSize = f_size(fp);
+
+    Header result = Header::Raw;
+    bool hasFormat = false;
+    uint8_t header[16];
+    if (readAt(fp, 0, header, 12) && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0) {
+        // Playing a RIFF file from its first byte would only be noise, so it either parses or is refused
+        result = Header::Unsupported;
+        FSIZE_t offset = 12;
+        for (int i = 0; i < c_maxChunks && result == Header::Unsupported && readAt(fp, offset, header, 8); i++) {
+            const uint32_t chunkSize = getLE32(header + 4);
+            if (memcmp(header, "fmt ", 4) == 0 && chunkSize >= 16 && readAt(fp, offset + 8, header, 16)) {
+                const uint16_t format = getLE16(header);
+                if ((format != c_formatPcm && format != c_formatExtensible) || getLE16(header + 2) != 2 ||
+                    getLE32(header + 4) != 44100 || getLE16(header + 14) != 16) {
+                    DEBUG_PRINT("%s isn't 16-bit stereo 44.1kHz PCM\n", path);
+                    break;
+                }
+                hasFormat = true;
+            } else if (memcmp(header, "data", 4) == 0 && hasFormat) {
+                // Writers that stream the file may leave the size unset, the file size bounds it either way
+                dataOffset = offset + 8;
+                dataSize = std::min<FSIZE_t>(chunkSize, fileSize - dataOffset);
+                result = Header::Pcm;
+            }
+            offset += 8 + chunkSize + (chunkSize & 1);
+        }
+    }
+    f_close(fp);
+    g_mountArena.release(arenaMark);
+    return result;
+}
@@ -36,6 +36,15 @@ SOFTWARE.
 #include "cueparser/fileabstract.h"
 #include "cueparser/scheduler.h"
 
+#ifdef CUSTOM_ALLOCATOR
+#include "mount_arena.h"
+#define CUE_MALLOC mount_arena_malloc
+#define CUE_FREE mount_arena_free
+#else
+#define CUE_MALLOC malloc
+#define CUE_FREE free
+#endif
+
 #pragma GCC diagnostic ignored "-Wswitch"
 
 enum Keyword {
@@ -92,7 +101,7 @@ struct end_Closure {
     const char* error;
 };
 
-static void closure_generic_free(struct CueClosure* closure) { free(closure); }
+static void closure_generic_free(struct CueClosure* closure) { CUE_FREE(closure); }
 
 static void end_closure_call(struct CueClosure* closure_) {
     struct end_Closure* closure = (struct end_Closure*)closure_;
@@ -203,8 +212,11 @@ static int32_t timecodeToSectorNumber(char* timecode) {
 }
 
 void end_parse(struct CueParser* parser, struct CueScheduler* scheduler, const char* error) {
-    struct end_Closure* closure = malloc(sizeof(struct end_Closure));
-    assert(closure);
+    struct end_Closure* closure = CUE_MALLOC(sizeof(struct end_Closure));
+    if (!closure) {
+        Scheduler_fail(scheduler, error ? error : "out of memory ending the cuesheet parse");
+        return;
+    }
     closure->destroy = closure_generic_free;
     closure->call = end_closure_call;
     closure->parser = parser;
@@ -348,8 +360,11 @@ static void parse(struct CueParser* parser, struct CueFile* file, struct CueSche
                     end_parse(parser, scheduler, "cuesheet FILE missing its filename argument");
                     return;
                 } else {
-                    struct CueFile* binaryFile = malloc(sizeof(struct CueFile));
-                    assert(binaryFile);
+                    struct CueFile* binaryFile = CUE_MALLOC(sizeof(struct CueFile));
+                    if (!binaryFile) {
+                        end_parse(parser, scheduler, "out of memory opening a cuesheet FILE");
+                        return;
+                    }
                     binaryFile->user = file;
                     if (parser->isTrackANewFile) {
                         end_parse(parser, scheduler, "cuesheet has too many FILE without TRACK");
@@ -365,7 +380,7 @@ static void parse(struct CueParser* parser, struct CueFile* file, struct CueSche
                     }
                     if (!parser->open(binaryFile, scheduler, parser->word)) {
                         binaryFile->destroy(binaryFile);
-                        free(binaryFile);
+                        CUE_FREE(binaryFile);
                         end_parse(parser, scheduler, "cuesheet references a file that can't be found");
                         return;
                     }
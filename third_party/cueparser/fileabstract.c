@@ -31,7 +31,16 @@ SOFTWARE.
 
 #include "cueparser/scheduler.h"
 
-static void closure_generic_free(struct CueClosure *closure) { free(closure); }
+#ifdef CUSTOM_ALLOCATOR
+#include "mount_arena.h"
+#define CUE_MALLOC mount_arena_malloc
+#define CUE_FREE mount_arena_free
+#else
+#define CUE_MALLOC malloc
+#define CUE_FREE free
+#endif
+
+static void closure_generic_free(struct CueClosure *closure) { CUE_FREE(closure); }
 
 struct close_Closure {
     struct CueScheduler *scheduler;
@@ -49,7 +58,11 @@ static void close_closure_call(struct CueClosure *closure_) {
 
 void File_schedule_close(struct CueFile *file, struct CueScheduler *scheduler,
                          void (*cb)(struct CueFile *, struct CueScheduler *)) {
-    struct close_Closure *closure = malloc(sizeof(struct close_Closure));
+    struct close_Closure *closure = CUE_MALLOC(sizeof(struct close_Closure));
+    if (!closure) {
+        Scheduler_fail(scheduler, "out of memory for a file close callback");
+        return;
+    }
     closure->destroy = closure_generic_free;
     closure->call = close_closure_call;
     closure->file = file;
@@ -74,7 +87,11 @@ static void size_closure_call(struct CueClosure *closure_) {
 
 void File_schedule_size(struct CueFile *file, struct CueScheduler *scheduler, uint64_t size,
                         void (*cb)(struct CueFile *, struct CueScheduler *, uint64_t)) {
-    struct size_Closure *closure = malloc(sizeof(struct size_Closure));
+    struct size_Closure *closure = CUE_MALLOC(sizeof(struct size_Closure));
+    if (!closure) {
+        Scheduler_fail(scheduler, "out of memory for a file size callback");
+        return;
+    }
     closure->destroy = closure_generic_free;
     closure->call = size_closure_call;
     closure->file = file;
@@ -103,7 +120,11 @@ void File_schedule_read(struct CueFile *file, struct CueScheduler *scheduler, in
                         uint8_t *buffer,
                         void (*cb)(struct CueFile *, struct CueScheduler *, int error, uint32_t amount,
                                    uint8_t *buffer)) {
-    struct read_Closure *closure = malloc(sizeof(struct read_Closure));
+    struct read_Closure *closure = CUE_MALLOC(sizeof(struct read_Closure));
+    if (!closure) {
+        Scheduler_fail(scheduler, "out of memory for a file read callback");
+        return;
+    }
     closure->destroy = closure_generic_free;
     closure->call = read_closure_call;
     closure->file = file;
@@ -132,7 +153,11 @@ static void write_closure_call(struct CueClosure *closure_) {
 
 void File_schedule_write(struct CueFile *file, struct CueScheduler *scheduler, int error, uint32_t amount,
                          void (*cb)(struct CueFile *, struct CueScheduler *, int error, uint32_t amount)) {
-    struct write_Closure *closure = malloc(sizeof(struct write_Closure));
+    struct write_Closure *closure = CUE_MALLOC(sizeof(struct write_Closure));
+    if (!closure) {
+        Scheduler_fail(scheduler, "out of memory for a file write callback");
+        return;
+    }
     closure->destroy = closure_generic_free;
     closure->call = write_closure_call;
     closure->file = file;
@@ -33,7 +33,10 @@ int Scheduler_hasPendingEvents(struct CueScheduler *scheduler) { return 0; }
 void Scheduler_processEvents(struct CueScheduler *scheduler) {}
 #endif
 
-void Scheduler_construct(struct CueScheduler *scheduler) { scheduler->top = NULL; }
+void Scheduler_construct(struct CueScheduler *scheduler) {
+    scheduler->top = NULL;
+    scheduler->error = NULL;
+}
 
 void Scheduler_schedule(struct CueScheduler *scheduler, struct CueClosure *closure) {
     closure->scheduler = scheduler;
@@ -41,11 +44,23 @@ void Scheduler_schedule(struct CueScheduler *scheduler, struct CueClosure *closu
     scheduler->top = closure;
 }
 
+// The callback that should have run is lost, so nothing after it can run either
+void Scheduler_fail(struct CueScheduler *scheduler, const char *error) {
+    if (!scheduler->error) {
+        scheduler->error = error;
+    }
+}
+
 void Scheduler_run(struct CueScheduler *scheduler) {
-    while (scheduler->top || Scheduler_hasPendingEvents(scheduler)) {
+    while (!scheduler->error && (scheduler->top || Scheduler_hasPendingEvents(scheduler))) {
         Scheduler_run_once(scheduler);
         Scheduler_processEvents(scheduler);
     }
+    while (scheduler->top) {
+        struct CueClosure *closure = scheduler->top;
+        scheduler->top = closure->next;
+        closure->destroy(closure);
+    }
 }
 
 void Scheduler_run_once(struct CueScheduler *scheduler) {
@@ -42,12 +42,14 @@ struct CueClosure {
 struct CueScheduler {
     struct CueClosure *top;
     void *opaque;
+    const char *error;  // Set when a closure couldn't be allocated, the run stops there
 };
 
 void Scheduler_construct(struct CueScheduler *);
 int Scheduler_hasPendingEvents(struct CueScheduler *);
 void Scheduler_processEvents(struct CueScheduler *);
 void Scheduler_schedule(struct CueScheduler *, struct CueClosure *);
+void Scheduler_fail(struct CueScheduler *, const char *error);
 void Scheduler_run(struct CueScheduler *);
 void Scheduler_run_once(struct CueScheduler *);
 void Scheduler_run_one(struct CueScheduler *);
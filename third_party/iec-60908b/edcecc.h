@@ -32,7 +32,13 @@ SOFTWARE.
 extern "C" {
 #endif
 
+// Fills in EDC and ECC of a raw 2352 bytes sector, according to the mode in its header
 void compute_edcecc(uint8_t* sector);
+void compute_mode1_edcecc(uint8_t* sector);
+void compute_mode2_edcecc(uint8_t* sector, unsigned form);
+void compute_ecc(uint8_t* sector);
+// The original byte-wise mode 2 code, for the EDC/ECC benchmark
+void compute_edcecc_reference(uint8_t* sector);
 
 #ifdef __cplusplus
 }
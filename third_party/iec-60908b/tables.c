@@ -112,6 +112,147 @@ int main() {
 }
 #endif
 
+/* Slicing-by-4 tables for the same crc32: entry n of slice k is the crc of
+   byte n followed by k zero bytes, which lets the crc consume a whole 32-bit
+   word per round with four independent lookups instead of four dependent
+   ones. Slice 0 is the table above, which isn't repeated here. Going up to
+   slicing-by-8 would double the size of these tables for a smaller gain,
+   which isn't worth the cache pressure on small targets. */
+
+const uint32_t yellow_book_crctable_slices[3][256] = {
+    {
+        0x00000000, 0x90019000, 0x90002003, 0x0001b003, 0x90034005, 0x0002d005, 0x00036006, 0x9002f006,  // 00
+        0x90058009, 0x00041009, 0x0005a00a, 0x9004300a, 0x0006c00c, 0x9007500c, 0x9006e00f, 0x0007700f,  // 08
+        0x90080011, 0x00099011, 0x00082012, 0x9009b012, 0x000b4014, 0x900ad014, 0x900b6017, 0x000af017,  // 10
+        0x000d8018, 0x900c1018, 0x900da01b, 0x000c301b, 0x900ec01d, 0x000f501d, 0x000ee01e, 0x900f701e,  // 18
+        0x90130021, 0x00129021, 0x00132022, 0x9012b022, 0x00104024, 0x9011d024, 0x90106027, 0x0011f027,  // 20
+        0x00168028, 0x90171028, 0x9016a02b, 0x0017302b, 0x9015c02d, 0x0014502d, 0x0015e02e, 0x9014702e,  // 28
+        0x001b0030, 0x901a9030, 0x901b2033, 0x001ab033, 0x90184035, 0x0019d035, 0x00186036, 0x9019f036,  // 30
+        0x901e8039, 0x001f1039, 0x001ea03a, 0x901f303a, 0x001dc03c, 0x901c503c, 0x901de03f, 0x001c703f,  // 38
+        0x90250041, 0x00249041, 0x00252042, 0x9024b042, 0x00264044, 0x9027d044, 0x90266047, 0x0027f047,  // 40
+        0x00208048, 0x90211048, 0x9020a04b, 0x0021304b, 0x9023c04d, 0x0022504d, 0x0023e04e, 0x9022704e,  // 48
+        0x002d0050, 0x902c9050, 0x902d2053, 0x002cb053, 0x902e4055, 0x002fd055, 0x002e6056, 0x902ff056,  // 50
+        0x90288059, 0x00291059, 0x0028a05a, 0x9029305a, 0x002bc05c, 0x902a505c, 0x902be05f, 0x002a705f,  // 58
+        0x00360060, 0x90379060, 0x90362063, 0x0037b063, 0x90354065, 0x0034d065, 0x00356066, 0x9034f066,  // 60
+        0x90338069, 0x00321069, 0x0033a06a, 0x9032306a, 0x0030c06c, 0x9031506c, 0x9030e06f, 0x0031706f,  // 68
+        0x903e0071, 0x003f9071, 0x003e2072, 0x903fb072, 0x003d4074, 0x903cd074, 0x903d6077, 0x003cf077,  // 70
+        0x003b8078, 0x903a1078, 0x903ba07b, 0x003a307b, 0x9038c07d, 0x0039507d, 0x0038e07e, 0x9039707e,  // 78
+        0x90490081, 0x00489081, 0x00492082, 0x9048b082, 0x004a4084, 0x904bd084, 0x904a6087, 0x004bf087,  // 80
+        0x004c8088, 0x904d1088, 0x904ca08b, 0x004d308b, 0x904fc08d, 0x004e508d, 0x004fe08e, 0x904e708e,  // 88
+        0x00410090, 0x90409090, 0x90412093, 0x0040b093, 0x90424095, 0x0043d095, 0x00426096, 0x9043f096,  // 90
+        0x90448099, 0x00451099, 0x0044a09a, 0x9045309a, 0x0047c09c, 0x9046509c, 0x9047e09f, 0x0046709f,  // 98
+        0x005a00a0, 0x905b90a0, 0x905a20a3, 0x005bb0a3, 0x905940a5, 0x0058d0a5, 0x005960a6, 0x9058f0a6,  // a0
+        0x905f80a9, 0x005e10a9, 0x005fa0aa, 0x905e30aa, 0x005cc0ac, 0x905d50ac, 0x905ce0af, 0x005d70af,  // a8
+        0x905200b1, 0x005390b1, 0x005220b2, 0x9053b0b2, 0x005140b4, 0x9050d0b4, 0x905160b7, 0x0050f0b7,  // b0
+        0x005780b8, 0x905610b8, 0x9057a0bb, 0x005630bb, 0x9054c0bd, 0x005550bd, 0x0054e0be, 0x905570be,  // b8
+        0x006c00c0, 0x906d90c0, 0x906c20c3, 0x006db0c3, 0x906f40c5, 0x006ed0c5, 0x006f60c6, 0x906ef0c6,  // c0
+        0x906980c9, 0x006810c9, 0x0069a0ca, 0x906830ca, 0x006ac0cc, 0x906b50cc, 0x906ae0cf, 0x006b70cf,  // c8
+        0x906400d1, 0x006590d1, 0x006420d2, 0x9065b0d2, 0x006740d4, 0x9066d0d4, 0x906760d7, 0x0066f0d7,  // d0
+        0x006180d8, 0x906010d8, 0x9061a0db, 0x006030db, 0x9062c0dd, 0x006350dd, 0x0062e0de, 0x906370de,  // d8
+        0x907f00e1, 0x007e90e1, 0x007f20e2, 0x907eb0e2, 0x007c40e4, 0x907dd0e4, 0x907c60e7, 0x007df0e7,  // e0
+        0x007a80e8, 0x907b10e8, 0x907aa0eb, 0x007b30eb, 0x9079c0ed, 0x007850ed, 0x0079e0ee, 0x907870ee,  // e8
+        0x007700f0, 0x907690f0, 0x907720f3, 0x0076b0f3, 0x907440f5, 0x0075d0f5, 0x007460f6, 0x9075f0f6,  // f0
+        0x907280f9, 0x007310f9, 0x0072a0fa, 0x907330fa, 0x0071c0fc, 0x907050fc, 0x9071e0ff, 0x007070ff,  // f8
+    },
+    {
+        0x00000000, 0x00900190, 0x01200320, 0x01b002b0, 0x02400640, 0x02d007d0, 0x03600560, 0x03f004f0,  // 00
+        0x04800c80, 0x04100d10, 0x05a00fa0, 0x05300e30, 0x06c00ac0, 0x06500b50, 0x07e009e0, 0x07700870,  // 08
+        0x09001900, 0x09901890, 0x08201a20, 0x08b01bb0, 0x0b401f40, 0x0bd01ed0, 0x0a601c60, 0x0af01df0,  // 10
+        0x0d801580, 0x0d101410, 0x0ca016a0, 0x0c301730, 0x0fc013c0, 0x0f501250, 0x0ee010e0, 0x0e701170,  // 18
+        0x12003200, 0x12903390, 0x13203120, 0x13b030b0, 0x10403440, 0x10d035d0, 0x11603760, 0x11f036f0,  // 20
+        0x16803e80, 0x16103f10, 0x17a03da0, 0x17303c30, 0x14c038c0, 0x14503950, 0x15e03be0, 0x15703a70,  // 28
+        0x1b002b00, 0x1b902a90, 0x1a202820, 0x1ab029b0, 0x19402d40, 0x19d02cd0, 0x18602e60, 0x18f02ff0,  // 30
+        0x1f802780, 0x1f102610, 0x1ea024a0, 0x1e302530, 0x1dc021c0, 0x1d502050, 0x1ce022e0, 0x1c702370,  // 38
+        0x24006400, 0x24906590, 0x25206720, 0x25b066b0, 0x26406240, 0x26d063d0, 0x27606160, 0x27f060f0,  // 40
+        0x20806880, 0x20106910, 0x21a06ba0, 0x21306a30, 0x22c06ec0, 0x22506f50, 0x23e06de0, 0x23706c70,  // 48
+        0x2d007d00, 0x2d907c90, 0x2c207e20, 0x2cb07fb0, 0x2f407b40, 0x2fd07ad0, 0x2e607860, 0x2ef079f0,  // 50
+        0x29807180, 0x29107010, 0x28a072a0, 0x28307330, 0x2bc077c0, 0x2b507650, 0x2ae074e0, 0x2a707570,  // 58
+        0x36005600, 0x36905790, 0x37205520, 0x37b054b0, 0x34405040, 0x34d051d0, 0x35605360, 0x35f052f0,  // 60
+        0x32805a80, 0x32105b10, 0x33a059a0, 0x33305830, 0x30c05cc0, 0x30505d50, 0x31e05fe0, 0x31705e70,  // 68
+        0x3f004f00, 0x3f904e90, 0x3e204c20, 0x3eb04db0, 0x3d404940, 0x3dd048d0, 0x3c604a60, 0x3cf04bf0,  // 70
+        0x3b804380, 0x3b104210, 0x3aa040a0, 0x3a304130, 0x39c045c0, 0x39504450, 0x38e046e0, 0x38704770,  // 78
+        0x4800c800, 0x4890c990, 0x4920cb20, 0x49b0cab0, 0x4a40ce40, 0x4ad0cfd0, 0x4b60cd60, 0x4bf0ccf0,  // 80
+        0x4c80c480, 0x4c10c510, 0x4da0c7a0, 0x4d30c630, 0x4ec0c2c0, 0x4e50c350, 0x4fe0c1e0, 0x4f70c070,  // 88
+        0x4100d100, 0x4190d090, 0x4020d220, 0x40b0d3b0, 0x4340d740, 0x43d0d6d0, 0x4260d460, 0x42f0d5f0,  // 90
+        0x4580dd80, 0x4510dc10, 0x44a0dea0, 0x4430df30, 0x47c0dbc0, 0x4750da50, 0x46e0d8e0, 0x4670d970,  // 98
+        0x5a00fa00, 0x5a90fb90, 0x5b20f920, 0x5bb0f8b0, 0x5840fc40, 0x58d0fdd0, 0x5960ff60, 0x59f0fef0,  // a0
+        0x5e80f680, 0x5e10f710, 0x5fa0f5a0, 0x5f30f430, 0x5cc0f0c0, 0x5c50f150, 0x5de0f3e0, 0x5d70f270,  // a8
+        0x5300e300, 0x5390e290, 0x5220e020, 0x52b0e1b0, 0x5140e540, 0x51d0e4d0, 0x5060e660, 0x50f0e7f0,  // b0
+        0x5780ef80, 0x5710ee10, 0x56a0eca0, 0x5630ed30, 0x55c0e9c0, 0x5550e850, 0x54e0eae0, 0x5470eb70,  // b8
+        0x6c00ac00, 0x6c90ad90, 0x6d20af20, 0x6db0aeb0, 0x6e40aa40, 0x6ed0abd0, 0x6f60a960, 0x6ff0a8f0,  // c0
+        0x6880a080, 0x6810a110, 0x69a0a3a0, 0x6930a230, 0x6ac0a6c0, 0x6a50a750, 0x6be0a5e0, 0x6b70a470,  // c8
+        0x6500b500, 0x6590b490, 0x6420b620, 0x64b0b7b0, 0x6740b340, 0x67d0b2d0, 0x6660b060, 0x66f0b1f0,  // d0
+        0x6180b980, 0x6110b810, 0x60a0baa0, 0x6030bb30, 0x63c0bfc0, 0x6350be50, 0x62e0bce0, 0x6270bd70,  // d8
+        0x7e009e00, 0x7e909f90, 0x7f209d20, 0x7fb09cb0, 0x7c409840, 0x7cd099d0, 0x7d609b60, 0x7df09af0,  // e0
+        0x7a809280, 0x7a109310, 0x7ba091a0, 0x7b309030, 0x78c094c0, 0x78509550, 0x79e097e0, 0x79709670,  // e8
+        0x77008700, 0x77908690, 0x76208420, 0x76b085b0, 0x75408140, 0x75d080d0, 0x74608260, 0x74f083f0,  // f0
+        0x73808b80, 0x73108a10, 0x72a088a0, 0x72308930, 0x71c08dc0, 0x71508c50, 0x70e08ee0, 0x70708f70,  // f8
+    },
+    {
+        0x00000000, 0x41000001, 0x82000002, 0xc3000003, 0xb4030007, 0xf5030006, 0x36030005, 0x77030004,  // 00
+        0xd805000d, 0x9905000c, 0x5a05000f, 0x1b05000e, 0x6c06000a, 0x2d06000b, 0xee060008, 0xaf060009,  // 08
+        0x00090019, 0x41090018, 0x8209001b, 0xc309001a, 0xb40a001e, 0xf50a001f, 0x360a001c, 0x770a001d,  // 10
+        0xd80c0014, 0x990c0015, 0x5a0c0016, 0x1b0c0017, 0x6c0f0013, 0x2d0f0012, 0xee0f0011, 0xaf0f0010,  // 18
+        0x00120032, 0x41120033, 0x82120030, 0xc3120031, 0xb4110035, 0xf5110034, 0x36110037, 0x77110036,  // 20
+        0xd817003f, 0x9917003e, 0x5a17003d, 0x1b17003c, 0x6c140038, 0x2d140039, 0xee14003a, 0xaf14003b,  // 28
+        0x001b002b, 0x411b002a, 0x821b0029, 0xc31b0028, 0xb418002c, 0xf518002d, 0x3618002e, 0x7718002f,  // 30
+        0xd81e0026, 0x991e0027, 0x5a1e0024, 0x1b1e0025, 0x6c1d0021, 0x2d1d0020, 0xee1d0023, 0xaf1d0022,  // 38
+        0x00240064, 0x41240065, 0x82240066, 0xc3240067, 0xb4270063, 0xf5270062, 0x36270061, 0x77270060,  // 40
+        0xd8210069, 0x99210068, 0x5a21006b, 0x1b21006a, 0x6c22006e, 0x2d22006f, 0xee22006c, 0xaf22006d,  // 48
+        0x002d007d, 0x412d007c, 0x822d007f, 0xc32d007e, 0xb42e007a, 0xf52e007b, 0x362e0078, 0x772e0079,  // 50
+        0xd8280070, 0x99280071, 0x5a280072, 0x1b280073, 0x6c2b0077, 0x2d2b0076, 0xee2b0075, 0xaf2b0074,  // 58
+        0x00360056, 0x41360057, 0x82360054, 0xc3360055, 0xb4350051, 0xf5350050, 0x36350053, 0x77350052,  // 60
+        0xd833005b, 0x9933005a, 0x5a330059, 0x1b330058, 0x6c30005c, 0x2d30005d, 0xee30005e, 0xaf30005f,  // 68
+        0x003f004f, 0x413f004e, 0x823f004d, 0xc33f004c, 0xb43c0048, 0xf53c0049, 0x363c004a, 0x773c004b,  // 70
+        0xd83a0042, 0x993a0043, 0x5a3a0040, 0x1b3a0041, 0x6c390045, 0x2d390044, 0xee390047, 0xaf390046,  // 78
+        0x004800c8, 0x414800c9, 0x824800ca, 0xc34800cb, 0xb44b00cf, 0xf54b00ce, 0x364b00cd, 0x774b00cc,  // 80
+        0xd84d00c5, 0x994d00c4, 0x5a4d00c7, 0x1b4d00c6, 0x6c4e00c2, 0x2d4e00c3, 0xee4e00c0, 0xaf4e00c1,  // 88
+        0x004100d1, 0x414100d0, 0x824100d3, 0xc34100d2, 0xb44200d6, 0xf54200d7, 0x364200d4, 0x774200d5,  // 90
+        0xd84400dc, 0x994400dd, 0x5a4400de, 0x1b4400df, 0x6c4700db, 0x2d4700da, 0xee4700d9, 0xaf4700d8,  // 98
+        0x005a00fa, 0x415a00fb, 0x825a00f8, 0xc35a00f9, 0xb45900fd, 0xf55900fc, 0x365900ff, 0x775900fe,  // a0
+        0xd85f00f7, 0x995f00f6, 0x5a5f00f5, 0x1b5f00f4, 0x6c5c00f0, 0x2d5c00f1, 0xee5c00f2, 0xaf5c00f3,  // a8
+        0x005300e3, 0x415300e2, 0x825300e1, 0xc35300e0, 0xb45000e4, 0xf55000e5, 0x365000e6, 0x775000e7,  // b0
+        0xd85600ee, 0x995600ef, 0x5a5600ec, 0x1b5600ed, 0x6c5500e9, 0x2d5500e8, 0xee5500eb, 0xaf5500ea,  // b8
+        0x006c00ac, 0x416c00ad, 0x826c00ae, 0xc36c00af, 0xb46f00ab, 0xf56f00aa, 0x366f00a9, 0x776f00a8,  // c0
+        0xd86900a1, 0x996900a0, 0x5a6900a3, 0x1b6900a2, 0x6c6a00a6, 0x2d6a00a7, 0xee6a00a4, 0xaf6a00a5,  // c8
+        0x006500b5, 0x416500b4, 0x826500b7, 0xc36500b6, 0xb46600b2, 0xf56600b3, 0x366600b0, 0x776600b1,  // d0
+        0xd86000b8, 0x996000b9, 0x5a6000ba, 0x1b6000bb, 0x6c6300bf, 0x2d6300be, 0xee6300bd, 0xaf6300bc,  // d8
+        0x007e009e, 0x417e009f, 0x827e009c, 0xc37e009d, 0xb47d0099, 0xf57d0098, 0x367d009b, 0x777d009a,  // e0
+        0xd87b0093, 0x997b0092, 0x5a7b0091, 0x1b7b0090, 0x6c780094, 0x2d780095, 0xee780096, 0xaf780097,  // e8
+        0x00770087, 0x41770086, 0x82770085, 0xc3770084, 0xb4740080, 0xf5740081, 0x36740082, 0x77740083,  // f0
+        0xd872008a, 0x9972008b, 0x5a720088, 0x1b720089, 0x6c71008d, 0x2d71008c, 0xee71008f, 0xaf71008e,  // f8
+    },
+};
+
+/*
+Tables above generated using the following code, on top of make_crc_table:
+*/
+
+#if 0
+int main() {
+    uint32_t crc[4][256];
+
+    make_crc_table(crc[0], 0x8001801b, 1);
+    for (int k = 1; k < 4; k++) {
+        for (int i = 0; i < 256; i++) {
+            crc[k][i] = (crc[k - 1][i] >> 8) ^ crc[0][crc[k - 1][i] & 0xff];
+        }
+    }
+
+    for (int k = 1; k < 4; k++) {
+        printf("    {\n");
+        for (int i = 0; i < 256; i++) {
+            if ((i & 7) == 0) printf("        ");
+            printf("0x%08x, ", crc[k][i]);
+            if ((i & 7) == 7) {
+                printf("  // %02x\n", i - 7);
+            }
+        }
+        printf("    },\n");
+    }
+}
+#endif
+
 /* These tables are to help with galois field lookups. The yellow book is
    using the typical galois field primitive of x⁸ + x⁴ + x³ + x² + 1,
    so these tables shouldn't be anything surprising from other galois field
@@ -30,6 +30,8 @@ SOFTWARE.
 
 // Lookup table for the yellow book's crc32
 extern const uint32_t yellow_book_crctable[256];
+// Slicing-by-4 companions of the table above, for slices 1 to 3
+extern const uint32_t yellow_book_crctable_slices[3][256];
 
 // Lookup tables for Galois field's exponent and logarithmic operations
 extern const uint8_t gf_exp_table[512];
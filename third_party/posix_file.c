@@ -26,23 +26,33 @@ SOFTWARE.
 
 #include "posix_file.h"
 
-#include "ff_stdio.h"
+#include "ff.h"
 
 #include <stdio.h>
 
+#ifdef CUSTOM_ALLOCATOR
+#include "mount_arena.h"
+#define FILE_MALLOC mount_arena_malloc
+#define FILE_FREE mount_arena_free
+#else
+#include <stdlib.h>
+#define FILE_MALLOC malloc
+#define FILE_FREE free
+#endif
 
 static void posix_destroy(struct CueFile *file) {}
 
 static void posix_close(struct CueFile *file, struct CueScheduler *scheduler, void (*cb)(struct CueFile *, struct CueScheduler *)) {
-    ff_fclose((FIL *)file->opaque);
+    f_close((FIL *)file->opaque);
+    FILE_FREE(file->opaque);
+    file->opaque = NULL;
     File_schedule_close(file, scheduler, cb);
 }
 
 static void posix_size(struct CueFile *file, struct CueScheduler *scheduler, int compressed,
                        void (*cb)(struct CueFile *, struct CueScheduler *, uint64_t)) {
     FIL *f = (FIL *)file->opaque;
-    ff_fseek(f, 0, FF_SEEK_END);
-    uint64_t size = ff_ftell(f);
+    uint64_t size = f_size(f);
     File_schedule_size(file, scheduler, size, cb);
 }
 
@@ -50,24 +60,64 @@ static void posix_read(struct CueFile *file, struct CueScheduler *scheduler, uin
                        uint8_t *buffer,
                        void (*cb)(struct CueFile *, struct CueScheduler *, int error, uint32_t amount, uint8_t *buffer)) {
     FIL *f = (FIL *)file->opaque;
-    ff_fseek(f, cursor, FF_SEEK_SET);
-    f->err = 0; //clearerr(f);
-    size_t r = ff_fread(buffer, 1, amount, f);
-    File_schedule_read(file, scheduler, f_error(f) == 0 ? 0 : 1, r, buffer, cb);
+    UINT r = 0;
+    FRESULT fr = f_lseek(f, cursor);
+    if (fr == FR_OK) {
+        fr = f_read(f, buffer, amount, &r);
+    }
+    File_schedule_read(file, scheduler, fr == FR_OK ? 0 : 1, r, buffer, cb);
 }
 
 static void posix_write(struct CueFile *file, struct CueScheduler *scheduler, uint32_t amount, uint64_t cursor,
                         const uint8_t *buffer,
                         void (*cb)(struct CueFile *, struct CueScheduler *, int error, uint32_t amount)) {
     FIL *f = (FIL *)file->opaque;
-    ff_fseek(f, cursor, FF_SEEK_SET);
-    f->err = 0; //clearerr(f);
-    size_t r = ff_fwrite(buffer, 1, amount, f);
-    File_schedule_write(file, scheduler, f_error(f) == 0 ? 0 : 1, r, cb);
+    UINT r = 0;
+    FRESULT fr = f_lseek(f, cursor);
+    if (fr == FR_OK) {
+        fr = f_write(f, buffer, amount, &r);
+    }
+    File_schedule_write(file, scheduler, fr == FR_OK ? 0 : 1, r, cb);
 }
 
-struct CueFile *create_posix_file(struct CueFile *file, const char *filename, const char *mode) {
-    file->opaque = ff_fopen(filename, mode);
+static BYTE posix_mode(const char *mode) {
+    BYTE flags = 0;
+    switch (mode[0]) {
+        case 'r':
+            flags = FA_READ | FA_OPEN_EXISTING;
+            break;
+        case 'w':
+            flags = FA_WRITE | FA_CREATE_ALWAYS;
+            break;
+        case 'a':
+            flags = FA_WRITE | FA_OPEN_ALWAYS;
+            break;
+    }
+    for (const char *c = mode; *c; c++) {
+        if (*c == '+') flags |= FA_READ | FA_WRITE;
+    }
+    return flags;
+}
+
+struct CueFile *create_posix_file(struct CueFile *file, const char *filename, const char *mode, FRESULT *result) {
+    // The FIL is allocated here rather than through ff_fopen so it can come out of the mount arena
+    FIL *f = (FIL *)FILE_MALLOC(sizeof(FIL));
+    FRESULT fr = f ? f_open(f, filename, posix_mode(mode)) : FR_NOT_ENOUGH_CORE;
+    if (fr == FR_OK && mode[0] == 'a') {
+        // f_open has no append flag, ff_fopen did this seek itself
+        fr = f_lseek(f, f_size(f));
+        if (fr != FR_OK) {
+            f_close(f);
+        }
+    }
+    if (f && fr != FR_OK) {
+        FILE_FREE(f);
+        f = NULL;
+    }
+    if (result) {
+        *result = fr;
+    }
+    file->opaque = f;
     file->destroy = posix_destroy;
     file->close = posix_close;
     file->size = posix_size;
@@ -77,4 +127,61 @@ struct CueFile *create_posix_file(struct CueFile *file, const char *filename, co
     file->filename = NULL;
     file->references = 1;
     return file->opaque ? file : NULL;
-}
\ No newline at end of file
+}
+
+static void stat_close(struct CueFile *file, struct CueScheduler *scheduler, void (*cb)(struct CueFile *, struct CueScheduler *)) {
+    FILE_FREE(file->opaque);
+    file->opaque = NULL;
+    File_schedule_close(file, scheduler, cb);
+}
+
+static void stat_size(struct CueFile *file, struct CueScheduler *scheduler, int compressed,
+                      void (*cb)(struct CueFile *, struct CueScheduler *, uint64_t)) {
+    File_schedule_size(file, scheduler, *(uint64_t *)file->opaque, cb);
+}
+
+static void stat_read(struct CueFile *file, struct CueScheduler *scheduler, uint32_t amount, uint64_t cursor,
+                      uint8_t *buffer,
+                      void (*cb)(struct CueFile *, struct CueScheduler *, int error, uint32_t amount, uint8_t *buffer)) {
+    File_schedule_read(file, scheduler, 1, 0, buffer, cb);
+}
+
+static void stat_write(struct CueFile *file, struct CueScheduler *scheduler, uint32_t amount, uint64_t cursor,
+                       const uint8_t *buffer,
+                       void (*cb)(struct CueFile *, struct CueScheduler *, int error, uint32_t amount)) {
+    File_schedule_write(file, scheduler, 1, 0, cb);
+}
+
+static struct CueFile *create_size_only_file(struct CueFile *file, uint64_t *size) {
+    file->opaque = size;
+    file->destroy = posix_destroy;
+    file->close = stat_close;
+    file->size = stat_size;
+    file->read = stat_read;
+    file->write = stat_write;
+    file->cfilename = NULL;
+    file->filename = NULL;
+    file->references = 1;
+    return file->opaque ? file : NULL;
+}
+
+struct CueFile *create_posix_stat_file(struct CueFile *file, const char *filename) {
+    // Only the size of the file is known; no FIL is held open
+    FILINFO info;
+    uint64_t *size = (uint64_t *)FILE_MALLOC(sizeof(uint64_t));
+    if (size && f_stat(filename, &info) == FR_OK) {
+        *size = info.fsize;
+    } else {
+        FILE_FREE(size);
+        size = NULL;
+    }
+    return create_size_only_file(file, size);
+}
+
+struct CueFile *create_posix_sized_file(struct CueFile *file, uint64_t fileSize) {
+    uint64_t *size = (uint64_t *)FILE_MALLOC(sizeof(uint64_t));
+    if (size) {
+        *size = fileSize;
+    }
+    return create_size_only_file(file, size);
+}
@@ -27,12 +27,18 @@ SOFTWARE.
 #pragma once
 
 #include "cueparser/fileabstract.h"
+#include "ff.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-struct CueFile* create_posix_file(struct CueFile*, const char* filename, const char* mode);
+// result, if not NULL, gets the f_open error, or FR_NOT_ENOUGH_CORE when the FIL couldn't be allocated
+struct CueFile* create_posix_file(struct CueFile*, const char* filename, const char* mode, FRESULT* result);
+// Size-only file for the cue parser, for files that are read through another path once mounted
+struct CueFile* create_posix_stat_file(struct CueFile*, const char* filename);
+// Same, for a file whose contents are stored in another form and only the original size is known
+struct CueFile* create_posix_sized_file(struct CueFile*, uint64_t size);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,312 @@
+#!/usr/bin/env python3
+"""Converts a cue/bin disc image into a .psenc image the firmware streams straight into its I2S buffers.
+
+Every sector is stored as the 1176 PIO words core1 would otherwise build from it at run time, scrambled for data
+tracks, along with the Q subchannel frame SubQ sends for it. A .sbi or .lsd next to the cue is baked into the Q
+frames. PPF patches aren't applied by the firmware to these images, patch the bin before converting it.
+
+Layout, little endian:
+    header, 2048 bytes:
+        "PSEN"  u16 version  u16 trackCount  u32 sectorCount  u32 subQOffset  u32 dataOffset
+        at 32, for tracks 1 to trackCount: u32 index0  u32 index1  u32 type (1 audio, 2 data)
+    Q frames from subQOffset, 12 bytes per sector, as SubQ sends them
+    PIO words from dataOffset, 4704 bytes per sector
+
+Sector 0 is the first sector of track 1, the pregap before it isn't stored. subQOffset and dataOffset are
+multiples of 512 so sector data starts on a card block.
+
+usage: encode_image.py <image.cue> <output.psenc>
+"""
+
+import os
+import re
+import struct
+import sys
+
+MAGIC = b"PSEN"
+VERSION = 1
+HEADER_SIZE = 2048
+SECTOR_SIZE = 2352
+PREGAP = 150
+BLOCK_SIZE = 512
+MAX_TRACKS = 99
+
+AUDIO, DATA = 1, 2
+TRACK_TYPES = {"AUDIO": AUDIO, "MODE1/2352": DATA, "MODE2/2352": DATA}
+
+SYNC = bytes([0x00] + [0xFF] * 10 + [0x00])
+
+
+def generate_scrambling_lut():
+    """Mirrors I2S::generateScramblingLUT."""
+    lut = [0] * (SECTOR_SIZE // 2)
+    shift = 1
+    for i in range(6, SECTOR_SIZE // 2):
+        upper = shift & 0xFF
+        for _ in range(8):
+            bit = ((shift & 1) ^ ((shift & 2) >> 1)) << 15
+            shift = (bit | shift) >> 1
+        lower = shift & 0xFF
+        lut[i] = (lower << 8) | upper
+        for _ in range(8):
+            bit = ((shift & 1) ^ ((shift & 2) >> 1)) << 15
+            shift = (bit | shift) >> 1
+    return lut
+
+
+SCRAMBLING_LUT = generate_scrambling_lut()
+
+
+def encode_sector(sector, scramble):
+    """Mirrors I2S::encodeSector, PIO words for a 2352 byte sector."""
+    samples = struct.unpack(f"<{SECTOR_SIZE // 2}h", sector)
+    words = []
+    for i, sample in enumerate(samples):
+        if scramble:
+            sample ^= SCRAMBLING_LUT[i]
+        words.append(((sample << 8) | (0xFF if sample & 1 else 0)) & 0xFFFFFFFF)
+    return struct.pack(f"<{len(words)}I", *words)
+
+
+EDC_LUT = []
+for i in range(256):
+    e = i
+    for _ in range(8):
+        e = (e >> 1) ^ (0xD8018001 if e & 1 else 0)
+    EDC_LUT.append(e)
+
+
+def edc(data):
+    e = 0
+    for x in data:
+        e = (e >> 8) ^ EDC_LUT[(e ^ x) & 0xFF]
+    return e
+
+
+def to_bcd(value):
+    return 0x99 if value > 99 else ((value // 10) << 4) | (value % 10)
+
+
+def to_msf(sector):
+    """Mirrors sectorToMSF in disc_image.cpp, the pregap counts down to 0 rather than up from -1."""
+    seconds = abs(sector) // 75
+    return seconds // 60, seconds % 60, abs(sector) % 75
+
+
+def filler_sector(index):
+    """Mirrors DiscImage::buildSector with no user data, sent for data track pregaps that aren't in a file."""
+    mm, ss, ff = to_msf(index + PREGAP)
+    sector = bytearray(SYNC + bytes([to_bcd(mm), to_bcd(ss), to_bcd(ff), 2]) + bytes([0, 0, 0x20, 0]) * 2)
+    sector += bytes(SECTOR_SIZE - len(sector))
+    struct.pack_into("<I", sector, 0x92C, edc(sector[0x10:0x92C]))
+    return bytes(sector)
+
+
+def crc16(data):
+    crc = 0
+    for x in data:
+        crc ^= x << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def parse_time(text):
+    mm, ss, ff = (int(x) for x in text.split(":"))
+    return (mm * 60 + ss) * 75 + ff
+
+
+def parse_cue(path):
+    """Returns [(bin path, [track])], each track a dict with number, type, indices, pregap and postgap."""
+    files = []
+    track = None
+    directory = os.path.dirname(path)
+    with open(path, "r", encoding="utf-8", errors="replace") as f:
+        for line in f:
+            words = line.strip().split()
+            if not words:
+                continue
+            command = words[0].upper()
+            if command == "FILE":
+                match = re.match(r'\s*FILE\s+"?(.*?)"?\s+(\S+)\s*$', line, re.IGNORECASE)
+                if not match or match.group(2).upper() != "BINARY":
+                    sys.exit(f"{path}: only BINARY files are supported: {line.strip()}")
+                files.append((os.path.join(directory, match.group(1)), []))
+            elif command == "TRACK":
+                if not files or words[2].upper() not in TRACK_TYPES:
+                    sys.exit(f"{path}: unsupported track: {line.strip()}")
+                track = {"number": int(words[1]), "type": TRACK_TYPES[words[2].upper()], "indices": {},
+                         "pregap": 0, "postgap": 0}
+                files[-1][1].append(track)
+            elif command == "INDEX" and track:
+                track["indices"][int(words[1])] = parse_time(words[2])
+            elif command == "PREGAP" and track:
+                track["pregap"] = parse_time(words[1])
+            elif command == "POSTGAP" and track:
+                track["postgap"] = parse_time(words[1])
+    return files
+
+
+def layout_disc(files):
+    """Lays the files out one after the other from sector 0, gaps that aren't in a file included.
+
+    Returns the tracks with absolute index0, index1 and type, and one (path, file sector) per disc sector,
+    None where the sector isn't in a file.
+    """
+    sectors = []
+    tracks = []
+    for path, file_tracks in files:
+        file_sectors = os.path.getsize(path) // SECTOR_SIZE
+        cursor = 0
+        previous = None
+        for track in file_tracks:
+            if 1 not in track["indices"]:
+                sys.exit(f"track {track['number']} has no INDEX 01")
+            index1 = track["indices"][1]
+            start = track["indices"].get(0, index1)
+            sectors += [(path, s) for s in range(cursor, start)]
+            if previous:
+                sectors += [None] * previous["postgap"]
+            absolute0 = len(sectors)
+            sectors += [None] * track["pregap"]
+            sectors += [(path, s) for s in range(start, index1)]
+            tracks.append({"number": track["number"], "type": track["type"], "index0": absolute0,
+                           "index1": len(sectors)})
+            cursor = index1
+            previous = track
+        sectors += [(path, s) for s in range(cursor, file_sectors)]
+        if previous:
+            sectors += [None] * previous["postgap"]
+
+    if not tracks or len(tracks) > MAX_TRACKS or tracks[0]["index1"] != 0:
+        sys.exit("track 1 has to start the first file and there can be at most 99 tracks")
+    for i, track in enumerate(tracks):
+        if track["number"] != i + 1:
+            sys.exit(f"track {track['number']} is out of order")
+    return tracks, sectors
+
+
+def read_patches(cue_path):
+    """Q frames from a .sbi or .lsd next to the cue, mirrors SubQPatches. Returns {sector: (offset, bytes, crc)}."""
+    stem = os.path.splitext(cue_path)[0]
+    patches = {}
+    if os.path.exists(stem + ".sbi"):
+        with open(stem + ".sbi", "rb") as f:
+            data = f.read()
+        if data[0:4] != b"SBI\0":
+            sys.exit(f"{stem}.sbi: not an SBI file")
+        pos = 4
+        while pos + 4 <= len(data):
+            sector = msf_bcd_to_sector(data[pos:pos + 3]) - PREGAP
+            kind = data[pos + 3]
+            pos += 4
+            length = 10 if kind == 1 else 3
+            offset = {1: 0, 2: 3, 3: 7}.get(kind)
+            if offset is None:
+                sys.exit(f"{stem}.sbi: unknown entry type {kind}")
+            patches[sector] = (offset, data[pos:pos + length], None)
+            pos += length
+    elif os.path.exists(stem + ".lsd"):
+        with open(stem + ".lsd", "rb") as f:
+            data = f.read()
+        for pos in range(0, len(data) - 14, 15):
+            sector = msf_bcd_to_sector(data[pos:pos + 3]) - PREGAP
+            q = data[pos + 3:pos + 15]
+            # Dumped straight off the disc, where the CRC is stored inverted
+            patches[sector] = (0, q[0:10], bytes([~q[10] & 0xFF, ~q[11] & 0xFF]))
+    return patches
+
+
+def msf_bcd_to_sector(msf):
+    def from_bcd(value):
+        return (value >> 4) * 10 + (value & 0x0F)
+
+    return (from_bcd(msf[0]) * 60 + from_bcd(msf[1])) * 75 + from_bcd(msf[2])
+
+
+def subq_frame(index, tracks, patches):
+    """Mirrors DiscImage::generateSubQ for a program area sector in the normal audio mode."""
+    track = tracks[-1]
+    for i in range(len(tracks) - 1):
+        if tracks[i + 1]["index0"] > index:
+            track = tracks[i]
+            break
+    relative = index - track["index1"]
+    mm, ss, ff = to_msf(relative)
+    amm, ass, aff = to_msf(index + PREGAP)
+    q = bytearray(12)
+    q[0] = 0x41 if track["type"] == DATA else 0x01
+    q[1] = to_bcd(track["number"])
+    if relative < 0:
+        q[2:6] = bytes([0x00, 0x00, to_bcd(ss), to_bcd(ff)])
+    else:
+        q[2:6] = bytes([0x01, to_bcd(mm), to_bcd(ss), to_bcd(ff)])
+    q[7:10] = bytes([to_bcd(amm), to_bcd(ass), to_bcd(aff)])
+
+    patch = patches.get(index)
+    if patch:
+        offset, data, recorded_crc = patch
+        q[offset:offset + len(data)] = data
+        if recorded_crc:
+            q[10:12] = recorded_crc
+            return bytes(q)
+    crc = crc16(q[0:10])
+    if patch:
+        # .sbi dumps leave the CRC out, a protected sector's never matches its frame
+        crc ^= 0xFFFF
+    q[10:12] = bytes([crc >> 8, crc & 0xFF])
+    return bytes(q)
+
+
+def align(value):
+    return (value + BLOCK_SIZE - 1) // BLOCK_SIZE * BLOCK_SIZE
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+
+    cue_path = sys.argv[1]
+    tracks, sectors = layout_disc(parse_cue(cue_path))
+    patches = read_patches(cue_path)
+    count = len(sectors)
+    subq_offset = HEADER_SIZE
+    data_offset = align(subq_offset + count * 12)
+
+    header = bytearray(HEADER_SIZE)
+    header[0:20] = MAGIC + struct.pack("<HHIII", VERSION, len(tracks), count, subq_offset, data_offset)
+    for i, track in enumerate(tracks):
+        struct.pack_into("<III", header, 32 + i * 12, track["index0"], track["index1"], track["type"])
+
+    track_of = []
+    for i, track in enumerate(tracks):
+        end = tracks[i + 1]["index0"] if i + 1 < len(tracks) else count
+        track_of += [track] * (end - len(track_of))
+
+    handles = {}
+    with open(sys.argv[2], "wb") as out:
+        out.write(header)
+        subq = b"".join(subq_frame(i, tracks, patches) for i in range(count))
+        out.write(subq + bytes(data_offset - subq_offset - len(subq)))
+
+        for index, source in enumerate(sectors):
+            data_track = track_of[index]["type"] == DATA
+            if source:
+                path, file_sector = source
+                if path not in handles:
+                    handles[path] = open(path, "rb")
+                handles[path].seek(file_sector * SECTOR_SIZE)
+                sector = handles[path].read(SECTOR_SIZE)
+            elif data_track:
+                sector = filler_sector(index)
+            else:
+                sector = bytes(SECTOR_SIZE)
+            out.write(encode_sector(sector, data_track))
+
+    for handle in handles.values():
+        handle.close()
+    print(f"{cue_path}: {len(tracks)} tracks, {count} sectors")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Packs a raw 2352 byte per sector disc image for embedding in the firmware.
+
+Sectors whose sync, header, EDC and ECC can be regenerated keep only their subheader and user data, the rest are
+kept whole. Every sector is deflated on its own so any of them can be decoded straight into the sector buffer.
+
+Layout, little endian:
+    "PSMZ"  u16 version  u16 reserved  u32 sectorCount
+    u32 offsets[sectorCount + 1]       start of each sector's record, the last one is the end of the image
+    record: u8 type, raw deflate stream (Raw: 2352 bytes, Mode1: 2048, Mode2Form1: 4 + 2048, Mode2Form2: 4 + 2324)
+
+usage: pack_menu.py <input.bin> <output>
+"""
+
+import struct
+import sys
+import zlib
+
+MAGIC = b"PSMZ"
+VERSION = 1
+SECTOR_SIZE = 2352
+PREGAP = 150
+SYNC = bytes([0x00] + [0xFF] * 10 + [0x00])
+
+RAW, MODE1, MODE2_FORM1, MODE2_FORM2 = range(4)
+
+EDC_LUT = []
+for i in range(256):
+    e = i
+    for _ in range(8):
+        e = (e >> 1) ^ (0xD8018001 if e & 1 else 0)
+    EDC_LUT.append(e)
+
+ECC_F_LUT = [((i << 1) ^ (0x11D if i & 0x80 else 0)) & 0xFF for i in range(256)]
+ECC_B_LUT = [0] * 256
+for i in range(256):
+    ECC_B_LUT[i ^ ECC_F_LUT[i]] = i
+
+
+def edc(data):
+    e = 0
+    for x in data:
+        e = (e >> 8) ^ EDC_LUT[(e ^ x) & 0xFF]
+    return e
+
+
+def ecc_block(sector, major_count, minor_count, major_mult, minor_inc, dest):
+    size = major_count * minor_count
+    for major in range(major_count):
+        index = (major >> 1) * major_mult + (major & 1)
+        a = b = 0
+        for _ in range(minor_count):
+            t = sector[12 + index]
+            index += minor_inc
+            if index >= size:
+                index -= size
+            a ^= t
+            b ^= t
+            a = ECC_F_LUT[a]
+        a = ECC_B_LUT[ECC_F_LUT[a] ^ b]
+        sector[dest + major] = a
+        sector[dest + major + major_count] = a ^ b
+
+
+def ecc(sector):
+    ecc_block(sector, 86, 24, 2, 86, 0x81C)
+    ecc_block(sector, 52, 43, 86, 88, 0x8C8)
+
+
+def bcd(value):
+    return ((value // 10) << 4) | (value % 10)
+
+
+def address(index):
+    sector = index + PREGAP
+    return bytes([bcd(sector // 75 // 60), bcd(sector // 75 % 60), bcd(sector % 75)])
+
+
+def rebuild(index, mode, payload):
+    """Sector the firmware makes out of a record, mirrors MenuImage::readSector."""
+    sector = bytearray(SYNC + address(index) + bytes([1 if mode == MODE1 else 2]) + bytes(SECTOR_SIZE - 16))
+    if mode == MODE1:
+        sector[16:16 + 2048] = payload
+        struct.pack_into("<I", sector, 0x810, edc(sector[0:0x810]))
+        ecc(sector)
+    elif mode == MODE2_FORM1:
+        sector[20:20 + len(payload)] = payload
+        sector[16:20] = payload[0:4]
+        struct.pack_into("<I", sector, 0x818, edc(sector[0x10:0x818]))
+        location = sector[12:16]
+        sector[12:16] = bytes(4)
+        ecc(sector)
+        sector[12:16] = location
+    else:
+        sector[20:20 + len(payload)] = payload
+        sector[16:20] = payload[0:4]
+        struct.pack_into("<I", sector, 0x92C, edc(sector[0x10:0x92C]))
+    return bytes(sector)
+
+
+def classify(index, sector):
+    """Returns the record type and payload for a sector, Raw unless rebuilding it gives the same bytes."""
+    if sector[0:12] == SYNC and sector[12:15] == address(index):
+        if sector[15] == 1:
+            candidates = [(MODE1, sector[16:16 + 2048])]
+        elif sector[15] == 2 and sector[16:20] == sector[20:24]:
+            mode = MODE2_FORM2 if sector[18] & 0x20 else MODE2_FORM1
+            length = 4 + (2324 if mode == MODE2_FORM2 else 2048)
+            candidates = [(mode, sector[20:20 + length])]
+        else:
+            candidates = []
+        for mode, payload in candidates:
+            if rebuild(index, mode, payload) == sector:
+                return mode, payload
+    return RAW, sector
+
+
+def deflate(data):
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+    return compressor.compress(data) + compressor.flush()
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+
+    with open(sys.argv[1], "rb") as f:
+        image = f.read()
+    if len(image) % SECTOR_SIZE:
+        sys.exit(f"{sys.argv[1]}: size is not a multiple of {SECTOR_SIZE}")
+
+    count = len(image) // SECTOR_SIZE
+    records = []
+    for index in range(count):
+        mode, payload = classify(index, image[index * SECTOR_SIZE:(index + 1) * SECTOR_SIZE])
+        records.append(bytes([mode]) + deflate(payload))
+
+    offset = 12 + 4 * (count + 1)
+    offsets = []
+    for record in records:
+        offsets.append(offset)
+        offset += len(record)
+    offsets.append(offset)
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(MAGIC + struct.pack("<HHI", VERSION, 0, count))
+        f.write(struct.pack(f"<{count + 1}I", *offsets))
+        for record in records:
+            f.write(record)
+
+    raw = sum(1 for record in records if record[0] == RAW)
+    print(f"{sys.argv[1]}: {count} sectors, {len(image)} -> {offset} bytes, {raw} kept whole")
+
+
+if __name__ == "__main__":
+    main()